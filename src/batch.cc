@@ -0,0 +1,418 @@
+#include "batch.h"
+#include "blockcache.h"
+#include "cpu65xops.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <stdexcept>
+
+typedef uint8_t LaneBytes[CpuBatch::LANES];
+
+// where A, X and Y sit in reg32, as CPU::A() and the others read them
+struct LaneReg {
+    uint8_t word;
+    uint8_t shift;
+};
+
+enum : uint8_t { RegA, RegX, RegY };
+static constexpr LaneReg laneRegs[] = { {0, 8}, {0, 24}, {1, 8} };
+
+static inline void get(const CpuBatch& b, uint8_t reg, LaneBytes out) {
+    auto r = laneRegs[reg];
+    for(unsigned l=0; l<CpuBatch::LANES; l++) out[l] = b.reg32[r.word][l] >> r.shift;
+}
+
+static inline void set(CpuBatch& b, uint8_t reg, const LaneBytes in) {
+    auto r = laneRegs[reg];
+    for(unsigned l=0; l<CpuBatch::LANES; l++) {
+        b.reg32[r.word][l] = (b.reg32[r.word][l] & ~(0xffu << r.shift)) | uint32_t(in[l]) << r.shift;
+    }
+}
+
+// CPU::set_flags(flags, 8, v1, v2, addend) on one lane's P
+template<uint8_t flags>
+static inline uint8_t lane_flags(uint8_t p, unsigned v1, unsigned v2, unsigned addend = 0) {
+    p &= ~flags;
+    if constexpr ((flags & ZF_Mask) != 0) p |= (v1 == 0) << 1;
+    if constexpr ((flags & NF_Mask) != 0) p |= ((v1 >> 7) & 1) << 7;
+    if constexpr ((flags & CF_Mask) != 0) p |= v1 < v2;
+    if constexpr ((flags & OF_Mask) != 0) p |= ((~(v2 ^ addend) & (v2 ^ v1)) >> 7 & 1) << 6;
+    return p;
+}
+
+static constexpr uint8_t NZ = NF_Mask | ZF_Mask;
+static constexpr uint8_t NZC = NF_Mask | ZF_Mask | CF_Mask;
+static constexpr uint8_t NZCV = NF_Mask | ZF_Mask | CF_Mask | OF_Mask;
+
+enum LaneAlu : uint8_t { AluADC, AluSBC, AluAND, AluORA, AluEOR, AluCMP, AluCPX, AluCPY, AluLDA, AluLDX, AluLDY };
+
+// the alu:: policies on every lane, with the operand in v
+static void alu(CpuBatch& b, LaneAlu op, const LaneBytes v) {
+    constexpr unsigned N = CpuBatch::LANES;
+    LaneBytes r;
+    switch(op) {
+        case AluADC:
+            get(b, RegA, r);
+            for(unsigned l=0; l<N; l++) {
+                uint8_t a = r[l];
+                auto res = a + v[l] + (b.p[l] & CF_Mask);
+                r[l] = res;
+                b.p[l] = lane_flags<NZCV>(b.p[l], res, a, v[l]);
+            }
+            set(b, RegA, r);
+            break;
+        case AluSBC:
+            get(b, RegA, r);
+            for(unsigned l=0; l<N; l++) {
+                uint8_t a = r[l];
+                uint8_t c = b.p[l] & CF_Mask;
+                auto res = a - v[l] - ~c;
+                r[l] = res;
+                b.p[l] = lane_flags<NZCV>(b.p[l], res, a, ~v[l]);
+            }
+            set(b, RegA, r);
+            break;
+        case AluAND:
+        case AluORA:
+        case AluEOR:
+            get(b, RegA, r);
+            for(unsigned l=0; l<N; l++) {
+                auto res = op == AluAND ? r[l] & v[l] : op == AluORA ? r[l] | v[l] : r[l] ^ v[l];
+                r[l] = res;
+                b.p[l] = lane_flags<NZ>(b.p[l], res, 0);
+            }
+            set(b, RegA, r);
+            break;
+        case AluCMP:
+        case AluCPX:
+        case AluCPY:
+            get(b, op == AluCMP ? RegA : op == AluCPX ? RegX : RegY, r);
+            for(unsigned l=0; l<N; l++) {
+                auto res = r[l] - v[l];
+                b.p[l] = lane_flags<NZC>(b.p[l], res, r[l]);
+            }
+            break;
+        default:
+            set(b, op == AluLDA ? RegA : op == AluLDX ? RegX : RegY, v);
+            for(unsigned l=0; l<N; l++) b.p[l] = lane_flags<NZ>(b.p[l], v[l], 0);
+            break;
+    }
+}
+
+enum LaneKind : uint8_t {
+    KindNone,     // not run in lockstep
+    KindRead,     // alu op on an operand
+    KindStore,    // register to memory
+    KindStep,     // INC/DEC memory
+    KindStepReg,  // INX, INY, DEX, DEY
+    KindTransfer, // TAX, TAY, TXA, TYA
+    KindCarry,    // CLC, SEC
+    KindNop,
+    KindJump,
+    KindBranch
+};
+
+enum LaneMode : uint8_t { Implied, Imm, Zp, Abs };
+
+struct LaneOp {
+    LaneKind kind = KindNone;
+    LaneMode mode = Implied;
+    uint8_t arg = 0;  // LaneAlu, register, transfer from | to << 4, or the flag a branch tests
+    int8_t delta = 0; // INC/DEC step, carry value, or whether a branch is taken with its flag set
+    uint8_t cycles = 0;
+};
+
+struct LaneOps {
+    LaneOp ops[256];
+
+    LaneOps() {
+        static constexpr struct { uint8_t opcode; LaneMode mode; LaneAlu alu; } reads[] = {
+            { ADC_Immediate, Imm, AluADC }, { ADC_ZeroPage, Zp, AluADC }, { ADC_Absolute, Abs, AluADC },
+            { SBC_Immediate, Imm, AluSBC }, { SBC_ZeroPage, Zp, AluSBC }, { SBC_Absolute, Abs, AluSBC },
+            { AND_Immediate, Imm, AluAND }, { AND_ZeroPage, Zp, AluAND }, { AND_Absolute, Abs, AluAND },
+            { ORA_Immediate, Imm, AluORA }, { ORA_ZeroPage, Zp, AluORA }, { ORA_Absolute, Abs, AluORA },
+            { EOR_Immediate, Imm, AluEOR }, { EOR_ZeroPage, Zp, AluEOR }, { EOR_Absolute, Abs, AluEOR },
+            { CMP_Immediate, Imm, AluCMP }, { CMP_ZeroPage, Zp, AluCMP }, { CMP_Absolute, Abs, AluCMP },
+            { CPX_Immediate, Imm, AluCPX }, { CPX_ZeroPage, Zp, AluCPX }, { CPX_Absolute, Abs, AluCPX },
+            { CPY_Immediate, Imm, AluCPY }, { CPY_ZeroPage, Zp, AluCPY }, { CPY_Absolute, Abs, AluCPY },
+            { LDA_Immediate, Imm, AluLDA }, { LDA_ZeroPage, Zp, AluLDA }, { LDA_Absolute, Abs, AluLDA },
+            { LDX_Immediate, Imm, AluLDX }, { LDX_ZeroPage, Zp, AluLDX }, { LDX_Absolute, Abs, AluLDX },
+            { LDY_Immediate, Imm, AluLDY }, { LDY_ZeroPage, Zp, AluLDY }, { LDY_Absolute, Abs, AluLDY },
+        };
+        for(auto& r : reads) {
+            ops[r.opcode] = { KindRead, r.mode, r.alu, 0, uint8_t(r.mode == Imm ? 2 : r.mode == Zp ? 3 : 4) };
+        }
+        ops[STA_ZeroPage] = { KindStore, Zp, RegA, 0, 3 };
+        ops[STX_ZeroPage] = { KindStore, Zp, RegX, 0, 3 };
+        ops[STY_ZeroPage] = { KindStore, Zp, RegY, 0, 3 };
+        ops[STA_Absolute] = { KindStore, Abs, RegA, 0, 4 };
+        ops[STX_Absolute] = { KindStore, Abs, RegX, 0, 4 };
+        ops[STY_Absolute] = { KindStore, Abs, RegY, 0, 4 };
+        ops[INC_ZeroPage] = { KindStep, Zp, 0, 1, 5 };
+        ops[DEC_ZeroPage] = { KindStep, Zp, 0, -1, 5 };
+        ops[INC_Absolute] = { KindStep, Abs, 0, 1, 6 };
+        ops[DEC_Absolute] = { KindStep, Abs, 0, -1, 6 };
+        ops[INX] = { KindStepReg, Implied, RegX, 1, 2 };
+        ops[INY] = { KindStepReg, Implied, RegY, 1, 2 };
+        ops[DEX] = { KindStepReg, Implied, RegX, -1, 2 };
+        ops[DEY] = { KindStepReg, Implied, RegY, -1, 2 };
+        ops[TAX] = { KindTransfer, Implied, RegA | RegX << 4, 0, 2 };
+        ops[TAY] = { KindTransfer, Implied, RegA | RegY << 4, 0, 2 };
+        ops[TXA] = { KindTransfer, Implied, RegX | RegA << 4, 0, 2 };
+        ops[TYA] = { KindTransfer, Implied, RegY | RegA << 4, 0, 2 };
+        ops[CLC] = { KindCarry, Implied, 0, 0, 2 };
+        ops[SEC] = { KindCarry, Implied, 0, 1, 2 };
+        ops[NOP] = { KindNop, Implied, 0, 0, 2 };
+        ops[JMP_Absolute] = { KindJump, Abs, 0, 0, 3 };
+        // as the handlers test them, BCC/BCS included
+        ops[BCC] = { KindBranch, Imm, CF_Mask, 1, 2 };
+        ops[BCS] = { KindBranch, Imm, CF_Mask, 0, 2 };
+        ops[BEQ] = { KindBranch, Imm, ZF_Mask, 1, 2 };
+        ops[BNE] = { KindBranch, Imm, ZF_Mask, 0, 2 };
+        ops[BMI] = { KindBranch, Imm, NF_Mask, 1, 2 };
+        ops[BPL] = { KindBranch, Imm, NF_Mask, 0, 2 };
+        ops[BVS] = { KindBranch, Imm, OF_Mask, 1, 2 };
+        ops[BVC] = { KindBranch, Imm, OF_Mask, 0, 2 };
+    }
+};
+
+static const LaneOps laneOps;
+
+// what every lane of a group allows on a DS page, found on first use
+enum : uint8_t { AccessChecked = 1, AccessRead = 2, AccessWrite = 4 };
+
+// whether a code page is the same in every lane, found on first use
+enum : uint8_t { CodeUnknown, CodeSame, CodeDiffers };
+
+unsigned CpuBatch::add(CPU& cpu, Memory& ram) {
+    if(lanes == LANES) throw std::length_error(format("a batch holds at most %u lanes", LANES));
+    this->cpu[lanes] = &cpu;
+    this->ram[lanes] = &ram;
+    return lanes++;
+}
+
+unsigned CpuBatch::lockstep(uint32_t group, uint64_t room) {
+    // the group's lanes, and their segments as the cpu has them bound
+    unsigned lane[LANES];
+    const uint8_t* code[LANES];
+    uint8_t* data[LANES];
+    const uint8_t* types[LANES];
+    uint8_t* dirty[LANES];
+    BlockCache* blocks[LANES];
+    unsigned n = 0;
+    for(unsigned l=0; l<lanes; l++) {
+        if(!(group >> l & 1)) continue;
+        auto& c = *cpu[l];
+        for(unsigned r=0; r<8; r++) reg32[r][l] = c.reg32[r];
+        pc[l] = c.PC;
+        sp[l] = c.SP;
+        p[l] = c.P.asByte();
+        ps[l] = c.PS;
+        ds[l] = c.DS;
+        ss[l] = c.SS;
+        code[n] = c.psData;
+        data[n] = c.dsData;
+        types[n] = c.dsPages;
+        dirty[n] = c.dsDirty;
+        blocks[n] = ram[l]->blocks;
+        lane[n++] = l;
+    }
+    uint8_t sameCode[256] = {};
+    uint8_t access[256] = {};
+    auto lead = lane[0];
+    uint16_t at = pc[lead];
+    uint64_t spent = 0;
+    unsigned count = 0;
+    uint16_t lastPC = 0;
+    uint8_t lastOp = 0;
+    uint8_t lastCycles = 0;
+    LaneBytes v, r;
+
+    while(spent < room) {
+        uint8_t opcode = code[0][at];
+        auto& op = laneOps.ops[opcode];
+        if(op.kind == KindNone) break;
+        unsigned length = op.mode == Abs ? 3 : op.mode == Implied ? 1 : 2;
+        uint8_t page = at >> 8;
+        if(sameCode[page] == CodeUnknown) {
+            bool same = true;
+            for(unsigned i=1; i<n; i++) same &= memcmp(code[i] + (page << 8), code[0] + (page << 8), 256) == 0;
+            sameCode[page] = same ? CodeSame : CodeDiffers;
+        }
+        if(sameCode[page] != CodeSame || uint8_t((at + length - 1) >> 8) != page) {
+            bool same = true;
+            for(unsigned i=1; i<n; i++) {
+                for(unsigned k=0; k<length; k++) same &= code[i][uint16_t(at + k)] == code[0][uint16_t(at + k)];
+            }
+            if(!same) break;
+        }
+        uint8_t a8 = code[0][uint16_t(at + 1)];
+        uint16_t a16 = a8 | code[0][uint16_t(at + 2)] << 8;
+        uint16_t adr = op.mode == Zp ? a8 : a16;
+
+        // devices, and writes to ROM, are left to the lanes on their own
+        if(op.kind == KindRead || op.kind == KindStore || op.kind == KindStep) {
+            auto& allowed = access[adr >> 8];
+            if(!allowed) {
+                allowed = AccessChecked | AccessRead | AccessWrite;
+                for(unsigned i=0; i<n; i++) {
+                    auto type = types[i][adr >> 8];
+                    if(type == PageDevice) allowed &= ~AccessRead;
+                    if(type != PageRAM) allowed &= ~AccessWrite;
+                }
+            }
+            if(op.mode != Imm && !(allowed & (op.kind == KindRead ? AccessRead : AccessWrite))) break;
+        }
+        if(op.kind == KindBranch) {
+            bool flag = p[lead] & op.arg;
+            bool same = true;
+            for(unsigned i=1; i<n; i++) same &= bool(p[lane[i]] & op.arg) == flag;
+            if(!same) break;
+        }
+
+        // CPU::writeData, on a page known to be RAM
+        auto store = [&](unsigned i, uint8_t byte) {
+            data[i][adr] = byte;
+            dirty[i][adr >> 8] = 1;
+            if(blocks[i]) blocks[i]->written(ds[lane[i]], adr);
+        };
+        // a lane that stores into its own code keeps it in step only if the others match
+        auto stored = [&]() {
+            if(sameCode[adr >> 8] != CodeSame) return;
+            for(unsigned i=1; i<n; i++) {
+                if(code[i][adr] != code[0][adr]) sameCode[adr >> 8] = CodeDiffers;
+            }
+        };
+
+        uint16_t next = at + length;
+        unsigned cycles = op.cycles;
+        switch(op.kind) {
+            case KindRead:
+                if(op.mode == Imm) memset(v, a8, LANES);
+                else for(unsigned i=0; i<n; i++) v[lane[i]] = data[i][adr];
+                alu(*this, LaneAlu(op.arg), v);
+                break;
+            case KindStore:
+                get(*this, op.arg, r);
+                for(unsigned i=0; i<n; i++) store(i, r[lane[i]]);
+                stored();
+                break;
+            case KindStep:
+                for(unsigned i=0; i<n; i++) {
+                    auto l = lane[i];
+                    auto res = data[i][adr] + op.delta;
+                    store(i, res);
+                    p[l] = lane_flags<NZ>(p[l], res, 0);
+                }
+                stored();
+                break;
+            case KindStepReg:
+                get(*this, op.arg, r);
+                for(unsigned l=0; l<LANES; l++) {
+                    auto res = r[l] + op.delta;
+                    r[l] = res;
+                    p[l] = lane_flags<NZ>(p[l], res, 0);
+                }
+                set(*this, op.arg, r);
+                break;
+            case KindTransfer:
+                get(*this, op.arg & 0xf, r);
+                set(*this, op.arg >> 4, r);
+                break;
+            case KindCarry:
+                for(unsigned l=0; l<LANES; l++) p[l] = (p[l] & ~CF_Mask) | op.delta;
+                break;
+            case KindJump:
+                next = a16;
+                break;
+            case KindBranch:
+                if(bool(p[lead] & op.arg) == bool(op.delta)) {
+                    uint16_t target = next + (int8_t)a8;
+                    if((target & 0xff00) != (next & 0xff00)) cycles++;
+                    next = target;
+                }
+                break;
+            default:
+                break;
+        }
+        lastPC = at;
+        lastOp = opcode;
+        lastCycles = cycles;
+        at = next;
+        spent += cycles;
+        count++;
+    }
+
+    if(!count) return 0;
+    for(unsigned i=0; i<n; i++) {
+        auto l = lane[i];
+        auto& c = *cpu[l];
+        for(unsigned r=0; r<8; r++) c.reg32[r] = reg32[r][l];
+        c.PC = pc[l] = at;
+        c.P.setByte(p[l]);
+        c.cycles += spent;
+        c.instructions += count;
+        c.opSeg = ps[l];
+        c.opPC = lastPC;
+        c.OP = lastOp;
+        c.opCC = lastCycles;
+    }
+    lockstepInstructions += uint64_t(count) * n;
+    return count;
+}
+
+void CpuBatch::run_for_cycles(uint64_t n) {
+    uint64_t limit[LANES], startCycles[LANES], startInstructions[LANES];
+    uint32_t running = 0;
+    for(unsigned l=0; l<lanes; l++) {
+        auto& c = *cpu[l];
+        if(c.state == Halt) c.state = Normal;
+        if(c.state == Reset) c.reset(*ram[l]);
+        c.bind(*ram[l]);
+        // counted from after a reset, as run_for_cycles does
+        limit[l] = c.cycles > UINT64_MAX - n ? UINT64_MAX : c.cycles + n;
+        c.illegalStop = false;
+        startCycles[l] = c.cycles;
+        startInstructions[l] = c.instructions;
+        running |= 1u << l;
+    }
+    while(running) {
+        // the lanes furthest behind go next
+        uint32_t group = 0;
+        uint32_t lowest = UINT32_MAX;
+        for(unsigned l=0; l<lanes; l++) {
+            if(!(running >> l & 1)) continue;
+            uint32_t key = cpu[l]->PS << 16 | cpu[l]->PC;
+            if(key < lowest) {
+                lowest = key;
+                group = 0;
+            }
+            if(key == lowest) group |= 1u << l;
+        }
+        uint32_t together = 0;
+        uint64_t room = UINT64_MAX;
+        for(unsigned l=0; l<lanes; l++) {
+            auto& c = *cpu[l];
+            if(!(group >> l & 1) || c.tracing || c.traceRing || c.opStats || c.profiler) continue;
+            auto deadline = std::min(limit[l], c.nextEvent);
+            if(c.state != Normal || c.cycles >= deadline) continue;
+            together |= 1u << l;
+            room = std::min(room, deadline - c.cycles);
+        }
+        if(std::popcount(together) < 2 || !lockstep(together, room)) {
+            for(unsigned l=0; l<lanes; l++) {
+                if(!(group >> l & 1)) continue;
+                cpu[l]->execute_next_instruction(*ram[l]);
+                scalarInstructions++;
+            }
+        }
+        for(unsigned l=0; l<lanes; l++) {
+            auto& c = *cpu[l];
+            if(!(group >> l & 1) || (c.state == Normal && c.cycles < limit[l])) continue;
+            c.P.sync();
+            stop[l] = c.stop_reason(startCycles[l], startInstructions[l]);
+            running &= ~(1u << l);
+        }
+    }
+}
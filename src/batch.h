@@ -0,0 +1,59 @@
+#ifndef __BATCH_H
+#define __BATCH_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "cpu65x.h"
+#include "memory.h"
+
+/*
+    Lockstep execution of instances running the same program on different
+    data, each lane with its own CPU and Memory. Lanes whose PS:PC agree
+    and whose code bytes match there run as one group: each instruction is
+    decoded once and applied to every lane's copy of the registers, kept
+    here as structure-of-arrays so the per-lane work is a fixed-width loop
+    the compiler turns into vector code. Loads and stores go to each lane's
+    own DS segment.
+
+    The group covers what the JIT does (implied, immediate, zero page and
+    absolute loads, stores, ALU ops, INC/DEC and transfers) plus branches
+    and JMP. Anything else, a page that is not plain RAM, a branch the
+    lanes take different ways, an event coming due or the budget running
+    out ends the group's run. From there lanes step on their own CPU, those
+    at the lowest PS:PC first, so lanes that went different ways catch up
+    and join again where their paths meet. Lanes that trace, count or
+    profile always step on their own. Results match running each lane
+    alone with the interpreter, cycle for cycle.
+*/
+struct CpuBatch {
+    static constexpr unsigned LANES = 16;
+
+    unsigned lanes = 0;
+    CPU* cpu[LANES];
+    Memory* ram[LANES];
+    StopReason stop[LANES]; // how each lane's last run ended
+
+    // the lanes' state while a group runs, [register][lane]
+    uint32_t reg32[8][LANES];
+    uint16_t pc[LANES];
+    uint16_t sp[LANES];
+    uint8_t p[LANES]; // ProcessorStatus::asByte()
+    uint8_t ps[LANES];
+    uint8_t ds[LANES];
+    uint8_t ss[LANES];
+
+    // lane instructions run by groups and by single lanes
+    uint64_t lockstepInstructions = 0;
+    uint64_t scalarInstructions = 0;
+
+    // returns the lane; the cpu and memory stay the caller's
+    unsigned add(CPU& cpu, Memory& ram);
+    // runs every lane n cycles of its own or to its stop, as run_for_cycles does
+    void run_for_cycles(uint64_t n);
+    // runs the lanes in `group`, all at the same PS:PC, together for up to
+    // `room` cycles; returns the instructions each ran, 0 if none could
+    unsigned lockstep(uint32_t group, uint64_t room);
+};
+
+#endif
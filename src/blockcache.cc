@@ -0,0 +1,163 @@
+#include "blockcache.h"
+#include "memory.h"
+#include "cpu65xops.h"
+#include "utils.h"
+
+#include <algorithm>
+
+template<class... Op> static constexpr Fusion makeFusion(const char* name, Op... op) {
+    return { name, uint8_t(sizeof...(op)), uint8_t((opcodeLength[op] + ...)), { uint8_t(op)... } };
+}
+
+#define FUSION_ENTRY(...) makeFusion(#__VA_ARGS__, __VA_ARGS__),
+const Fusion fusions[NUM_FUSIONS] = {
+    { "", 0, 0, {} },
+    FOR_EACH_FUSION(FUSION_ENTRY)
+};
+#undef FUSION_ENTRY
+
+// index of the longest fusion matching ops[0..n), 0 if none does
+static uint8_t matchFusion(const DecodedOp* ops, size_t n) {
+    uint8_t best = 0;
+    for(size_t f=1; f<NUM_FUSIONS; f++) {
+        auto& fusion = fusions[f];
+        if(fusion.count > n || (best && fusion.count <= fusions[best].count)) continue;
+        bool match = true;
+        for(size_t i=0; i<fusion.count; i++) {
+            if(ops[i].opcode != fusion.ops[i]) match = false;
+        }
+        if(match) best = f;
+    }
+    return best;
+}
+
+// instructions that never fall through to the next one
+static constexpr bool endsBlock(uint8_t opcode) {
+    switch(opcode) {
+        case BRK:
+        case BRA:
+        case JMP_Absolute:
+        case JMP_Indirect:
+        case JSR_Absolute:
+        case RTI:
+        case RTS:
+            return true;
+        default:
+            return false;
+    }
+}
+
+Block* BlockCache::find(Memory& ram, uint32_t key) {
+    Block* block;
+    auto it = blocks.find(key);
+    if(it != blocks.end()) {
+        block = it->second.get();
+    } else {
+        block = decode(ram, key);
+    }
+    fast[slot(key)] = block;
+    return block;
+}
+
+Block* BlockCache::decode(Memory& ram, uint32_t key) {
+    auto block = std::make_unique<Block>();
+    block->key = key;
+    uint8_t seg = key >> 16;
+    uint16_t adr = key & 0xffff;
+    while(true) {
+        auto opcode = ram.peek(seg, adr);
+        auto length = opcodeLength[opcode];
+        uint16_t operand = 0;
+        for(unsigned i=length; i>1; i--) operand = operand << 8 | ram.peek(seg, adr + i - 1);
+        block->ops.push_back({opcode, length, 0, operand});
+        // register every page the opcode and its operand bytes sit on
+        for(unsigned i=0; i<(length ? length : 1); i++) {
+            uint32_t page = (seg << 8) | (uint16_t(adr + i) >> 8);
+            auto& pages = block->pages;
+            if(std::find(pages.begin(), pages.end(), page) != pages.end()) continue;
+            pages.push_back(page);
+            codePage[page] = 1;
+            auto& keys = pageBlocks[page];
+            if(std::find(keys.begin(), keys.end(), key) == keys.end()) keys.push_back(key);
+        }
+        if(length == 0 || endsBlock(opcode) || block->ops.size() == MAX_OPS) break;
+        adr += length;
+    }
+    auto& ops = block->ops;
+    for(size_t i=0; i<ops.size(); i++) {
+        ops[i].fusion = matchFusion(&ops[i], ops.size() - i);
+    }
+    auto result = block.get();
+    blocks[key] = std::move(block);
+    return result;
+}
+
+void BlockCache::invalidate_page(uint32_t page) {
+    auto it = pageBlocks.find(page);
+    if(it != pageBlocks.end()) {
+        auto keys = std::move(it->second);
+        pageBlocks.erase(it);
+        for(auto key : keys) drop(key);
+    }
+    codePage[page] = 0;
+    epoch++;
+}
+
+// forgets the block at key and takes it off the other pages it sits on
+void BlockCache::drop(uint32_t key) {
+    auto b = blocks.find(key);
+    if(b == blocks.end()) return;
+    auto block = b->second.get();
+    for(auto page : block->pages) {
+        auto it = pageBlocks.find(page);
+        if(it == pageBlocks.end()) continue;
+        auto& keys = it->second;
+        keys.erase(std::remove(keys.begin(), keys.end(), key), keys.end());
+        if(keys.empty()) {
+            pageBlocks.erase(it);
+            codePage[page] = 0;
+        }
+    }
+    auto& s = fast[slot(key)];
+    if(s == block) s = nullptr;
+    blocks.erase(b);
+}
+
+void BlockCache::invalidate_range(uint8_t seg, uint16_t adr, size_t len) {
+    if(len == 0) return;
+    if(len > 0x10000) len = 0x10000;
+    unsigned first = adr >> 8;
+    unsigned last = first + ((adr & 0xff) + len - 1) / 256;
+    for(unsigned p=first; p<=last; p++) {
+        uint32_t page = (seg << 8) | (p & 0xff);
+        if(codePage[page]) invalidate_page(page);
+    }
+}
+
+BlockCache::~BlockCache() {
+    if(jit != nullptr) delete jit;
+}
+
+void BlockCache::translate(Memory& ram, Block& block) {
+    if(!jit) jit = new Jit;
+    if(jit->translate(ram, block) || !jit->full) return;
+    // the arena is full: forget every translation and start over
+    for(auto& b : blocks) b.second->native = nullptr;
+    jit->reset();
+    jit->translate(ram, block);
+}
+
+void BlockCache::clear() {
+    blocks.clear();
+    pageBlocks.clear();
+    for(auto& s : fast) s = nullptr;
+    for(auto& p : codePage) p = 0;
+    if(jit) jit->reset();
+    epoch++;
+}
+
+void BlockCache::dump_fusions(std::ostream& ostr) {
+    for(size_t f=1; f<NUM_FUSIONS; f++) {
+        ostr << format("%-32s %12llu", fusions[f].name, (unsigned long long)fusionRuns[f]) << std::endl;
+    }
+}
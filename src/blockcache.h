@@ -0,0 +1,120 @@
+#ifndef __BLOCKCACHE_H
+#define __BLOCKCACHE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <iostream>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "cpu65xops.h"
+#include "jit65x.h"
+
+struct Memory;
+
+/*
+    Straight-line guest code, decoded once into a run of opcodes and their
+    operands keyed by segment:address. Decoding stops after an
+    unconditional transfer or an instruction whose length is not known up
+    front (the xtop groups and unimplemented opcodes); the executor leaves
+    a block early whenever an instruction does not fall through to the
+    next one.
+
+    Every page holding a decoded opcode is marked, and Memory::write drops
+    all blocks on a marked page it writes to. A dropped block is taken off
+    every page it was registered on, so a page's list only ever holds the
+    live blocks on it.
+*/
+
+/*
+    Opcode runs that blocks execute as one fused handler when
+    cpu.fuseInstructions is set. Only the last instruction of a run may
+    write memory, so a run never has to re-check the block it came from.
+*/
+#define FOR_EACH_FUSION(X) \
+    X(INX, CPX_Immediate, BNE) \
+    X(INY, CPY_Immediate, BNE) \
+    X(DEX, BNE) \
+    X(DEY, BNE) \
+    X(INX, BNE) \
+    X(INY, BNE) \
+    X(CMP_Immediate, BEQ) \
+    X(CMP_Immediate, BNE) \
+    X(LDA_ZeroPage, STA_Absolute) \
+    X(LDA_ZeroPage, STA_ZeroPage) \
+    X(LDA_Immediate, STA_ZeroPage) \
+    X(ADC_ZeroPage, STA_ZeroPage)
+
+struct Fusion {
+    const char* name;
+    uint8_t count;  // instructions in the run
+    uint8_t length; // bytes in the run
+    uint8_t ops[3];
+};
+
+#define FUSION_COUNT(...) + 1
+static constexpr size_t NUM_FUSIONS = 1 FOR_EACH_FUSION(FUSION_COUNT); // entry 0 is "not fused"
+#undef FUSION_COUNT
+
+extern const Fusion fusions[NUM_FUSIONS];
+
+struct DecodedOp {
+    uint8_t opcode;
+    uint8_t length; // 0 if unknown, always the last op of its block
+    uint8_t fusion = 0; // index into fusions of the run starting here
+    uint16_t operand = 0; // the bytes after the opcode, little-endian
+};
+
+struct Block {
+    uint32_t key; // seg << 16 | adr
+    std::vector<DecodedOp> ops;
+    std::vector<uint32_t> pages; // the pages it is registered on in BlockCache::pageBlocks
+    unsigned hits = 0; // runs, counted up to Jit::HOT_BLOCK
+    JitBlockFn native = nullptr;
+    uint32_t nativeCycles = 0; // most cycles and instructions of one native pass
+    uint32_t nativeOps = 0;
+};
+
+struct BlockCache {
+    static constexpr size_t NUM_PAGES = 256 * 256; // 256-byte pages of all segments
+    static constexpr size_t MAX_OPS = 64;
+    static constexpr size_t FAST_SLOTS = 1024;
+
+    uint64_t epoch = 0; // bumped whenever blocks are dropped
+    uint8_t codePage[NUM_PAGES] = {};
+
+    std::unordered_map<uint32_t, std::unique_ptr<Block>> blocks;
+    std::unordered_map<uint32_t, std::vector<uint32_t>> pageBlocks; // keys of the blocks on each page
+    Block* fast[FAST_SLOTS] = {};
+    Jit* jit = nullptr; // created by the first translation
+    uint64_t fusionRuns[NUM_FUSIONS] = {}; // fused runs executed, by fusion
+
+    ~BlockCache();
+
+    inline Block* lookup(Memory& ram, uint8_t seg, uint16_t adr) {
+        uint32_t key = (seg << 16) | adr;
+        auto block = fast[slot(key)];
+        if(block && block->key == key) return block;
+        return find(ram, key);
+    }
+
+    inline void written(uint8_t seg, uint16_t adr) {
+        uint32_t page = (seg << 8) | (adr >> 8);
+        if(codePage[page]) invalidate_page(page);
+    }
+
+    void invalidate_page(uint32_t page);
+    void drop(uint32_t key);
+    void invalidate_range(uint8_t seg, uint16_t adr, size_t len);
+    void clear();
+    void translate(Memory& ram, Block& block);
+    void dump_fusions(std::ostream& ostr);
+
+    static inline size_t slot(uint32_t key) { return (key ^ (key >> 10)) % FAST_SLOTS; }
+    Block* find(Memory& ram, uint32_t key);
+    Block* decode(Memory& ram, uint32_t key);
+};
+
+#endif
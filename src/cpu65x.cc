@@ -1,50 +1,280 @@
 #include "cpu65x.h"
 #include "cpu65xops.h"
+#include "cpu65xkernels.h"
 #include "xtop1imp.h"
 #include "xtop2imp.h"
 #include "xtop3imp.h"
+#include "jit65x.h"
 
-#define CHECK_CPU_MODE(mode, op) do { if(!mode) { illegalInstruction(op); } } while(0)
+#include <array>
+#include <utility>
+#include <string.h>
+
+template<class T> static const OpHandler* selectOpTable(uint8_t model);
+static const OpHandler* selectFusedTable(uint8_t model);
+static const OpHandler* selectBlockOpTable(uint8_t model);
 
 void CPU::reset(Memory& ram) {
+    if(tracing) reset<Trace>(ram);
+    else if(traceRing) reset<RecordTrace>(ram);
+    else if(opStats) reset<CountOps>(ram);
+    else if(profiler) reset<Profile>(ram);
+    else reset<NoTrace>(ram);
+}
+
+template<class T> void CPU::reset(Memory& ram) {
     init();
-    auto resetv = readWord(ram, 0, 0xfffc);
-    if(tracing) std::cout << format("Reset vector: 00:%04X\n", resetv);
+    model = (allow65c02 ? Model65c02 : Model6502) | (allow65x02 ? Model65x02 : Model6502);
+    opTable = selectOpTable<NoTrace>(model);
+    traceOpTable = selectOpTable<Trace>(model);
+    recordOpTable = selectOpTable<RecordTrace>(model);
+    countOpTable = selectOpTable<CountOps>(model);
+    profileOpTable = selectOpTable<Profile>(model);
+    fusedTable = selectFusedTable(model);
+    blockOpTable = selectBlockOpTable(model);
+    auto resetv = readWord<T>(ram, 0, 0xfffc);
+    if constexpr (T::enabled) std::cout << format("Reset vector: 00:%04X\n", resetv);
     PC = resetv;
     PS = 0;
     DS = 0;
     SS = 0;
+    bind(ram);
+    select_segments();
     state = Normal;
-    if(tracing) std::cout << format("CPU: NORMAL @ %02X:%04X\n", PS, PC);
+    if constexpr (T::profiles) profiler->restart(cycles);
+    if constexpr (T::enabled) std::cout << format("CPU: NORMAL @ %02X:%04X\n", PS, PC);
 }
 
+/*
+    Run budgets. The run loops test spent() once per instruction; Unbounded
+    folds away entirely, the others are a single compare against a counter
+    the cpu maintains anyway. run() calls start() once any reset is done,
+    since init() zeroes the counters the limit is measured on.
+*/
+struct Unbounded {
+    void start(const CPU& cpu) {}
+    bool spent(const CPU& cpu) const { return false; }
+    bool allows(const CPU& cpu, unsigned n) const { return true; }
+    JitLimits limits(const CPU& cpu) const { return {UINT64_MAX, UINT64_MAX}; }
+};
+
+// most cycles any single 6502 instruction takes
+static constexpr unsigned MAX_OP_CYCLES = 7;
+
+template<uint64_t CPU::*counter>
+struct Budget {
+    uint64_t n;
+    uint64_t limit = UINT64_MAX;
+    void start(const CPU& cpu) { limit = cpu.*counter > UINT64_MAX - n ? UINT64_MAX : cpu.*counter + n; }
+    bool spent(const CPU& cpu) const { return cpu.*counter >= limit; }
+    // true if n instructions in a row cannot spend the budget before the last one starts
+    bool allows(const CPU& cpu, unsigned n) const {
+        if constexpr (counter == &CPU::cycles) return cpu.cycles + MAX_OP_CYCLES * (n - 1) < limit;
+        else return cpu.instructions + (n - 1) < limit;
+    }
+    JitLimits limits(const CPU& cpu) const {
+        if constexpr (counter == &CPU::cycles) return {limit, UINT64_MAX};
+        else return {UINT64_MAX, limit};
+    }
+};
+
+typedef Budget<&CPU::cycles> CycleBudget;
+typedef Budget<&CPU::instructions> InstructionBudget;
+
+/*
+    What the engines run on: the caller's budget, cut short once cycles
+    reach cpu.nextEvent. It is read live, so an event posted or an IRQ
+    unmasked by the instruction just run stops the engine at the next
+    boundary. Under Unbounded this is the only compare left.
+*/
+template<class B> struct UntilEvent {
+    B budget;
+    bool spent(const CPU& cpu) const { return cpu.cycles >= cpu.nextEvent || budget.spent(cpu); }
+    bool allows(const CPU& cpu, unsigned n) const {
+        return cpu.cycles + MAX_OP_CYCLES * (n - 1) < cpu.nextEvent && budget.allows(cpu, n);
+    }
+    JitLimits limits(const CPU& cpu) const {
+        auto limits = budget.limits(cpu);
+        if(cpu.nextEvent < limits.cycles) limits.cycles = cpu.nextEvent;
+        return limits;
+    }
+};
+
 void CPU::execute_until_break(Memory& ram) {
+    if(tracing) execute_until_break<Trace>(ram);
+    else if(traceRing) execute_until_break<RecordTrace>(ram);
+    else if(opStats) execute_until_break<CountOps>(ram);
+    else if(profiler) execute_until_break<Profile>(ram);
+    else execute_until_break<NoTrace>(ram);
+}
+
+template<class T> void CPU::execute_until_break(Memory& ram) {
     auto oldHaltOnBRK = haltOnBRK;
-    if(state == Halt) state = Normal; // unhalt the CPU
     haltOnBRK = true;
-    do {
-        execute_next_instruction(ram);
-    } while (state == Normal);
-    if (tracing && OP == BRK) {
-        std::cout << "Stopping on BRK" << std::endl;
-    } else if (tracing && state == Halt) {
-        std::cout << "CPU is halted\n";
-    } else if (tracing && state == Reset) {
-        std::cout << "CPU was reset\n";
-    } else if (tracing) {
-        std::cout << "Stopped for unknown reason.\n";
+    auto stop = run<T>(ram, Unbounded{});
+    if constexpr (T::enabled) {
+        if (stop.cause == StopBRK) {
+            std::cout << "Stopping on BRK" << std::endl;
+        } else if (state == Halt) {
+            std::cout << "CPU is halted\n";
+        } else if (state == Reset) {
+            std::cout << "CPU was reset\n";
+        } else {
+            std::cout << "Stopped for unknown reason.\n";
+        }
     }
     haltOnBRK = oldHaltOnBRK;
 }
 
+StopReason CPU::run_for_cycles(Memory& ram, uint64_t n) {
+    CycleBudget budget{n};
+    if(tracing) return run<Trace>(ram, budget);
+    if(traceRing) return run<RecordTrace>(ram, budget);
+    if(opStats) return run<CountOps>(ram, budget);
+    if(profiler) return run<Profile>(ram, budget);
+    return run<NoTrace>(ram, budget);
+}
+
+StopReason CPU::run_for_instructions(Memory& ram, uint64_t n) {
+    InstructionBudget budget{n};
+    if(tracing) return run<Trace>(ram, budget);
+    if(traceRing) return run<RecordTrace>(ram, budget);
+    if(opStats) return run<CountOps>(ram, budget);
+    if(profiler) return run<Profile>(ram, budget);
+    return run<NoTrace>(ram, budget);
+}
+
+template<class T, class B> StopReason CPU::run(Memory& ram, B budget) {
+    if(state == Halt) state = Normal; // unhalt the CPU
+    if(state == Reset) reset<T>(ram);
+    bind(ram);
+    budget.start(*this);
+    auto startCycles = cycles;
+    auto startInstructions = instructions;
+    illegalStop = false;
+    for(;;) {
+        UntilEvent<B> slice{budget};
+        if(engine == Threaded) {
+            execute_threaded<T>(ram, slice);
+        } else if(engine == Cached) {
+            execute_cached<T>(ram, slice);
+        } else if(engine == Translated) {
+            execute_translated<T>(ram, slice);
+        } else {
+            while(state == Normal && !slice.spent(*this)) {
+                execute_next_instruction<T>(ram);
+            }
+        }
+        // otherwise the budget ran out or the cpu stopped
+        if(state != Normal || cycles < nextEvent || budget.spent(*this)) break;
+        service_events<T>(ram);
+    }
+    P.sync(); // callers read P directly
+    return stop_reason(startCycles, startInstructions);
+}
+
+StopReason CPU::stop_reason(uint64_t startCycles, uint64_t startInstructions) const {
+    StopReason stop;
+    if(state == Normal) stop.cause = StopBudget;
+    else if(illegalStop) stop.cause = StopIllegal;
+    else if(state == Reset) stop.cause = StopReset;
+    else if(OP == BRK) stop.cause = StopBRK;
+    else stop.cause = StopHalt;
+    stop.seg = opSeg;
+    stop.pc = opPC;
+    stop.cycles = cycles - startCycles;
+    stop.instructions = instructions - startInstructions;
+    return stop;
+}
+
+std::string StopReason::describe() const {
+    switch(cause) {
+        case StopBudget: return "budget exhausted";
+        case StopBRK: return format("BRK at %02X:%04X", seg, pc);
+        case StopHalt: return format("halted at %02X:%04X", seg, pc);
+        case StopReset: return format("reset at %02X:%04X", seg, pc);
+        case StopIllegal: return format("illegal instruction at %02X:%04X", seg, pc);
+    }
+    return "unknown";
+}
+
 void CPU::execute_next_instruction(Memory& ram) {
+    bind(ram);
+    if(tracing) step<Trace>(ram);
+    else if(traceRing) step<RecordTrace>(ram);
+    else if(opStats) step<CountOps>(ram);
+    else if(profiler) step<Profile>(ram);
+    else step<NoTrace>(ram);
+    P.sync();
+}
+
+template<class T> void CPU::step(Memory& ram) {
+    if(state == Normal && cycles >= nextEvent) service_events<T>(ram);
+    execute_next_instruction<T>(ram);
+}
+
+template<class T> void CPU::service_events(Memory& ram) {
+    ScheduledEvent ev;
+    // a device may raise a line for this very boundary, so events go first
+    while(events.pop_due(cycles, ev)) ev.handler->fire(*this, ev.when, ev.tag);
+    if(nmiPending) {
+        nmiPending = false;
+        interrupt<T>(ram, NMI_VECTOR);
+    } else if(irqLines && !P.IF) {
+        interrupt<T>(ram, IRQ_VECTOR);
+    }
+    update_next_event();
+}
+
+template<class T> void CPU::interrupt(Memory& ram, uint16_t vector) {
+    if constexpr (T::enabled) std::cout << (vector == NMI_VECTOR ? "NMI\n" : "IRQ\n");
+    auto site = PS << 16 | PC;
+    pushByte<T>(ram, PC >> 8);
+    pushByte<T>(ram, PC & 0xff);
+    pushByte<T>(ram, P.asByte() & ~BF_Mask);
+    uint16_t adr = readByte<T>(ram, 0, vector);
+    adr |= readByte<T>(ram, 0, vector + 1) << 8;
+    P.IF = 1;
+    save_segments();
+    DS = 0;
+    PS = 0;
+    SS = 0;
+    select_segments();
+    PC = adr;
+    cycle();
+    cycle();
+    if constexpr (T::profiles) profiler->call(site, adr, SP + 3);
+}
+
+void CPU::save_segments() {
+    // a frame at or below this one was never returned from
+    while(numSegmentFrames && segmentFrames[numSegmentFrames - 1].sp <= SP) numSegmentFrames--;
+    if(!(PS | DS | SS)) return;
+    if(numSegmentFrames == MAX_SEGMENT_FRAMES) {
+        memmove(segmentFrames, segmentFrames + 1, sizeof(segmentFrames) - sizeof(segmentFrames[0]));
+        numSegmentFrames--;
+    }
+    segmentFrames[numSegmentFrames++] = {SP, PS, DS, SS};
+}
+
+void CPU::restore_segments() {
+    while(numSegmentFrames && segmentFrames[numSegmentFrames - 1].sp < SP) numSegmentFrames--;
+    if(!numSegmentFrames || segmentFrames[numSegmentFrames - 1].sp != SP) return;
+    auto& frame = segmentFrames[--numSegmentFrames];
+    PS = frame.ps;
+    DS = frame.ds;
+    SS = frame.ss;
+    select_segments();
+}
+
+template<class T> void CPU::execute_next_instruction(Memory& ram) {
     switch(state) {
         case Reset: {
-            reset(ram);
+            reset<T>(ram);
             return;
         }
         case Halt: {
-            if(tracing) std::cout << format("CPU:HALT\n");
+            if constexpr (T::enabled) std::cout << format("CPU:HALT\n");
             return;
         }
         default: {
@@ -52,18 +282,23 @@ void CPU::execute_next_instruction(Memory& ram) {
             opSeg = PS;
             opPC = PC;
             auto start = cycles;
-            OP = fetchByte(ram);
-            if (tracing) {
-                std::cout << format("OP=%02X", OP) << std::endl;
+            instructions++;
+            OP = fetchByte<T>(ram);
+            if constexpr (T::enabled) {
+                TextSink(std::cout).put("OP=").hex8(OP).put('\n');
             }
-            decodeAndExecute(ram, OP);
+            decodeAndExecute<T>(ram, OP);
             auto end = cycles;
             // capture how many cycles this instruction took
             opCC = end - start;
-            if (tracing) {
-                dump_regs_info(std::cout);
-                std::cout << std::endl;
+            if constexpr (T::enabled) {
+                TextSink out(std::cout);
+                dump_regs_info(out);
+                out.put('\n');
             }
+            traceInstruction<T>();
+            countInstruction<T>(ram);
+            profileInstruction<T>();
             break;
         }
     }
@@ -73,1175 +308,1341 @@ void CPU::illegalInstruction() {
     if(ignoreIllegalInstructions) {
         return;
     }
-    else if(allowHalting) {
+    illegalStop = true;
+    if(allowHalting) {
         state = Halt;
     } else {
         state = Reset;
     }
 }
 
-void CPU::illegalInstruction(uint8_t inst) {
-    if (tracing) {
+template<class T> void CPU::illegalInstruction(uint8_t inst) {
+    if constexpr (T::enabled) {
         std::cout << format("%02X:%04X=%02X ILLEGAL INSTRUCTION", opSeg, opPC, inst) << std::endl;
     }
     illegalInstruction();
 }
-void CPU::illegalInstruction(uint8_t inst0, uint8_t inst1) {
-    if(tracing) {
+
+template<class T> void CPU::illegalInstruction(uint8_t inst0, uint8_t inst1) {
+    if constexpr (T::enabled) {
         std::cout << format("%02X:%04X=%02X %02X ILLEGAL INSTRUCTION", opSeg, opPC, inst0, inst1) << std::endl;
     }
     illegalInstruction();
 }
 
+// the xtop decoders report their own illegal sub-opcodes
+template void CPU::illegalInstruction<NoTrace>(uint8_t inst0, uint8_t inst1);
+template void CPU::illegalInstruction<Trace>(uint8_t inst0, uint8_t inst1);
+template void CPU::illegalInstruction<RecordTrace>(uint8_t inst0, uint8_t inst1);
+template void CPU::illegalInstruction<CountOps>(uint8_t inst0, uint8_t inst1);
+template void CPU::illegalInstruction<Profile>(uint8_t inst0, uint8_t inst1);
+
 void CPU::decodeAndExecute(Memory& ram, uint16_t opcode) {
-    switch(opcode) {
-        case ADC_Immediate: {
-            auto imm = fetchByte(ram);
-            auto a = A();
-            auto v = a + imm + P.CF;
-            setA(v);
-            set_flags(NF_Mask | ZF_Mask | CF_Mask | OF_Mask, 8, v, a);
-            break;
-        }
-        case ADC_ZeroPage:
-        case ADC_ZeroPageX: {
-            auto zp = fetchByte(ram);
-            if (opcode == ADC_ZeroPageX) {
-                zp += X();
-                cycle();
-            }
-            auto v = readByte(ram, DS, zp);
-            auto a = A();
-            auto v2 = a + v + P.CF;
-            setA(v2);
-            set_flags(NF_Mask | ZF_Mask | CF_Mask | OF_Mask, 8, v2, a);
-            break;
-        }
-        case ADC_Absolute:
-        case ADC_AbsoluteX:
-        case ADC_AbsoluteY: {
-            uint16_t adr = fetchByte(ram) | fetchByte(ram) << 8;
-            adr += opcode == ADC_AbsoluteX ? X() : opcode == ADC_AbsoluteY ? Y() : 0;
-            auto v = readByte(ram, DS, adr);
-            auto a = A();
-            auto v2 = a + v + P.CF;
-            setA(v2);
-            set_flags(NF_Mask | ZF_Mask | CF_Mask | OF_Mask, 8, v2, a);
-            break;
-        }
-        case ADC_IndirectX: {
-            uint8_t zp = fetchByte(ram) + X();
-            cycle();
-            uint16_t adr = readByte(ram, DS, zp) | readByte(ram, DS, zp+1) << 8;
-            auto v = readByte(ram, DS, adr);
-            auto a = A();
-            auto v2 = a + v + P.CF;
-            setA(v2);
-            set_flags(NF_Mask | ZF_Mask | CF_Mask | OF_Mask, 8, v2, a);
-            break;
-        }
-        case ADC_IndirectY: {
-            uint8_t zp = fetchByte(ram);
-            uint16_t adr = readByte(ram, DS, zp) | readByte(ram, DS, zp+1) << 8;
-            auto v = readByte(ram, DS, adr + Y());
-            auto a = A();
-            auto v2 = a + v + P.CF;
-            setA(v2);
-            set_flags(NF_Mask | ZF_Mask | CF_Mask | OF_Mask, 8, v2, a);
-            break;
-        }
+    bind(ram);
+    if(tracing) decodeAndExecute<Trace>(ram, opcode);
+    else if(traceRing) decodeAndExecute<RecordTrace>(ram, opcode);
+    else if(opStats) decodeAndExecute<CountOps>(ram, opcode);
+    else if(profiler) decodeAndExecute<Profile>(ram, opcode);
+    else decodeAndExecute<NoTrace>(ram, opcode);
+    P.sync();
+}
 
-        case AND_Immediate: {
-            auto imm = fetchByte(ram);
-            auto v = A() & imm;
-            setA(v);
-            set_flags(NF_Mask | ZF_Mask, 8, v, 0);
-            break;
-        }
-        case AND_ZeroPage:
-        case AND_ZeroPageX: {
-            auto zp = (uint8_t)(fetchByte(ram) + (opcode == AND_ZeroPageX ? X() : 0));
-            auto v = readByte(ram, DS, zp);
-            auto v2 = A() & v;
-            setA(v2);
-            set_flags(NF_Mask | ZF_Mask, 8, v2, 0);
-            break;
-        }
-        case AND_Absolute:
-        case AND_AbsoluteX:
-        case AND_AbsoluteY: {
-            uint16_t adr = fetchByte(ram) | fetchByte(ram) << 8;
-            adr += opcode == AND_AbsoluteX ? X() : opcode == AND_AbsoluteY ? Y() : 0;
-            auto v = readByte(ram, DS, adr);
-            auto v2 = A() & v;
-            setA(v2);
-            set_flags(NF_Mask | ZF_Mask, 8, v2, 0);
-            break;
-        }
-        case AND_IndirectX: {
-            uint8_t zp = fetchByte(ram) + X();
-            cycle();
-            uint16_t adr = readByte(ram, DS, zp) | readByte(ram, DS, zp+1) << 8;
-            auto v = readByte(ram, DS, adr);
-            auto v2 = A() & v;
-            setA(v2);
-            set_flags(NF_Mask | ZF_Mask, 8, v2, 0);
-            break;
-        }
-        case AND_IndirectY: {
-            uint8_t zp = fetchByte(ram);
-            uint16_t adr = readByte(ram, DS, zp) | readByte(ram, DS, zp+1) << 8;
-            auto v = readByte(ram, DS, adr + Y());
-            auto v2 = A() & v;
-            setA(v2);
-            set_flags(NF_Mask | ZF_Mask, 8, v2, 0);
-            break;
-        }
+template<class T> void CPU::decodeAndExecute(Memory& ram, uint16_t opcode) {
+    auto table = T::enabled ? traceOpTable : T::records ? recordOpTable
+        : T::counts ? countOpTable : T::profiles ? profileOpTable : opTable;
+    table[opcode & 0xff](ram, *this);
+}
 
-        case ASL_Implied: {
-            cycle();
-            P.CF = A() & 0x80;
-            auto v = (A() << 1);
-            setA(v);
-            set_flags(NF_Mask | ZF_Mask, 8, v, 0);
-            break;
-        }
-        case ASL_ZeroPage: { 
-            auto zp = fetchByte(ram);
-            auto res = readByte(ram, DS, zp);
-            P.CF = res & 0x80;
-            res = (res << 1);
-            cycle();
-            writeByte(ram, DS, zp, res);
-            set_flags(NF_Mask | ZF_Mask, 8, res, 0);
-            break;
-        }
-        case ASL_ZeroPageX: {
-            auto zp = fetchByte(ram);
-            zp = (zp + X()) & 0xff;
-            cycle();
-            auto res = readByte(ram, DS, zp);
-            P.CF = res & 0x80;
-            res = (res << 1);
-            cycle();
-            writeByte(ram, DS, zp, res);
-            set_flags(NF_Mask | ZF_Mask, 8, res, 0);
-            break;
-        }
-        case ASL_Absolute: {
-            uint16_t adr = fetchByte(ram) | fetchByte(ram) << 8;
-            auto res = readByte(ram, DS, adr);
-            P.CF = res & 0x80;
-            res = (res << 1);
-            cycle();
-            writeByte(ram, DS, adr, res);
-            set_flags(NF_Mask | ZF_Mask, 8, res, 0);
-            break;
-        }
-        case ASL_AbsoluteX: {
-            uint16_t adr = fetchByte(ram) | fetchByte(ram) << 8;
-            adr = (adr + X()) & 0xffff;
-            cycle();
-            auto res = readByte(ram, DS, adr);
-            P.CF = res & 0x80;
-            res = (res << 1);
-            cycle();
-            writeByte(ram, DS, adr, res);
-            set_flags(NF_Mask | ZF_Mask, 8, res, 0);
-            break;
-        }
+template<uint8_t opcode> struct Opcode {};
 
-        case BCC: {
-            auto rel = (int8_t)fetchByte(ram);
-            branch_relative8_if(rel, P.CF == 1);
-            break;
-        }
-        case BCS: {
-            auto rel = (int8_t)fetchByte(ram);
-            branch_relative8_if(rel, P.CF == 0);
-            break;
-        }
-        case BEQ: {
-            auto rel = (int8_t)fetchByte(ram);
-            branch_relative8_if(rel, P.ZF == 1);
-            break;
-        }
-        case BMI: {
-            auto rel = (int8_t)fetchByte(ram);
-            branch_relative8_if(rel, P.NF == 1);
-            break;
-        }
-        case BNE: {
-            auto rel = (int8_t)fetchByte(ram);
-            branch_relative8_if(rel, P.ZF == 0);
-            break;
-        }
-        case BPL: {
-            auto rel = (int8_t)fetchByte(ram);
-            branch_relative8_if(rel, P.NF == 0);
-            break;
-        }
-        case BVC: {
-            auto rel = (int8_t)fetchByte(ram);
-            branch_relative8_if(rel, P.OF == 0);
-            break;
-        }
-        case BVS: {
-            auto rel = (int8_t)fetchByte(ram);
-            branch_relative8_if(rel, P.OF == 1);
-            break;
-        }
+// opcodes without an overload below are illegal on every cpu model
+template<class T, uint8_t opcode> static void execute(Memory& ram, CPU& cpu, Opcode<opcode>) {
+    cpu.illegalInstruction<T>(opcode);
+}
 
-        case BIT_ZeroPage: {
-            auto zp = fetchByte(ram);
-            auto v = readByte(ram, DS, zp);
-            P.NF = (v & 0x80) ? 1 : 0;
-            P.OF = (v & 0x40) ? 1 : 0;
-            P.ZF = ((A() & v) == 0) ? 1 : 0;
-            break;
-        }
-        case BIT_Absolute: {
-            uint16_t adr = fetchByte(ram) | fetchByte(ram) << 8;
-            auto v = readByte(ram, DS, adr);
-            P.NF = (v & 0x80) ? 1 : 0;
-            P.OF = (v & 0x40) ? 1 : 0;
-            P.ZF = ((A() & v) == 0) ? 1 : 0;
-            break;
-        }
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<ADC_Immediate>) {
+    read_op<T, mode::Immediate, alu::ADC>(ram, cpu);
+}
 
-        case BRK: {
-            auto ret_adr = PC + 2;
-            pushByte(ram, ret_adr >> 8);
-            pushByte(ram, ret_adr & 0xff);
-            pushByte(ram, P.asByte());
-            uint16_t adr = readByte(ram, 0, 0xfffe) | readByte(ram, 0, 0xffff) << 8;
-            P.IF = 1;
-            DS = 0;
-            PS = 0;
-            SS = 0;
-            PC = adr;
-            if(haltOnBRK) state = Halt;
-            break;
-        }
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<ADC_ZeroPage>) {
+    read_op<T, mode::ZeroPage, alu::ADC>(ram, cpu);
+}
 
-        case CLC: {
-            P.CF = 0;
-            cycle();
-            break;
-        }
-        case CLD: {
-            P.DF = 0;
-            cycle();
-            break;
-        }
-        case CLI: {
-            P.IF = 0;
-            cycle();
-            break;
-        }
-        case CLV: {
-            P.OF = 0;
-            cycle();
-            break;
-        }
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<ADC_ZeroPageX>) {
+    read_op<T, mode::ZeroPageX, alu::ADC>(ram, cpu);
+}
 
-        case CMP_Immediate: {
-            auto imm = fetchByte(ram);
-            auto res = A() - imm;
-            set_flags(NF_Mask | ZF_Mask | CF_Mask, 8, res, A());
-            break;
-        }
-        case CMP_ZeroPage:
-        case CMP_ZeroPageX: {
-            auto zp = (uint8_t)(fetchByte(ram) + (opcode == CMP_ZeroPageX ? X() : 0));
-            auto v = readByte(ram, DS, zp);
-            auto res = A() - v;
-            set_flags(NF_Mask | ZF_Mask | CF_Mask, 8, res, A());
-            break;
-        }
-        case CMP_Absolute:
-        case CMP_AbsoluteX:
-        case CMP_AbsoluteY: {
-            uint16_t adr = fetchByte(ram) | fetchByte(ram) << 8;
-            adr += opcode == CMP_AbsoluteX ? X() : opcode == CMP_AbsoluteY ? Y() : 0;
-            auto v = readByte(ram, DS, adr);
-            auto res = A() - v;
-            set_flags(NF_Mask | ZF_Mask | CF_Mask, 8, res, A());
-            break;
-        }
-        case CMP_IndirectX: {
-            uint8_t zp = fetchByte(ram) + X();
-            cycle();
-            uint16_t adr = readByte(ram, DS, zp) | readByte(ram, DS, zp+1) << 8;
-            auto v = readByte(ram, DS, adr);
-            auto res = A() - v;
-            set_flags(NF_Mask | ZF_Mask | CF_Mask, 8, res, A());
-            break;
-        }
-        case CMP_IndirectY: {
-            uint8_t zp = fetchByte(ram);
-            uint16_t adr = readByte(ram, DS, zp) | readByte(ram, DS, zp+1) << 8;
-            auto v = readByte(ram, DS, adr + Y());
-            auto res = A() - v;
-            set_flags(NF_Mask | ZF_Mask | CF_Mask, 8, res, A());
-            break;
-        }
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<ADC_Absolute>) {
+    read_op<T, mode::Absolute, alu::ADC>(ram, cpu);
+}
 
-        case CPX_Immediate: {
-            uint8_t imm = fetchByte(ram);
-            auto res = X() - imm;
-            set_flags(NF_Mask | ZF_Mask | CF_Mask, 8, res, X());
-            break;
-        }
-        case CPX_ZeroPage: {
-            uint8_t zp = fetchByte(ram);
-            uint8_t v = readByte(ram, DS, zp);
-            auto res = X() - v;
-            set_flags(NF_Mask | ZF_Mask | CF_Mask, 8, res, X());
-            break;
-        }
-        case CPX_Absolute: {
-            uint16_t adr = fetchByte(ram) | fetchByte(ram) << 8;
-            uint8_t v = readByte(ram, DS, adr);
-            auto res = X() - v;
-            set_flags(NF_Mask | ZF_Mask | CF_Mask, 8, res, X());
-            break;
-        }
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<ADC_AbsoluteX>) {
+    read_op<T, mode::AbsoluteX, alu::ADC>(ram, cpu);
+}
 
-        case CPY_Immediate: {
-            uint8_t imm = fetchByte(ram);
-            auto res = Y() - imm;
-            set_flags(NF_Mask | ZF_Mask | CF_Mask, 8, res, Y());
-            break;
-        }
-        case CPY_ZeroPage: {
-            uint8_t zp = fetchByte(ram);
-            uint8_t v = readByte(ram, DS, zp);
-            auto res = Y() - v;
-            set_flags(NF_Mask | ZF_Mask | CF_Mask, 8, res, Y());
-            break;
-        }
-        case CPY_Absolute: {
-            uint16_t adr = fetchByte(ram) | fetchByte(ram) << 8;
-            uint8_t v = readByte(ram, DS, adr);
-            auto res = Y() - v;
-            set_flags(NF_Mask | ZF_Mask | CF_Mask, 8, res, Y());
-            break;
-        }
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<ADC_AbsoluteY>) {
+    read_op<T, mode::AbsoluteY, alu::ADC>(ram, cpu);
+}
 
-        case DEC_ZeroPage: {
-            auto zp = fetchByte(ram);
-            auto v = readByte(ram, DS, zp);
-            auto res = v - 1;
-            cycle();
-            writeByte(ram, DS, zp, res);
-            set_flags(NF_Mask | ZF_Mask, 8, res, 0);
-            break;            
-        }
-        case DEC_ZeroPageX: {
-            auto zp = fetchByte(ram);
-            zp = (zp + X()) & 0xff;
-            cycle();
-            auto v = readByte(ram, DS, zp);
-            auto res = v - 1;
-            cycle();
-            writeByte(ram, DS, zp, res);
-            set_flags(NF_Mask | ZF_Mask, 8, res, 0);
-            break; 
-        }
-        case DEC_Absolute: {
-            uint16_t adr = fetchByte(ram) | fetchByte(ram) << 8;
-            uint8_t v = readByte(ram, DS, adr);
-            auto res = v - 1;
-            cycle();
-            writeByte(ram, DS, adr, res);
-            set_flags(NF_Mask | ZF_Mask, 8, res, 0);
-            break;
-        }
-        case DEC_AbsoluteX: {
-            uint16_t adr = fetchByte(ram) | fetchByte(ram) << 8;
-            adr += X();
-            cycle();
-            uint8_t v = readByte(ram, DS, adr);
-            auto res = v - 1;
-            cycle();
-            writeByte(ram, DS, adr, res);
-            set_flags(NF_Mask | ZF_Mask, 8, res, 0);
-            break;
-        }
-        case DEX: {
-            auto res = X() - 1;
-            cycle();
-            setX(res);
-            set_flags(NF_Mask | ZF_Mask, 8, res, 0);
-            break;
-        }
-        case DEY: {
-            auto res = Y() - 1;
-            cycle();
-            setY(res);
-            set_flags(NF_Mask | ZF_Mask, 8, res, 0);
-            break;
-        }
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<ADC_IndirectX>) {
+    read_op<T, mode::IndirectX, alu::ADC>(ram, cpu);
+}
 
-        case EOR_Immediate: {
-            auto imm = fetchByte(ram);
-            auto v = A() ^ imm;
-            setA(v);
-            set_flags(NF_Mask | ZF_Mask, 8, v, 0);
-            break;
-        }
-        case EOR_ZeroPage:
-        case EOR_ZeroPageX: {
-            auto zp = (uint8_t)(fetchByte(ram) + (opcode == ADC_ZeroPageX ? X() : 0));
-            auto v = readByte(ram, DS, zp);
-            auto v2 = A() ^ v;
-            setA(v2);
-            set_flags(NF_Mask | ZF_Mask, 8, v2, 0);
-            break;
-        }
-        case EOR_Absolute:
-        case EOR_AbsoluteX:
-        case EOR_AbsoluteY: {
-            uint16_t adr = fetchByte(ram) | fetchByte(ram) << 8;
-            adr += opcode == ADC_AbsoluteX ? X() : opcode == ADC_AbsoluteY ? Y() : 0;
-            auto v = readByte(ram, DS, adr);
-            auto v2 = A() ^ v;
-            setA(v2);
-            set_flags(NF_Mask | ZF_Mask, 8, v2, 0);
-            break;
-        }
-        case EOR_IndirectX: {
-            uint8_t zp = fetchByte(ram) + X();
-            cycle();
-            uint16_t adr = readByte(ram, DS, zp) | readByte(ram, DS, zp+1) << 8;
-            auto v = readByte(ram, DS, adr);
-            auto v2 = A() ^ v;
-            setA(v2);
-            set_flags(NF_Mask | ZF_Mask, 8, v2, 0);
-            break;
-        }
-        case EOR_IndirectY: {
-            uint8_t zp = fetchByte(ram);
-            uint16_t adr = readByte(ram, DS, zp) | readByte(ram, DS, zp+1) << 8;
-            auto v = readByte(ram, DS, adr + Y());
-            auto v2 = A() ^ v;
-            setA(v2);
-            set_flags(NF_Mask | ZF_Mask, 8, v2, 0);
-            break;
-        }
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<ADC_IndirectY>) {
+    read_op<T, mode::IndirectY, alu::ADC>(ram, cpu);
+}
 
-        case INC_ZeroPage: {
-            auto zp = fetchByte(ram);
-            auto v = readByte(ram, DS, zp);
-            auto res = v + 1;
-            cycle();
-            writeByte(ram, DS, zp, res);
-            set_flags(NF_Mask | ZF_Mask, 8, res, 0);
-            break;            
-        }
-        case INC_ZeroPageX: {
-            auto zp = fetchByte(ram);
-            zp = (zp + X()) & 0xff;
-            cycle();
-            auto v = readByte(ram, DS, zp);
-            auto res = v + 1;
-            cycle();
-            writeByte(ram, DS, zp, res);
-            set_flags(NF_Mask | ZF_Mask, 8, res, 0);
-            break; 
-        }
-        case INC_Absolute: {
-            uint16_t adr = fetchByte(ram) | fetchByte(ram) << 8;
-            uint8_t v = readByte(ram, DS, adr);
-            auto res = v + 1;
-            cycle();
-            writeByte(ram, DS, adr, res);
-            set_flags(NF_Mask | ZF_Mask, 8, res, 0);
-            break;
-        }
-        case INC_AbsoluteX: {
-            uint16_t adr = fetchByte(ram) | fetchByte(ram) << 8;
-            adr += X();
-            cycle();
-            uint8_t v = readByte(ram, DS, adr);
-            auto res = v + 1;
-            cycle();
-            writeByte(ram, DS, adr, res);
-            set_flags(NF_Mask | ZF_Mask, 8, res, 0);
-            break;
-        }
-        case INX: {
-            auto res = X() + 1;
-            cycle();
-            setX(res);
-            set_flags(NF_Mask | ZF_Mask, 8, res, 0);
-            break;
-        }
-        case INY: {
-            auto res = Y() + 1;
-            cycle();
-            setY(res);
-            set_flags(NF_Mask | ZF_Mask, 8, res, 0);
-            break;
-        }
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<AND_Immediate>) {
+    read_op<T, mode::Immediate, alu::AND>(ram, cpu);
+}
 
-        case JMP_Absolute: {
-            auto lo = fetchByte(ram);
-            PC = fetchByte(ram) << 8 | lo;
-            break;
-        }
-        case JMP_Indirect: {
-            auto lo = fetchByte(ram);
-            uint16_t addr = fetchByte(ram) << 8 | lo;
-            auto pclo = readByte(ram, PS, addr);
-            PC = readByte(ram, PS, addr+1); 
-            break;
-        }
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<AND_ZeroPage>) {
+    read_op<T, mode::ZeroPage, alu::AND>(ram, cpu);
+}
 
-        case JSR_Absolute: {
-            auto adr = fetchByte(ram) | fetchByte(ram) << 8;
-            pushByte(ram, adr >> 8);
-            pushByte(ram, adr & 0xff);
-            cycle();
-            PC = adr;
-            break;
-        }
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<AND_ZeroPageX>) {
+    read_op<T, mode::ZeroPageX, alu::AND>(ram, cpu);
+}
 
-        case LDA_Immediate: {
-            auto imm = fetchByte(ram);
-            setA(imm);
-            set_flags(NF_Mask | ZF_Mask, 8, imm, 0);
-            break;
-        }
-        case LDA_ZeroPage:
-        case LDA_ZeroPageX: {
-            auto zp = (uint8_t)(fetchByte(ram) + (opcode == LDA_ZeroPageX ? X() : 0));
-            auto v = readByte(ram, DS, zp);
-            setA(v);
-            set_flags(NF_Mask | ZF_Mask, 8, v, 0);
-            break;
-        }
-        case LDA_Absolute:
-        case LDA_AbsoluteX:
-        case LDA_AbsoluteY: {
-            uint16_t adr = fetchByte(ram) | fetchByte(ram) << 8;
-            adr += opcode == LDA_AbsoluteX ? X() : opcode == LDA_AbsoluteY ? Y() : 0;
-            auto v = readByte(ram, DS, adr);
-            setA(v);
-            set_flags(NF_Mask | ZF_Mask, 8, v, 0);
-            break;
-        }
-        case LDA_IndirectX: {
-            uint8_t zp = fetchByte(ram) + X();
-            cycle();
-            uint16_t adr = readByte(ram, DS, zp) | readByte(ram, DS, zp+1) << 8;
-            auto v = readByte(ram, DS, adr);
-            setA(v);
-            set_flags(NF_Mask | ZF_Mask, 8, v, 0);
-            break;
-        }
-        case LDA_IndirectY: {
-            uint8_t zp = fetchByte(ram);
-            uint16_t adr = readByte(ram, DS, zp) | readByte(ram, DS, zp+1) << 8;
-            auto v = readByte(ram, DS, adr + Y());
-            setA(v);
-            set_flags(NF_Mask | ZF_Mask, 8, v, 0);
-            break;
-        }
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<AND_Absolute>) {
+    read_op<T, mode::Absolute, alu::AND>(ram, cpu);
+}
 
-        case LDX_Immediate: {
-            auto imm = fetchByte(ram);
-            setX(imm);
-            set_flags(NF_Mask | ZF_Mask, 8, imm, 0);
-            break;
-        }
-        case LDX_ZeroPage:
-        case LDX_ZeroPageY: {
-            auto zp = (uint8_t)(fetchByte(ram) + (opcode == LDX_ZeroPageY ? Y() : 0));
-            auto v = readByte(ram, DS, zp);
-            setX(v);
-            set_flags(NF_Mask | ZF_Mask, 8, v, 0);
-            break;
-        }
-        case LDX_Absolute:
-        case LDX_AbsoluteY: {
-            uint16_t adr = fetchByte(ram) | fetchByte(ram) << 8;
-            adr += opcode == LDX_AbsoluteY ? Y() : 0;
-            auto v = readByte(ram, DS, adr);
-            setX(v);
-            set_flags(NF_Mask | ZF_Mask, 8, v, 0);
-            break;
-        }
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<AND_AbsoluteX>) {
+    read_op<T, mode::AbsoluteX, alu::AND>(ram, cpu);
+}
 
-         case LDY_Immediate: {
-            auto imm = fetchByte(ram);
-            setY(imm);
-            set_flags(NF_Mask | ZF_Mask, 8, imm, 0);
-            break;
-        }
-        case LDY_ZeroPage:
-        case LDY_ZeroPageX: {
-            auto zp = (uint8_t)(fetchByte(ram) + (opcode == LDY_ZeroPageX ? X() : 0));
-            auto v = readByte(ram, DS, zp);
-            setY(v);
-            set_flags(NF_Mask | ZF_Mask, 8, v, 0);
-            break;
-        }
-        case LDY_Absolute:
-        case LDY_AbsoluteX: {
-            uint16_t adr = fetchByte(ram) | fetchByte(ram) << 8;
-            adr += opcode == LDY_AbsoluteX ? X() : 0;
-            auto v = readByte(ram, DS, adr);
-            setY(v);
-            set_flags(NF_Mask | ZF_Mask, 8, v, 0);
-            break;
-        }
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<AND_AbsoluteY>) {
+    read_op<T, mode::AbsoluteY, alu::AND>(ram, cpu);
+}
 
-        case LSR_Implied: {
-            cycle();
-            P.CF = A() & 0x01;
-            auto v = (A() >> 1);
-            P.NF = 0;
-            P.ZF = A() == 0 ? 1 : 0;
-            break;
-        }
-        case LSR_ZeroPage: {
-            auto zp = fetchByte(ram);
-            auto res = readByte(ram, DS, zp);
-            P.CF = res & 0x01;
-            res = (res >> 1);
-            cycle();
-            writeByte(ram, DS, zp, res);
-            P.NF = 0;
-            P.ZF = res == 0 ? 1 : 0;            
-            P.NF = 0;
-            P.ZF = res == 0 ? 1 : 0;
-            break;
-        }
-        case LSR_ZeroPageX: {
-            auto zp = fetchByte(ram);
-            zp = (zp + X()) & 0xff;
-            cycle();
-            auto res = readByte(ram, DS, zp);
-            P.CF = res & 0x01;
-            res = (res >> 1);
-            cycle();
-            writeByte(ram, DS, zp, res);
-            P.NF = 0;
-            P.ZF = res == 0 ? 1 : 0;
-            break;
-        }
-        case LSR_Absolute: {
-            uint16_t adr = fetchByte(ram) | fetchByte(ram) << 8;
-            auto res = readByte(ram, DS, adr);
-            P.CF = res & 0x01;
-            res = (res >> 1);
-            cycle();
-            writeByte(ram, DS, adr, res);
-            P.NF = 0;
-            P.ZF = res == 0 ? 1 : 0;
-            break;
-        }
-        case LSR_AbsoluteX: {
-            uint16_t adr = fetchByte(ram) | fetchByte(ram) << 8;
-            adr = (adr + X()) & 0xffff;
-            cycle();
-            auto res = readByte(ram, DS, adr);
-            P.CF = res & 0x01;
-            res = (res >> 1);
-            cycle();
-            writeByte(ram, DS, adr, res);
-            P.NF = 0;
-            P.ZF = res == 0 ? 1 : 0;
-            break;
-        }
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<AND_IndirectX>) {
+    read_op<T, mode::IndirectX, alu::AND>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<AND_IndirectY>) {
+    read_op<T, mode::IndirectY, alu::AND>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<ASL_Implied>) {
+    cpu.P.sync();
+    cpu.cycle();
+    cpu.P.CF = cpu.A() & 0x80;
+    auto v = (cpu.A() << 1);
+    cpu.setA(v);
+    cpu.set_flags(NF_Mask | ZF_Mask, 8, v, 0);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<ASL_ZeroPage>) {
+    cpu.P.sync();
+    auto zp = cpu.fetchByte<T>(ram);
+    auto res = cpu.readData<T>(ram, zp);
+    cpu.P.CF = res & 0x80;
+    res = (res << 1);
+    cpu.cycle();
+    cpu.writeData<T>(ram, zp, res);
+    cpu.set_flags(NF_Mask | ZF_Mask, 8, res, 0);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<ASL_ZeroPageX>) {
+    cpu.P.sync();
+    auto zp = cpu.fetchByte<T>(ram);
+    zp = (zp + cpu.X()) & 0xff;
+    cpu.cycle();
+    auto res = cpu.readData<T>(ram, zp);
+    cpu.P.CF = res & 0x80;
+    res = (res << 1);
+    cpu.cycle();
+    cpu.writeData<T>(ram, zp, res);
+    cpu.set_flags(NF_Mask | ZF_Mask, 8, res, 0);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<ASL_Absolute>) {
+    cpu.P.sync();
+    uint16_t adr = cpu.fetchByte<T>(ram) | cpu.fetchByte<T>(ram) << 8;
+    auto res = cpu.readData<T>(ram, adr);
+    cpu.P.CF = res & 0x80;
+    res = (res << 1);
+    cpu.cycle();
+    cpu.writeData<T>(ram, adr, res);
+    cpu.set_flags(NF_Mask | ZF_Mask, 8, res, 0);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<ASL_AbsoluteX>) {
+    cpu.P.sync();
+    uint16_t adr = cpu.fetchByte<T>(ram) | cpu.fetchByte<T>(ram) << 8;
+    adr = (adr + cpu.X()) & 0xffff;
+    cpu.cycle();
+    auto res = cpu.readData<T>(ram, adr);
+    cpu.P.CF = res & 0x80;
+    res = (res << 1);
+    cpu.cycle();
+    cpu.writeData<T>(ram, adr, res);
+    cpu.set_flags(NF_Mask | ZF_Mask, 8, res, 0);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<BCC>) {
+    auto rel = (int8_t)cpu.fetchByte<T>(ram);
+    cpu.branch_relative8_if(rel, cpu.P.carry() == 1);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<BCS>) {
+    auto rel = (int8_t)cpu.fetchByte<T>(ram);
+    cpu.branch_relative8_if(rel, cpu.P.carry() == 0);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<BEQ>) {
+    auto rel = (int8_t)cpu.fetchByte<T>(ram);
+    cpu.branch_relative8_if(rel, cpu.P.zero() == 1);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<BMI>) {
+    auto rel = (int8_t)cpu.fetchByte<T>(ram);
+    cpu.branch_relative8_if(rel, cpu.P.negative() == 1);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<BNE>) {
+    auto rel = (int8_t)cpu.fetchByte<T>(ram);
+    cpu.branch_relative8_if(rel, cpu.P.zero() == 0);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<BPL>) {
+    auto rel = (int8_t)cpu.fetchByte<T>(ram);
+    cpu.branch_relative8_if(rel, cpu.P.negative() == 0);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<BVC>) {
+    auto rel = (int8_t)cpu.fetchByte<T>(ram);
+    cpu.branch_relative8_if(rel, cpu.P.overflow() == 0);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<BVS>) {
+    auto rel = (int8_t)cpu.fetchByte<T>(ram);
+    cpu.branch_relative8_if(rel, cpu.P.overflow() == 1);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<BIT_ZeroPage>) {
+    cpu.P.sync();
+    auto zp = cpu.fetchByte<T>(ram);
+    auto v = cpu.readData<T>(ram, zp);
+    cpu.P.NF = (v & 0x80) ? 1 : 0;
+    cpu.P.OF = (v & 0x40) ? 1 : 0;
+    cpu.P.ZF = ((cpu.A() & v) == 0) ? 1 : 0;
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<BIT_Absolute>) {
+    cpu.P.sync();
+    uint16_t adr = cpu.fetchByte<T>(ram) | cpu.fetchByte<T>(ram) << 8;
+    auto v = cpu.readData<T>(ram, adr);
+    cpu.P.NF = (v & 0x80) ? 1 : 0;
+    cpu.P.OF = (v & 0x40) ? 1 : 0;
+    cpu.P.ZF = ((cpu.A() & v) == 0) ? 1 : 0;
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<BRK>) {
+    auto ret_adr = cpu.PC + 2;
+    cpu.pushByte<T>(ram, ret_adr >> 8);
+    cpu.pushByte<T>(ram, ret_adr & 0xff);
+    cpu.pushByte<T>(ram, cpu.P.asByte());
+    uint16_t adr = cpu.readByte<T>(ram, 0, 0xfffe) | cpu.readByte<T>(ram, 0, 0xffff) << 8;
+    cpu.P.IF = 1;
+    cpu.DS = 0;
+    cpu.PS = 0;
+    cpu.SS = 0;
+    cpu.select_segments();
+    cpu.PC = adr;
+    if(cpu.haltOnBRK) cpu.state = Halt;
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<CLC>) {
+    cpu.P.sync();
+    cpu.P.CF = 0;
+    cpu.cycle();
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<CLD>) {
+    cpu.P.DF = 0;
+    cpu.cycle();
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<CLI>) {
+    cpu.P.IF = 0;
+    cpu.cycle();
+    cpu.update_next_event();
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<CLV>) {
+    cpu.P.sync();
+    cpu.P.OF = 0;
+    cpu.cycle();
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<CMP_Immediate>) {
+    read_op<T, mode::Immediate, alu::CMP>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<CMP_ZeroPage>) {
+    read_op<T, mode::ZeroPage, alu::CMP>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<CMP_ZeroPageX>) {
+    read_op<T, mode::ZeroPageX, alu::CMP>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<CMP_Absolute>) {
+    read_op<T, mode::Absolute, alu::CMP>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<CMP_AbsoluteX>) {
+    read_op<T, mode::AbsoluteX, alu::CMP>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<CMP_AbsoluteY>) {
+    read_op<T, mode::AbsoluteY, alu::CMP>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<CMP_IndirectX>) {
+    read_op<T, mode::IndirectX, alu::CMP>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<CMP_IndirectY>) {
+    read_op<T, mode::IndirectY, alu::CMP>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<CPX_Immediate>) {
+    read_op<T, mode::Immediate, alu::CPX>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<CPX_ZeroPage>) {
+    read_op<T, mode::ZeroPage, alu::CPX>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<CPX_Absolute>) {
+    read_op<T, mode::Absolute, alu::CPX>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<CPY_Immediate>) {
+    read_op<T, mode::Immediate, alu::CPY>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<CPY_ZeroPage>) {
+    read_op<T, mode::ZeroPage, alu::CPY>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<CPY_Absolute>) {
+    read_op<T, mode::Absolute, alu::CPY>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<DEC_ZeroPage>) {
+    auto zp = cpu.fetchByte<T>(ram);
+    auto v = cpu.readData<T>(ram, zp);
+    auto res = v - 1;
+    cpu.cycle();
+    cpu.writeData<T>(ram, zp, res);
+    cpu.set_flags(NF_Mask | ZF_Mask, 8, res, 0);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<DEC_ZeroPageX>) {
+    auto zp = cpu.fetchByte<T>(ram);
+    zp = (zp + cpu.X()) & 0xff;
+    cpu.cycle();
+    auto v = cpu.readData<T>(ram, zp);
+    auto res = v - 1;
+    cpu.cycle();
+    cpu.writeData<T>(ram, zp, res);
+    cpu.set_flags(NF_Mask | ZF_Mask, 8, res, 0);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<DEC_Absolute>) {
+    uint16_t adr = cpu.fetchByte<T>(ram) | cpu.fetchByte<T>(ram) << 8;
+    uint8_t v = cpu.readData<T>(ram, adr);
+    auto res = v - 1;
+    cpu.cycle();
+    cpu.writeData<T>(ram, adr, res);
+    cpu.set_flags(NF_Mask | ZF_Mask, 8, res, 0);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<DEC_AbsoluteX>) {
+    uint16_t adr = cpu.fetchByte<T>(ram) | cpu.fetchByte<T>(ram) << 8;
+    adr += cpu.X();
+    cpu.cycle();
+    uint8_t v = cpu.readData<T>(ram, adr);
+    auto res = v - 1;
+    cpu.cycle();
+    cpu.writeData<T>(ram, adr, res);
+    cpu.set_flags(NF_Mask | ZF_Mask, 8, res, 0);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<DEX>) {
+    auto res = cpu.X() - 1;
+    cpu.cycle();
+    cpu.setX(res);
+    cpu.set_flags(NF_Mask | ZF_Mask, 8, res, 0);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<DEY>) {
+    auto res = cpu.Y() - 1;
+    cpu.cycle();
+    cpu.setY(res);
+    cpu.set_flags(NF_Mask | ZF_Mask, 8, res, 0);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<EOR_Immediate>) {
+    read_op<T, mode::Immediate, alu::EOR>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<EOR_ZeroPage>) {
+    read_op<T, mode::ZeroPage, alu::EOR>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<EOR_ZeroPageX>) {
+    read_op<T, mode::ZeroPageX, alu::EOR>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<EOR_Absolute>) {
+    read_op<T, mode::Absolute, alu::EOR>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<EOR_AbsoluteX>) {
+    read_op<T, mode::AbsoluteX, alu::EOR>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<EOR_AbsoluteY>) {
+    read_op<T, mode::AbsoluteY, alu::EOR>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<EOR_IndirectX>) {
+    read_op<T, mode::IndirectX, alu::EOR>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<EOR_IndirectY>) {
+    read_op<T, mode::IndirectY, alu::EOR>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<INC_ZeroPage>) {
+    auto zp = cpu.fetchByte<T>(ram);
+    auto v = cpu.readData<T>(ram, zp);
+    auto res = v + 1;
+    cpu.cycle();
+    cpu.writeData<T>(ram, zp, res);
+    cpu.set_flags(NF_Mask | ZF_Mask, 8, res, 0);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<INC_ZeroPageX>) {
+    auto zp = cpu.fetchByte<T>(ram);
+    zp = (zp + cpu.X()) & 0xff;
+    cpu.cycle();
+    auto v = cpu.readData<T>(ram, zp);
+    auto res = v + 1;
+    cpu.cycle();
+    cpu.writeData<T>(ram, zp, res);
+    cpu.set_flags(NF_Mask | ZF_Mask, 8, res, 0);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<INC_Absolute>) {
+    uint16_t adr = cpu.fetchByte<T>(ram) | cpu.fetchByte<T>(ram) << 8;
+    uint8_t v = cpu.readData<T>(ram, adr);
+    auto res = v + 1;
+    cpu.cycle();
+    cpu.writeData<T>(ram, adr, res);
+    cpu.set_flags(NF_Mask | ZF_Mask, 8, res, 0);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<INC_AbsoluteX>) {
+    uint16_t adr = cpu.fetchByte<T>(ram) | cpu.fetchByte<T>(ram) << 8;
+    adr += cpu.X();
+    cpu.cycle();
+    uint8_t v = cpu.readData<T>(ram, adr);
+    auto res = v + 1;
+    cpu.cycle();
+    cpu.writeData<T>(ram, adr, res);
+    cpu.set_flags(NF_Mask | ZF_Mask, 8, res, 0);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<INX>) {
+    auto res = cpu.X() + 1;
+    cpu.cycle();
+    cpu.setX(res);
+    cpu.set_flags(NF_Mask | ZF_Mask, 8, res, 0);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<INY>) {
+    auto res = cpu.Y() + 1;
+    cpu.cycle();
+    cpu.setY(res);
+    cpu.set_flags(NF_Mask | ZF_Mask, 8, res, 0);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<JMP_Absolute>) {
+    auto lo = cpu.fetchByte<T>(ram);
+    cpu.PC = cpu.fetchByte<T>(ram) << 8 | lo;
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<JMP_Indirect>) {
+    auto lo = cpu.fetchByte<T>(ram);
+    uint16_t addr = cpu.fetchByte<T>(ram) << 8 | lo;
+    auto pclo = cpu.readByte<T>(ram, cpu.PS, addr);
+    cpu.PC = cpu.readByte<T>(ram, cpu.PS, addr+1);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<JSR_Absolute>) {
+    auto adr = cpu.fetchByte<T>(ram) | cpu.fetchByte<T>(ram) << 8;
+    // the return address is that of the operand's last byte
+    uint16_t ret_adr = cpu.PC - 1;
+    cpu.pushByte<T>(ram, ret_adr >> 8);
+    cpu.pushByte<T>(ram, ret_adr & 0xff);
+    cpu.cycle();
+    cpu.PC = adr;
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<LDA_Immediate>) {
+    read_op<T, mode::Immediate, alu::LDA>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<LDA_ZeroPage>) {
+    read_op<T, mode::ZeroPage, alu::LDA>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<LDA_ZeroPageX>) {
+    read_op<T, mode::ZeroPageX, alu::LDA>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<LDA_Absolute>) {
+    read_op<T, mode::Absolute, alu::LDA>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<LDA_AbsoluteX>) {
+    read_op<T, mode::AbsoluteX, alu::LDA>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<LDA_AbsoluteY>) {
+    read_op<T, mode::AbsoluteY, alu::LDA>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<LDA_IndirectX>) {
+    read_op<T, mode::IndirectX, alu::LDA>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<LDA_IndirectY>) {
+    read_op<T, mode::IndirectY, alu::LDA>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<LDX_Immediate>) {
+    read_op<T, mode::Immediate, alu::LDX>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<LDX_ZeroPage>) {
+    read_op<T, mode::ZeroPage, alu::LDX>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<LDX_ZeroPageY>) {
+    read_op<T, mode::ZeroPageY, alu::LDX>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<LDX_Absolute>) {
+    read_op<T, mode::Absolute, alu::LDX>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<LDX_AbsoluteY>) {
+    read_op<T, mode::AbsoluteY, alu::LDX>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<LDY_Immediate>) {
+    read_op<T, mode::Immediate, alu::LDY>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<LDY_ZeroPage>) {
+    read_op<T, mode::ZeroPage, alu::LDY>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<LDY_ZeroPageX>) {
+    read_op<T, mode::ZeroPageX, alu::LDY>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<LDY_Absolute>) {
+    read_op<T, mode::Absolute, alu::LDY>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<LDY_AbsoluteX>) {
+    read_op<T, mode::AbsoluteX, alu::LDY>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<LSR_Implied>) {
+    cpu.P.sync();
+    cpu.cycle();
+    cpu.P.CF = cpu.A() & 0x01;
+    auto v = (cpu.A() >> 1);
+    cpu.P.NF = 0;
+    cpu.P.ZF = cpu.A() == 0 ? 1 : 0;
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<LSR_ZeroPage>) {
+    cpu.P.sync();
+    auto zp = cpu.fetchByte<T>(ram);
+    auto res = cpu.readData<T>(ram, zp);
+    cpu.P.CF = res & 0x01;
+    res = (res >> 1);
+    cpu.cycle();
+    cpu.writeData<T>(ram, zp, res);
+    cpu.P.NF = 0;
+    cpu.P.ZF = res == 0 ? 1 : 0;
+    cpu.P.NF = 0;
+    cpu.P.ZF = res == 0 ? 1 : 0;
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<LSR_ZeroPageX>) {
+    cpu.P.sync();
+    auto zp = cpu.fetchByte<T>(ram);
+    zp = (zp + cpu.X()) & 0xff;
+    cpu.cycle();
+    auto res = cpu.readData<T>(ram, zp);
+    cpu.P.CF = res & 0x01;
+    res = (res >> 1);
+    cpu.cycle();
+    cpu.writeData<T>(ram, zp, res);
+    cpu.P.NF = 0;
+    cpu.P.ZF = res == 0 ? 1 : 0;
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<LSR_Absolute>) {
+    cpu.P.sync();
+    uint16_t adr = cpu.fetchByte<T>(ram) | cpu.fetchByte<T>(ram) << 8;
+    auto res = cpu.readData<T>(ram, adr);
+    cpu.P.CF = res & 0x01;
+    res = (res >> 1);
+    cpu.cycle();
+    cpu.writeData<T>(ram, adr, res);
+    cpu.P.NF = 0;
+    cpu.P.ZF = res == 0 ? 1 : 0;
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<LSR_AbsoluteX>) {
+    cpu.P.sync();
+    uint16_t adr = cpu.fetchByte<T>(ram) | cpu.fetchByte<T>(ram) << 8;
+    adr = (adr + cpu.X()) & 0xffff;
+    cpu.cycle();
+    auto res = cpu.readData<T>(ram, adr);
+    cpu.P.CF = res & 0x01;
+    res = (res >> 1);
+    cpu.cycle();
+    cpu.writeData<T>(ram, adr, res);
+    cpu.P.NF = 0;
+    cpu.P.ZF = res == 0 ? 1 : 0;
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<NOP>) {
+    cpu.cycle();
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<ORA_Immediate>) {
+    read_op<T, mode::Immediate, alu::ORA>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<ORA_ZeroPage>) {
+    read_op<T, mode::ZeroPage, alu::ORA>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<ORA_ZeroPageX>) {
+    read_op<T, mode::ZeroPageX, alu::ORA>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<ORA_Absolute>) {
+    read_op<T, mode::Absolute, alu::ORA>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<ORA_AbsoluteX>) {
+    read_op<T, mode::AbsoluteX, alu::ORA>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<ORA_AbsoluteY>) {
+    read_op<T, mode::AbsoluteY, alu::ORA>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<ORA_IndirectX>) {
+    read_op<T, mode::IndirectX, alu::ORA>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<ORA_IndirectY>) {
+    read_op<T, mode::IndirectY, alu::ORA>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<PHA>) {
+    cpu.pushByte<T>(ram, cpu.A());
+    cpu.cycle();
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<PHP>) {
+    auto v = cpu.P.asByte();
+    cpu.pushByte<T>(ram, v);
+    cpu.cycle();
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<PLA>) {
+    auto v = cpu.popByte<T>(ram);
+    cpu.cycle();
+    cpu.setA(v);
+    cpu.set_flags(NF_Mask | ZF_Mask, 8, v, 0);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<PLP>) {
+    auto v = cpu.popByte<T>(ram);
+    cpu.cycle();
+    cpu.P.setByte(v);
+    cpu.update_next_event();
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<ROL_Implied>) {
+    cpu.P.sync();
+    cpu.cycle();
+    auto cf = cpu.P.CF;
+    cpu.P.CF = cpu.A() & 0x80;
+    auto v = (cpu.A() << 1) | cf;
+    cpu.setA(v);
+    cpu.set_flags(NF_Mask | ZF_Mask, 8, v, 0);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<ROL_ZeroPage>) {
+    cpu.P.sync();
+    auto zp = cpu.fetchByte<T>(ram);
+    auto res = cpu.readData<T>(ram, zp);
+    auto cf = cpu.P.CF;
+    cpu.P.CF = res & 0x80;
+    res = (res << 1) | cf;
+    cpu.cycle();
+    cpu.writeData<T>(ram, zp, res);
+    cpu.set_flags(NF_Mask | ZF_Mask, 8, res, 0);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<ROL_ZeroPageX>) {
+    cpu.P.sync();
+    auto zp = cpu.fetchByte<T>(ram);
+    zp = (zp + cpu.X()) & 0xff;
+    cpu.cycle();
+    auto res = cpu.readData<T>(ram, zp);
+    auto cf = cpu.P.CF;
+    cpu.P.CF = res & 0x80;
+    res = (res << 1) | cf;
+    cpu.cycle();
+    cpu.writeData<T>(ram, zp, res);
+    cpu.set_flags(NF_Mask | ZF_Mask, 8, res, 0);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<ROL_Absolute>) {
+    cpu.P.sync();
+    uint16_t adr = cpu.fetchByte<T>(ram) | cpu.fetchByte<T>(ram) << 8;
+    auto res = cpu.readData<T>(ram, adr);
+    auto cf = cpu.P.CF;
+    cpu.P.CF = res & 0x80;
+    res = (res << 1) | cf;
+    cpu.cycle();
+    cpu.writeData<T>(ram, adr, res);
+    cpu.set_flags(NF_Mask | ZF_Mask, 8, res, 0);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<ROL_AbsoluteX>) {
+    cpu.P.sync();
+    uint16_t adr = cpu.fetchByte<T>(ram) | cpu.fetchByte<T>(ram) << 8;
+    adr = (adr + cpu.X()) & 0xffff;
+    cpu.cycle();
+    auto res = cpu.readData<T>(ram, adr);
+    auto cf = cpu.P.CF;
+    cpu.P.CF = res & 0x80;
+    res = (res << 1) | cf;
+    cpu.cycle();
+    cpu.writeData<T>(ram, adr, res);
+    cpu.set_flags(NF_Mask | ZF_Mask, 8, res, 0);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<ROR_Implied>) {
+    cpu.P.sync();
+    cpu.cycle();
+    auto cf = cpu.P.CF;
+    cpu.P.CF = cpu.A() & 0x01;
+    auto v = (cpu.A() >> 1) | (cf ? 0x80 : 0);
+    cpu.setA(v);
+    cpu.set_flags(NF_Mask | ZF_Mask, 8, v, 0);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<ROR_ZeroPage>) {
+    cpu.P.sync();
+    auto zp = cpu.fetchByte<T>(ram);
+    auto res = cpu.readData<T>(ram, zp);
+    auto cf = cpu.P.CF;
+    cpu.P.CF = res & 0x01;
+    res = (res >> 1) | (cf ? 0x80 : 0);
+    cpu.cycle();
+    cpu.writeData<T>(ram, zp, res);
+    cpu.set_flags(NF_Mask | ZF_Mask, 8, res, 0);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<ROR_ZeroPageX>) {
+    cpu.P.sync();
+    auto zp = cpu.fetchByte<T>(ram);
+    zp = (zp + cpu.X()) & 0xff;
+    cpu.cycle();
+    auto res = cpu.readData<T>(ram, zp);
+    auto cf = cpu.P.CF;
+    cpu.P.CF = res & 0x01;
+    res = (res >> 1) | (cf ? 0x80 : 0);
+    cpu.cycle();
+    cpu.writeData<T>(ram, zp, res);
+    cpu.set_flags(NF_Mask | ZF_Mask, 8, res, 0);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<ROR_Absolute>) {
+    cpu.P.sync();
+    uint16_t adr = cpu.fetchByte<T>(ram) | cpu.fetchByte<T>(ram) << 8;
+    auto res = cpu.readData<T>(ram, adr);
+    auto cf = cpu.P.CF;
+    cpu.P.CF = res & 0x01;
+    res = (res >> 1) | (cf ? 0x80 : 0);
+    cpu.cycle();
+    cpu.writeData<T>(ram, adr, res);
+    cpu.set_flags(NF_Mask | ZF_Mask, 8, res, 0);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<ROR_AbsoluteX>) {
+    cpu.P.sync();
+    uint16_t adr = cpu.fetchByte<T>(ram) | cpu.fetchByte<T>(ram) << 8;
+    adr = (adr + cpu.X()) & 0xffff;
+    cpu.cycle();
+    auto res = cpu.readData<T>(ram, adr);
+    auto cf = cpu.P.CF;
+    cpu.P.CF = res & 0x01;
+    res = (res >> 1) | (cf ? 0x80 : 0);
+    cpu.cycle();
+    cpu.writeData<T>(ram, adr, res);
+    cpu.set_flags(NF_Mask | ZF_Mask, 8, res, 0);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<RTI>) {
+    cpu.restore_segments();
+    auto p = cpu.popByte<T>(ram);
+    uint16_t pc = cpu.popByte<T>(ram) | cpu.popByte<T>(ram) << 8;
+    cpu.P.setByte(p);
+    cpu.PC = pc;
+    cpu.cycle();
+    cpu.cycle();
+    cpu.update_next_event();
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<RTS>) {
+    uint16_t pc = cpu.popByte<T>(ram) | cpu.popByte<T>(ram) << 8;
+    cpu.PC = pc + 1;
+    cpu.cycle();
+    cpu.cycle();
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<SBC_Immediate>) {
+    read_op<T, mode::Immediate, alu::SBC>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<SBC_ZeroPage>) {
+    read_op<T, mode::ZeroPage, alu::SBC>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<SBC_ZeroPageX>) {
+    read_op<T, mode::ZeroPageX, alu::SBC>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<SBC_Absolute>) {
+    read_op<T, mode::Absolute, alu::SBC>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<SBC_AbsoluteX>) {
+    read_op<T, mode::AbsoluteX, alu::SBC>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<SBC_AbsoluteY>) {
+    read_op<T, mode::AbsoluteY, alu::SBC>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<SBC_IndirectX>) {
+    read_op<T, mode::IndirectX, alu::SBC>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<SBC_IndirectY>) {
+    read_op<T, mode::IndirectY, alu::SBC>(ram, cpu);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<SEC>) {
+    cpu.P.sync();
+    cpu.P.CF = 1;
+    cpu.cycle();
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<SED>) {
+    cpu.P.DF = 1;
+    cpu.cycle();
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<SEI>) {
+    cpu.P.IF = 1;
+    cpu.cycle();
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<STA_ZeroPage>) {
+    auto zp = cpu.fetchByte<T>(ram);
+    cpu.writeData<T>(ram, zp, cpu.A());
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<STA_ZeroPageX>) {
+    uint8_t zp = cpu.fetchByte<T>(ram);
+    zp += cpu.X();
+    cpu.cycle();
+    cpu.writeData<T>(ram, zp, cpu.A());
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<STA_Absolute>) {
+    uint16_t adr = cpu.fetchByte<T>(ram) | cpu.fetchByte<T>(ram) << 8;
+    cpu.writeData<T>(ram, adr, cpu.A());
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<STA_AbsoluteX>) {
+    uint16_t adr = cpu.fetchByte<T>(ram) | cpu.fetchByte<T>(ram) << 8;
+    adr += cpu.X();
+    cpu.cycle();
+    cpu.writeData<T>(ram, adr, cpu.A());
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<STA_AbsoluteY>) {
+    uint16_t adr = cpu.fetchByte<T>(ram) | cpu.fetchByte<T>(ram) << 8;
+    adr += cpu.Y();
+    cpu.cycle();
+    cpu.writeData<T>(ram, adr, cpu.A());
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<STA_IndirectX>) {
+    uint8_t zp = cpu.fetchByte<T>(ram);
+    zp += cpu.X();
+    cpu.cycle();
+    uint16_t adr = cpu.readData<T>(ram, zp) | cpu.readData<T>(ram, zp + 1);
+    cpu.writeData<T>(ram, adr, cpu.A());
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<STA_IndirectY>) {
+    uint8_t zp = cpu.fetchByte<T>(ram);
+    uint16_t adr = cpu.readData<T>(ram, zp) | cpu.readData<T>(ram, zp + 1);
+    adr += cpu.X();
+    cpu.cycle();
+    cpu.writeData<T>(ram, adr, cpu.A());
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<STX_ZeroPage>) {
+    auto zp = cpu.fetchByte<T>(ram);
+    cpu.writeData<T>(ram, zp, cpu.X());
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<STX_ZeroPageY>) {
+    auto zp = cpu.fetchByte<T>(ram);
+    zp += cpu.Y();
+    cpu.cycle();
+    cpu.writeData<T>(ram, zp, cpu.X());
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<STX_Absolute>) {
+    uint16_t adr = cpu.fetchByte<T>(ram) | cpu.fetchByte<T>(ram) << 8;
+    cpu.writeData<T>(ram, adr, cpu.X());
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<STY_ZeroPage>) {
+    auto zp = cpu.fetchByte<T>(ram);
+    cpu.writeData<T>(ram, zp, cpu.Y());
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<STY_ZeroPageX>) {
+    auto zp = cpu.fetchByte<T>(ram);
+    zp += cpu.X();
+    cpu.cycle();
+    cpu.writeData<T>(ram, zp, cpu.Y());
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<STY_Absolute>) {
+    uint16_t adr = cpu.fetchByte<T>(ram) | cpu.fetchByte<T>(ram) << 8;
+    cpu.writeData<T>(ram, adr, cpu.Y());
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<TAX>) {
+    cpu.cycle();
+    cpu.setX(cpu.A());
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<TAY>) {
+    cpu.cycle();
+    cpu.setY(cpu.A());
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<TSX>) {
+    cpu.cycle();
+    cpu.setX(cpu.SP & (0xff));
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<TXA>) {
+    cpu.cycle();
+    cpu.setA(cpu.X());
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<TXS>) {
+    cpu.cycle();
+    cpu.SP = 0x100 | cpu.X();
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<TYA>) {
+    cpu.cycle();
+    cpu.setA(cpu.Y());
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<BRA>) {
+    auto rel8 = cpu.fetchByte<T>(ram);
+    cpu.branch_relative8_if(rel8, true);
+}
+
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<STZ_ZeroPage>) {
+    auto zp = cpu.fetchByte<T>(ram);
+    cpu.writeData<T>(ram, zp, 0);
+}
 
-        case NOP: {
-            cycle();
-            break;
-        }
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<STZ_ZeroPageX>) {
+    auto zp = cpu.fetchByte<T>(ram);
+    zp += cpu.X();
+    cpu.cycle();
+    cpu.writeData<T>(ram, zp, 0);
+}
 
-        case ORA_Immediate: {
-            auto imm = fetchByte(ram);
-            auto v = A() | imm;
-            setA(v);
-            set_flags(NF_Mask | ZF_Mask, 8, v, 0);
-            break;
-        }
-        case ORA_ZeroPage:
-        case ORA_ZeroPageX: {
-            auto zp = (uint8_t)(fetchByte(ram) + (opcode == AND_ZeroPageX ? X() : 0));
-            auto v = readByte(ram, DS, zp);
-            auto v2 = A() | v;
-            setA(v2);
-            set_flags(NF_Mask | ZF_Mask, 8, v2, 0);
-            break;
-        }
-        case ORA_Absolute:
-        case ORA_AbsoluteX:
-        case ORA_AbsoluteY: {
-            uint16_t adr = fetchByte(ram) | fetchByte(ram) << 8;
-            adr += opcode == AND_AbsoluteX ? X() : opcode == AND_AbsoluteY ? Y() : 0;
-            auto v = readByte(ram, DS, adr);
-            auto v2 = A() | v;
-            setA(v2);
-            set_flags(NF_Mask | ZF_Mask, 8, v2, 0);
-            break;
-        }
-        case ORA_IndirectX: {
-            uint8_t zp = fetchByte(ram) + X();
-            cycle();
-            uint16_t adr = readByte(ram, DS, zp) | readByte(ram, DS, zp+1) << 8;
-            auto v = readByte(ram, DS, adr);
-            auto v2 = A() | v;
-            setA(v2);
-            set_flags(NF_Mask | ZF_Mask, 8, v2, 0);
-            break;
-        }
-        case ORA_IndirectY: {
-            uint8_t zp = fetchByte(ram);
-            uint16_t adr = readByte(ram, DS, zp) | readByte(ram, DS, zp+1) << 8;
-            auto v = readByte(ram, DS, adr + Y());
-            auto v2 = A() | v;
-            setA(v2);
-            set_flags(NF_Mask | ZF_Mask, 8, v2, 0);
-            break;
-        }
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<STZ_Absolute>) {
+    auto adr = cpu.fetchWord<T>(ram);
+    cpu.writeData<T>(ram, adr, 0);
+}
 
-        case PHA: {
-            pushByte(ram, A());
-            cycle();
-            break;
-        }
-        case PHP: {
-            auto v = P.asByte();
-            pushByte(ram, v);
-            cycle();
-            break;
-        }
-        case PLA: {
-            auto v = popByte(ram);
-            cycle();
-            setA(v);
-            set_flags(NF_Mask | ZF_Mask, 8, v, 0);
-            break;
-        }
-        case PLP: {
-            auto v = popByte(ram);
-            cycle();
-            P.setByte(v);
-            break;
-        }
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<STZ_AbsoluteX>) {
+    auto adr = cpu.fetchWord<T>(ram);
+    adr += cpu.X();
+    cpu.cycle();
+    cpu.writeData<T>(ram, adr, 0);
+}
 
-        case ROL_Implied: {
-            cycle();
-            auto cf = P.CF;
-            P.CF = A() & 0x80;
-            auto v = (A() << 1) | cf;
-            setA(v);
-            set_flags(NF_Mask | ZF_Mask, 8, v, 0);
-            break;
-        }
-        case ROL_ZeroPage: {
-            auto zp = fetchByte(ram);
-            auto res = readByte(ram, DS, zp);
-            auto cf = P.CF;
-            P.CF = res & 0x80;
-            res = (res << 1) | cf;
-            cycle();
-            writeByte(ram, DS, zp, res);
-            set_flags(NF_Mask | ZF_Mask, 8, res, 0);
-            break;
-        }
-        case ROL_ZeroPageX: {
-            auto zp = fetchByte(ram);
-            zp = (zp + X()) & 0xff;
-            cycle();
-            auto res = readByte(ram, DS, zp);
-            auto cf = P.CF;
-            P.CF = res & 0x80;
-            res = (res << 1) | cf;
-            cycle();
-            writeByte(ram, DS, zp, res);
-            set_flags(NF_Mask | ZF_Mask, 8, res, 0);
-            break;
-        }
-        case ROL_Absolute: {
-            uint16_t adr = fetchByte(ram) | fetchByte(ram) << 8;
-            auto res = readByte(ram, DS, adr);
-            auto cf = P.CF;
-            P.CF = res & 0x80;
-            res = (res << 1) | cf;
-            cycle();
-            writeByte(ram, DS, adr, res);
-            set_flags(NF_Mask | ZF_Mask, 8, res, 0);
-            break;
-        }
-        case ROL_AbsoluteX: {
-            uint16_t adr = fetchByte(ram) | fetchByte(ram) << 8;
-            adr = (adr + X()) & 0xffff;
-            cycle();
-            auto res = readByte(ram, DS, adr);
-            auto cf = P.CF;
-            P.CF = res & 0x80;
-            res = (res << 1) | cf;
-            cycle();
-            writeByte(ram, DS, adr, res);
-            set_flags(NF_Mask | ZF_Mask, 8, res, 0);
-            break;
-        }
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<XTOP1>) {
+    xtop1_decodeAndExecute<T>(ram, cpu);
+}
 
-        case ROR_Implied: {
-            cycle();
-            auto cf = P.CF;
-            P.CF = A() & 0x01;
-            auto v = (A() >> 1) | (cf ? 0x80 : 0);
-            setA(v);
-            set_flags(NF_Mask | ZF_Mask, 8, v, 0);
-            break;
-        }
-        case ROR_ZeroPage: {
-            auto zp = fetchByte(ram);
-            auto res = readByte(ram, DS, zp);
-            auto cf = P.CF;
-            P.CF = res & 0x01;
-            res = (res >> 1) | (cf ? 0x80 : 0);
-            cycle();
-            writeByte(ram, DS, zp, res);
-            set_flags(NF_Mask | ZF_Mask, 8, res, 0);
-            break;
-        }
-        case ROR_ZeroPageX: {
-            auto zp = fetchByte(ram);
-            zp = (zp + X()) & 0xff;
-            cycle();
-            auto res = readByte(ram, DS, zp);
-            auto cf = P.CF;
-            P.CF = res & 0x01;
-            res = (res >> 1) | (cf ? 0x80 : 0);
-            cycle();
-            writeByte(ram, DS, zp, res);
-            set_flags(NF_Mask | ZF_Mask, 8, res, 0);
-            break;
-        }
-        case ROR_Absolute: {
-            uint16_t adr = fetchByte(ram) | fetchByte(ram) << 8;
-            auto res = readByte(ram, DS, adr);
-            auto cf = P.CF;
-            P.CF = res & 0x01;
-            res = (res >> 1) | (cf ? 0x80 : 0);
-            cycle();
-            writeByte(ram, DS, adr, res);
-            set_flags(NF_Mask | ZF_Mask, 8, res, 0);
-            break;
-        }
-        case ROR_AbsoluteX: {
-            uint16_t adr = fetchByte(ram) | fetchByte(ram) << 8;
-            adr = (adr + X()) & 0xffff;
-            cycle();
-            auto res = readByte(ram, DS, adr);
-            auto cf = P.CF;
-            P.CF = res & 0x01;
-            res = (res >> 1) | (cf ? 0x80 : 0);
-            cycle();
-            writeByte(ram, DS, adr, res);
-            set_flags(NF_Mask | ZF_Mask, 8, res, 0);
-            break;
-        }
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<XTOP2>) {
+    xtop2_decodeAndExecute<T>(ram, cpu);
+}
 
-        case RTI: {
-            auto p = popByte(ram);
-            uint16_t pc = popByte(ram) | popByte(ram) << 8;
-            P.setByte(p);
-            PC = pc;
-            cycle();
-            cycle();
-            break;
-        }
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<XTOP3>) {
+    xtop3_decodeAndExecute<T>(ram, cpu);
+}
 
-        case RTS: {
-            uint16_t pc = popByte(ram) | popByte(ram) << 8;
-            PC = pc;
-            cycle();
-            cycle();
-            break;
-        }
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<XTOP1_TRX>) {
+    xtop1_trx_decodeAndExecute<T>(ram, cpu);
+}
 
-        case SBC_Immediate: {
-            auto imm = fetchByte(ram);
-            auto a = A();
-            auto v = a - imm - ~P.CF;
-            setA(v);
-            set_flags(NF_Mask | ZF_Mask | CF_Mask | OF_Mask, 8, v, a);
-            break;
-        }
-        case SBC_ZeroPage:
-        case SBC_ZeroPageX: {
-            auto zp = (uint8_t)(fetchByte(ram) + (opcode == SBC_ZeroPageX ? X() : 0));
-            auto v = readByte(ram, DS, zp);
-            auto a = A();
-            auto v2 = a - v - ~P.CF;
-            setA(v2);
-            set_flags(NF_Mask | ZF_Mask | CF_Mask | OF_Mask, 8, v2, a);
-            break;
-        }
-        case SBC_Absolute:
-        case SBC_AbsoluteX:
-        case SBC_AbsoluteY: {
-            uint16_t adr = fetchByte(ram) | fetchByte(ram) << 8;
-            adr += opcode == SBC_AbsoluteX ? X() : opcode == SBC_AbsoluteY ? Y() : 0;
-            auto v = readByte(ram, DS, adr);
-            auto a = A();
-            auto v2 = a - v - ~P.CF;
-            setA(v2);
-            set_flags(NF_Mask | ZF_Mask | CF_Mask | OF_Mask, 8, v2, a);
-            break;
-        }
-        case SBC_IndirectX: {
-            uint8_t zp = fetchByte(ram) + X();
-            cycle();
-            uint16_t adr = readByte(ram, DS, zp) | readByte(ram, DS, zp+1) << 8;
-            auto v = readByte(ram, DS, adr);
-            auto a = A();            
-            auto v2 = a - v - ~P.CF;
-            set_flags(NF_Mask | ZF_Mask | CF_Mask | OF_Mask, 8, v2, a);
-            break;
-        }
-        case SBC_IndirectY: {
-            uint8_t zp = fetchByte(ram);
-            uint16_t adr = readByte(ram, DS, zp) | readByte(ram, DS, zp+1) << 8;
-            auto v = readByte(ram, DS, adr + Y());
-            auto a = A();
-            auto v2 = a - v - ~P.CF;
-            setA(v2);
-            set_flags(NF_Mask | ZF_Mask | CF_Mask | OF_Mask, 8, v2, a);
-            break;
-        }
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<XTOP1_MATH>) {
+    xtop1_math_decodeAndExecute<T>(ram, cpu);
+}
 
-        case SEC: {
-            P.CF = 1;
-            cycle();
-            break;
-        }
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<XTOP2_MATH>) {
+    xtop2_math_decodeAndExecute<T>(ram, cpu);
+}
 
-        case SED: {
-            P.DF = 1;
-            cycle();
-            break;
-        }
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<XTOP3_MATH>) {
+    xtop3_math_decodeAndExecute<T>(ram, cpu);
+}
 
-        case SEI: {
-            P.IF = 1;
-            cycle();
-            break;
-        }
+template<class T> static void execute(Memory& ram, CPU& cpu, Opcode<XTOP1_STOR>) {
+    xtop1_stor_decodeAndExecute<T>(ram, cpu);
+}
 
-       case STA_ZeroPage: {
-            auto zp = fetchByte(ram);
-            writeByte(ram, DS, zp, A());
-            break;
-        }
-        case STA_ZeroPageX: {
-            uint8_t zp = fetchByte(ram);
-            zp += X();
-            cycle();
-            writeByte(ram, DS, zp, A());
-            break;
-        }
-        case STA_Absolute: {
-            uint16_t adr = fetchByte(ram) | fetchByte(ram) << 8;
-            writeByte(ram, DS, adr, A());
-            break;
-        }
-        case STA_AbsoluteX: {
-            uint16_t adr = fetchByte(ram) | fetchByte(ram) << 8;
-            adr += X();
-            cycle();
-            writeByte(ram, DS, adr, A());
-            break;
-        }
-        case STA_AbsoluteY: {
-            uint16_t adr = fetchByte(ram) | fetchByte(ram) << 8;
-            adr += Y();
-            cycle();
-            writeByte(ram, DS, adr, A());
-            break;
-        }
-        case STA_IndirectX: {
-            uint8_t zp = fetchByte(ram);
-            zp += X();
-            cycle();
-            uint16_t adr = readByte(ram, DS, zp) | readByte(ram, DS, zp + 1);
-            writeByte(ram, DS, adr, A());
-            break;
-        }
-        case STA_IndirectY: {
-            uint8_t zp = fetchByte(ram);
-            uint16_t adr = readByte(ram, DS, zp) | readByte(ram, DS, zp + 1);
-            adr += X();
-            cycle();
-            writeByte(ram, DS, adr, A());
-            break;
-        }
+// minimum model an implemented opcode requires
+static constexpr uint8_t opcodeModel(uint8_t opcode) {
+    switch(opcode) {
+        case BRA:
+        case STZ_ZeroPage:
+        case STZ_ZeroPageX:
+        case STZ_Absolute:
+        case STZ_AbsoluteX:
+            return Model65c02;
+        case XTOP1:
+        case XTOP2:
+        case XTOP3:
+        case XTOP1_TRX:
+        case XTOP1_MATH:
+        case XTOP2_MATH:
+        case XTOP3_MATH:
+        case XTOP1_STOR:
+            return Model65x02;
+        default:
+            return Model6502;
+    }
+}
 
-        case STX_ZeroPage: {
-            auto zp = fetchByte(ram);
-            writeByte(ram, DS, zp, X());
-            break;
-        }
-        case STX_ZeroPageY: {
-            auto zp = fetchByte(ram);
-            zp += Y();
-            cycle();
-            writeByte(ram, DS, zp, X());
-            break;
-        }
-        case STX_Absolute: {
-            uint16_t adr = fetchByte(ram) | fetchByte(ram) << 8;
-            writeByte(ram, DS, adr, X());
-            break;
-        }
+// executes opcode if the selected model implements it, reports it as illegal otherwise
+template<class T, uint8_t model, uint8_t opcode> static inline void dispatch(Memory& ram, CPU& cpu) {
+    if constexpr ((opcodeModel(opcode) & ~model) != 0) {
+        cpu.illegalInstruction<T>(opcode);
+    } else {
+        execute<T>(ram, cpu, Opcode<opcode>());
+    }
+}
 
-        case STY_ZeroPage: {
-            auto zp = fetchByte(ram);
-            writeByte(ram, DS, zp, Y());
-            break;
-        }
-        case STY_ZeroPageX: {
-            auto zp = fetchByte(ram);
-            zp += X();
-            cycle();
-            writeByte(ram, DS, zp, Y());
-            break;
-        }
-        case STY_Absolute: {
-            uint16_t adr = fetchByte(ram) | fetchByte(ram) << 8;
-            writeByte(ram, DS, adr, Y());
-            break;
-        }
+typedef std::array<OpHandler, 256> OpTable;
 
-        case TAX: {
-            cycle();
-            setX(A());
-            break;
-        }
-        case TAY: {
-            cycle();
-            setY(A());
-            break;
-        }
-        case TSX: {
-            cycle();
-            setX(SP & (0xff));
-            break;
-        }
-        case TXA: {
-            cycle();
-            setA(X());
-            break;
-        }
-        case TXS: {
-            cycle();
-            SP = 0x100 | X();
-            break;
-        }
-        case TYA: {
-            cycle();
-            setA(Y());
-            break;
-        }
+template<class T, uint8_t model, size_t... opcode>
+static constexpr OpTable makeOpTable(std::index_sequence<opcode...>) {
+    return {{ &dispatch<T, model, opcode>... }};
+}
 
-        case BRA: {
-            CHECK_CPU_MODE(allow65c02, opcode);
-            auto rel8 = fetchByte(ram);
-            branch_relative8_if(rel8, true);
-            break;
-        }
+// one table per combination of allow65c02/allow65x02, indexed by CpuModel bits
+template<class T> static constexpr OpTable opTables[] = {
+    makeOpTable<T, Model6502>(std::make_index_sequence<256>()),
+    makeOpTable<T, Model65c02>(std::make_index_sequence<256>()),
+    makeOpTable<T, Model65x02>(std::make_index_sequence<256>()),
+    makeOpTable<T, Model65c02 | Model65x02>(std::make_index_sequence<256>()),
+};
 
-        case STZ_ZeroPage: {
-            CHECK_CPU_MODE(allow65c02, opcode);
-            auto zp = fetchByte(ram);
-            writeByte(ram, DS, zp, 0);
-            break;
-        }
-        case STZ_ZeroPageX: {
-            CHECK_CPU_MODE(allow65c02, opcode);
-            auto zp = fetchByte(ram);
-            zp += X();
-            cycle();
-            writeByte(ram, DS, zp, 0);
-            break;
-        }
-        case STZ_Absolute: {
-            CHECK_CPU_MODE(allow65c02, opcode);
-            auto adr = fetchWord(ram);
-            writeByte(ram, DS, adr, 0);
-            break;
-        }
-        case STZ_AbsoluteX: {
-            CHECK_CPU_MODE(allow65c02, opcode);
-            auto adr = fetchWord(ram);
-            adr += X();
-            cycle();
-            writeByte(ram, DS, adr, 0);
-            break;
-        }
+template<class T> static const OpHandler* selectOpTable(uint8_t model) {
+    return opTables<T>[model].data();
+}
 
-        case XTOP1: {
-            CHECK_CPU_MODE(allow65x02, opcode);
-            xtop1_decodeAndExecute(ram, *this);
-            break;
-        }
+/*
+    What run_block calls for an instruction of a block: the PC and the
+    cycles of the operand fetches are charged in one go and the handler
+    reads the operand the block decoded. Opcodes the model does not
+    implement, and those of unknown length, fetch for themselves.
+*/
+template<uint8_t model, uint8_t opcode> static void blockOp(Memory& ram, CPU& cpu) {
+    constexpr uint8_t length = opcodeLength[opcode];
+    if constexpr (length == 0 || (opcodeModel(opcode) & ~model) != 0) {
+        dispatch<NoTrace, model, opcode>(ram, cpu);
+    } else {
+        cpu.PC += length - 1;
+        cpu.cycles += length - 1;
+        execute<Predecoded>(ram, cpu, Opcode<opcode>());
+    }
+}
 
-        case XTOP2: {
-            CHECK_CPU_MODE(allow65x02, opcode);
-            xtop2_decodeAndExecute(ram, *this);
-            break;
-        }
+template<uint8_t model, size_t... opcode>
+static constexpr OpTable makeBlockOpTable(std::index_sequence<opcode...>) {
+    return {{ &blockOp<model, opcode>... }};
+}
 
-        case XTOP3: {
-            CHECK_CPU_MODE(allow65x02, opcode);
-            xtop3_decodeAndExecute(ram, *this);
-            break;
-        }
+static constexpr OpTable blockOpTables[] = {
+    makeBlockOpTable<Model6502>(std::make_index_sequence<256>()),
+    makeBlockOpTable<Model65c02>(std::make_index_sequence<256>()),
+    makeBlockOpTable<Model65x02>(std::make_index_sequence<256>()),
+    makeBlockOpTable<Model65c02 | Model65x02>(std::make_index_sequence<256>()),
+};
 
-        case XTOP1_TRX: {
-            CHECK_CPU_MODE(allow65x02, opcode);
-            xtop1_trx_decodeAndExecute(ram, *this);
-            break;
-        }
+static const OpHandler* selectBlockOpTable(uint8_t model) {
+    return blockOpTables[model].data();
+}
 
-        case XTOP1_MATH: {
-            CHECK_CPU_MODE(allow65x02, opcode);
-            xtop1_math_decodeAndExecute(ram, *this);
-            break;
-        }
+// one instruction as run_block executes it: decoded ahead, so only the opcode fetch cycle is charged
+template<class T, uint8_t model, uint8_t opcode> static inline void predecoded(Memory& ram, CPU& cpu) {
+    cpu.opSeg = cpu.PS;
+    cpu.opPC = cpu.PC;
+    auto start = cpu.cycles;
+    cpu.instructions++;
+    cpu.OP = opcode;
+    cpu.PC++;
+    cpu.cycle();
+    dispatch<T, model, opcode>(ram, cpu);
+    cpu.opCC = cpu.cycles - start;
+}
 
-        case XTOP2_MATH: {
-            CHECK_CPU_MODE(allow65x02, opcode);
-            xtop2_math_decodeAndExecute(ram, *this);
-            break;
-        }
+// runs an entry of fusions[], stopping early if an instruction does not fall through
+template<class T, uint8_t model, uint8_t opcode, uint8_t... rest> static void fused(Memory& ram, CPU& cpu) {
+    uint16_t next = cpu.PC + opcodeLength[opcode];
+    predecoded<T, model, opcode>(ram, cpu);
+    if constexpr (sizeof...(rest) > 0) {
+        if(cpu.PC == next && cpu.state == Normal) fused<T, model, rest...>(ram, cpu);
+    }
+}
 
-        case XTOP3_MATH: {
-            CHECK_CPU_MODE(allow65x02, opcode);
-            xtop3_math_decodeAndExecute(ram, *this);
-            break;
-        }
+#define FUSED_HANDLER(...) &fused<NoTrace, model, __VA_ARGS__>,
+template<uint8_t model> static constexpr OpHandler fusedHandlers[NUM_FUSIONS] = {
+    nullptr,
+    FOR_EACH_FUSION(FUSED_HANDLER)
+};
+#undef FUSED_HANDLER
+
+static const OpHandler* selectFusedTable(uint8_t model) {
+    switch(model) {
+        case Model6502: return fusedHandlers<Model6502>;
+        case Model65c02: return fusedHandlers<Model65c02>;
+        case Model65x02: return fusedHandlers<Model65x02>;
+        default: return fusedHandlers<Model65c02 | Model65x02>;
+    }
+}
 
-        case XTOP1_STOR: {
-            CHECK_CPU_MODE(allow65x02, opcode);
-            xtop1_stor_decodeAndExecute(ram, *this);
-            break;
+#if defined(__GNUC__)
+/*
+    Threaded engine: every opcode gets its own label holding its inlined
+    handler followed by its own copy of the fetch and indirect jump, so
+    the host predicts each guest opcode's successor separately instead of
+    funnelling every instruction through one call site.
+*/
+#define OPCODE_ROW(X, h) \
+    X(h##0) X(h##1) X(h##2) X(h##3) X(h##4) X(h##5) X(h##6) X(h##7) \
+    X(h##8) X(h##9) X(h##A) X(h##B) X(h##C) X(h##D) X(h##E) X(h##F)
+#define FOR_EACH_OPCODE(X) \
+    OPCODE_ROW(X, 0x0) OPCODE_ROW(X, 0x1) OPCODE_ROW(X, 0x2) OPCODE_ROW(X, 0x3) \
+    OPCODE_ROW(X, 0x4) OPCODE_ROW(X, 0x5) OPCODE_ROW(X, 0x6) OPCODE_ROW(X, 0x7) \
+    OPCODE_ROW(X, 0x8) OPCODE_ROW(X, 0x9) OPCODE_ROW(X, 0xA) OPCODE_ROW(X, 0xB) \
+    OPCODE_ROW(X, 0xC) OPCODE_ROW(X, 0xD) OPCODE_ROW(X, 0xE) OPCODE_ROW(X, 0xF)
+
+#define THREADED_LABEL(op) &&op_##op,
+#define THREADED_HANDLER(op) op_##op: dispatch<T, model, op>(ram, *this); THREADED_NEXT();
+#define THREADED_FETCH() do { \
+        opSeg = PS; \
+        opPC = PC; \
+        start = cycles; \
+        instructions++; \
+        OP = fetchByte<T>(ram); \
+        if constexpr (T::enabled) TextSink(std::cout).put("OP=").hex8(OP).put('\n'); \
+    } while(0)
+#define THREADED_NEXT() do { \
+        opCC = cycles - start; \
+        if constexpr (T::enabled) { \
+            TextSink out(std::cout); \
+            dump_regs_info(out); \
+            out.put('\n'); \
+        } \
+        traceInstruction<T>(); \
+        countInstruction<T>(ram); \
+        profileInstruction<T>(); \
+        if(state != Normal || budget.spent(*this)) return; \
+        THREADED_FETCH(); \
+        goto *labels[OP]; \
+    } while(0)
+
+template<class T, class B, uint8_t model> void CPU::execute_threaded(Memory& ram, B budget) {
+    static void* const labels[256] = { FOR_EACH_OPCODE(THREADED_LABEL) };
+    uint64_t start;
+    if(state != Normal || budget.spent(*this)) return;
+    THREADED_FETCH();
+    goto *labels[OP];
+    FOR_EACH_OPCODE(THREADED_HANDLER)
+}
+
+#undef THREADED_NEXT
+#undef THREADED_FETCH
+#undef THREADED_HANDLER
+#undef THREADED_LABEL
+#undef FOR_EACH_OPCODE
+#undef OPCODE_ROW
+
+template<class T, class B> void CPU::execute_threaded(Memory& ram, B budget) {
+    switch(model) {
+        case Model6502: execute_threaded<T, B, Model6502>(ram, budget); break;
+        case Model65c02: execute_threaded<T, B, Model65c02>(ram, budget); break;
+        case Model65x02: execute_threaded<T, B, Model65x02>(ram, budget); break;
+        default: execute_threaded<T, B, Model65c02 | Model65x02>(ram, budget); break;
+    }
+}
+#else
+template<class T, class B> void CPU::execute_threaded(Memory& ram, B budget) {
+    // no computed goto on this compiler, run the plain loop
+    while(state == Normal && !budget.spent(*this)) {
+        execute_next_instruction<T>(ram);
+    }
+}
+#endif
+
+/*
+    Block engine: looks up the pre-decoded block at PS:PC and runs its
+    opcodes without fetching or decoding them again, handing each handler
+    the operand decoded with the block. The block is left as soon as an
+    instruction does not fall through, the cache drops blocks (the
+    instruction wrote to code), or the cpu stops.
+*/
+template<bool fuse, class B> static void run_block(Memory& ram, CPU& cpu, BlockCache& cache, Block* block, const B& budget) {
+    auto epoch = cache.epoch;
+    auto op = block->ops.data();
+    auto end = op + block->ops.size();
+    auto table = cpu.blockOpTable;
+    // the last instruction's opPC, OP and opCC are only stored once the block is left
+    const DecodedOp* last = nullptr;
+    uint16_t pc, next;
+    uint64_t start;
+    cpu.opSeg = cpu.PS;
+    do {
+        if(fuse && op->fusion && budget.allows(cpu, fusions[op->fusion].count)) {
+            auto& fusion = fusions[op->fusion];
+            next = cpu.PC + fusion.length;
+            cpu.fusedTable[op->fusion](ram, cpu);
+            cache.fusionRuns[op->fusion]++;
+            op += fusion.count - 1;
+            last = nullptr;
+            continue;
+        }
+        last = op;
+        pc = cpu.PC;
+        start = cpu.cycles;
+        cpu.instructions++;
+        cpu.operand = op->operand;
+        next = pc + op->length;
+        cpu.PC = pc + 1;
+        cpu.cycle();
+        table[op->opcode](ram, cpu);
+    } while(cache.epoch == epoch && cpu.PC == next && ++op != end
+        && cpu.state == Normal && !budget.spent(cpu));
+    if(last) {
+        cpu.opPC = pc;
+        cpu.OP = last->opcode;
+        cpu.opCC = cpu.cycles - start;
+    }
+}
+
+template<class T, class B> void CPU::execute_cached(Memory& ram, B budget) {
+    if constexpr (T::enabled || T::records || T::counts || T::profiles) {
+        // traces, counts and profiles see every instruction's handler, which blocks skip; run the plain loop
+        while(state == Normal && !budget.spent(*this)) {
+            execute_next_instruction<T>(ram);
         }
+    } else {
+        auto& cache = ram.blockCache();
+        while(state == Normal && !budget.spent(*this)) {
+            auto block = cache.lookup(ram, PS, PC);
+            if(fuseInstructions) run_block<true>(ram, *this, cache, block, budget);
+            else run_block<false>(ram, *this, cache, block, budget);
+        }
+    }
+}
 
-        default: {
-            illegalInstruction(opcode);
-            break; 
+/*
+    Translation tier: blocks run through run_block until they are hot, then
+    as native code when the host supports it. A native block only starts
+    when a full pass fits in the budget, which keeps run_for_* exact.
+*/
+template<class T, class B> void CPU::execute_translated(Memory& ram, B budget) {
+    if(T::enabled || T::records || T::counts || T::profiles || !Jit::available()) {
+        execute_cached<T>(ram, budget);
+        return;
+    }
+    auto& cache = ram.blockCache();
+    while(state == Normal && !budget.spent(*this)) {
+        auto block = cache.lookup(ram, PS, PC);
+        if(!block->native && block->hits < Jit::HOT_BLOCK && ++block->hits == Jit::HOT_BLOCK) {
+            cache.translate(ram, *block);
+        }
+        // the limits move with the next event
+        auto limits = budget.limits(*this);
+        // native code touches DS memory directly, so it needs a segment of plain RAM
+        if(block->native && !ram.mappedPages[DS] && cycles + block->nativeCycles <= limits.cycles
+            && instructions + block->nativeOps <= limits.instructions) {
+            // a store into code bails out before it, the interpreter runs it
+            P.sync(); // native code works on the flag bits
+            if(block->native(this, dsData, cache.codePage + (DS << 8), &limits)) {
+                execute_next_instruction<T>(ram);
+            }
+        } else {
+            if(fuseInstructions) run_block<true>(ram, *this, cache, block, budget);
+            else run_block<false>(ram, *this, cache, block, budget);
         }
     }
 }
+
 /*
     little endianness and register value mapping
     | d0 | d1 | d2 | d3 |
@@ -1302,6 +1703,7 @@ uint8_t CPU::registerPS() const {
 
 void CPU::set_registerPS(uint8_t val) {
     PS = val;
+    select_segments();
 }
 
 uint8_t CPU::registerDS() const {
@@ -1310,6 +1712,7 @@ uint8_t CPU::registerDS() const {
 
 void CPU::set_registerDS(uint8_t val) {
     DS = val;
+    select_segments();
 }
 
 uint8_t CPU::registerSS() const {
@@ -1318,22 +1721,7 @@ uint8_t CPU::registerSS() const {
 
 void CPU::set_registerSS(uint8_t val) {
     SS = val;
-}
-
-void CPU::set_flags(uint8_t flags, size_t size, unsigned v1, unsigned v2) {
-    if(flags & ZF_Mask) {
-        P.ZF = (v1 == 0) ? 1 : 0;
-    }
-    if(flags & NF_Mask) {
-        unsigned nmask = mask(size-1, size-1);
-        P.NF = (v1 & nmask) ? 1 : 0;
-    }
-    if(flags & CF_Mask) {
-        P.CF = (v1 < v2) ? 1 : 0;
-    }
-    if(flags & OF_Mask) {
-        P.OF = 0; // TODO
-    }
+    select_segments();
 }
 
 void CPU::branch_relative8_if(int8_t rel, bool cond) {
@@ -1345,77 +1733,3 @@ void CPU::branch_relative8_if(int8_t rel, bool cond) {
         PC = newPC;
     }
 }
-
-void CPU::pushByte(Memory& ram, uint8_t byte) {
-    writeByte(ram, SS, SP, byte);
-    SP = ((SP - 1) & 0xff) + 0x100; // TODO: fix this
-}
-
-uint8_t CPU::popByte(Memory& ram) {
-    auto byte = readByte(ram, SS, SP);
-    SP = ((SP + 1) & 0xff) + 0x100; // TODO: fix this
-    return byte;
-}
-
-uint8_t CPU::readByte(Memory& ram, uint8_t seg, uint16_t addr) {
-    auto data = ram.read(seg, addr);
-    if (tracing) {
-        std::cout << format("  read %02X:%04X=%02X", seg, addr, data) << std::endl;
-    }
-    cycle();
-    return data;
-}
-
-uint16_t CPU::readWord(Memory& ram, uint8_t seg, uint16_t addr) {
-    uint16_t data = readByte(ram, seg, addr);
-    data |= (readByte(ram, seg, addr+1) << 8);
-    if (tracing) std::cout << format("  read %02X:%04X=%04X\n", seg, addr, data);
-    return data;
-}
-
-uint32_t CPU:: readLongWord(Memory& ram, uint8_t seg, uint16_t addr) {
-    uint32_t data = readByte(ram, seg, addr);
-    data |= (readByte(ram, seg, addr+1) << 8);
-    data |= (readByte(ram, seg, addr+2) << 16);
-    data |= (readByte(ram, seg, addr+3) << 24);
-    if (tracing) std::cout << format("  read %02X:%04X=%08X\n", seg, addr, data);
-    return data;
-}
-
-uint8_t CPU::fetchByte(Memory& ram) {
-    return readByte(ram, PS, PC++);
-}
-
-uint16_t CPU::fetchWord(Memory& ram) {
-    auto word = readWord(ram, PS, PC);
-    PC += 2;
-    return word;
-}
-
-uint32_t CPU::fetchLongWord(Memory& ram) {
-    auto lword = readLongWord(ram, PS, PC);
-    PC += 4;
-    return lword;
-}
-
-void CPU::writeByte(Memory& ram, uint8_t seg, uint16_t addr, uint8_t byte) {
-    ram.write(seg, addr, byte);
-    if (tracing) std::cout << format("  wrote %02X:%04X=%02X\n", seg, addr, byte);
-    cycle();
-}
-
-void CPU::writeWord(Memory& ram, uint8_t seg, uint16_t addr, uint16_t word) {
-    writeByte(ram, seg, addr, word & 0xff);
-    writeByte(ram, seg, addr+1, word >> 8);
-}
-
-void CPU::writeLongWord(Memory& ram, uint8_t seg, uint16_t addr, uint32_t word) {
-    writeByte(ram, seg, addr, word & 0xff);
-    writeByte(ram, seg, addr+1, (word >> 8) & 0xff);
-    writeByte(ram, seg, addr+2, (word >> 16) & 0xff);
-    writeByte(ram, seg, addr+3, (word >> 24) & 0xff);
-}
-
-void CPU::cycle() {
-    cycles += 1;
-}
@@ -3,6 +3,8 @@
 
 #include <cstdint>
 #include <cstdbool>
+#include <cstring>
+#include <bit>
 
 #include <iostream>
 #include <iomanip>
@@ -10,6 +12,10 @@
 #include <exception>
 
 #include "memory.h"
+#include "opstats.h"
+#include "profiler.h"
+#include "scheduler.h"
+#include "tracering.h"
 #include "utils.h"
 
 enum ProcessorState {
@@ -28,6 +34,102 @@ enum FlagMasks: uint8_t {
     CF_Mask = 1
 };
 
+enum ExecutionEngine {
+    Interpreted, // execute_next_instruction per opcode
+    Threaded,    // computed-goto dispatch from handler to handler
+    Cached,      // runs pre-decoded basic blocks from ram.blockCache()
+    Translated   // runs hot blocks as x86-64 code, Cached elsewhere
+};
+
+// feature bits selecting which opcode table the cpu decodes with
+enum CpuModel : uint8_t {
+    Model6502 = 0,
+    Model65c02 = 1 << 0,
+    Model65x02 = 1 << 1
+};
+
+/*
+    Trace policies, picked once per run; NoTrace instantiations contain no
+    tracing code. Trace prints every step as text. RecordTrace pushes a
+    TraceRecord for every instruction and every byte the cpu reads or
+    writes (opcode and operand fetches aside) into cpu.traceRing. CountOps
+    adds every instruction and its cycles to cpu.opStats. Profile follows
+    calls and takes samples into cpu.profiler. Predecoded runs as NoTrace
+    does, for instructions of a pre-decoded block: their operand bytes come
+    from cpu.operand rather than memory, and the PC and cycles for them are
+    charged before the handler runs.
+*/
+struct NoTrace {
+    static constexpr bool enabled = false;
+    static constexpr bool records = false;
+    static constexpr bool counts = false;
+    static constexpr bool profiles = false;
+    static constexpr bool predecoded = false;
+};
+
+struct Trace {
+    static constexpr bool enabled = true;
+    static constexpr bool records = false;
+    static constexpr bool counts = false;
+    static constexpr bool profiles = false;
+    static constexpr bool predecoded = false;
+};
+
+struct RecordTrace {
+    static constexpr bool enabled = false;
+    static constexpr bool records = true;
+    static constexpr bool counts = false;
+    static constexpr bool profiles = false;
+    static constexpr bool predecoded = false;
+};
+
+struct CountOps {
+    static constexpr bool enabled = false;
+    static constexpr bool records = false;
+    static constexpr bool counts = true;
+    static constexpr bool profiles = false;
+    static constexpr bool predecoded = false;
+};
+
+struct Profile {
+    static constexpr bool enabled = false;
+    static constexpr bool records = false;
+    static constexpr bool counts = false;
+    static constexpr bool profiles = true;
+    static constexpr bool predecoded = false;
+};
+
+struct Predecoded {
+    static constexpr bool enabled = false;
+    static constexpr bool records = false;
+    static constexpr bool counts = false;
+    static constexpr bool profiles = false;
+    static constexpr bool predecoded = true;
+};
+
+// why a run returned to its caller
+enum StopCause {
+    StopBudget,  // the cycle or instruction budget ran out
+    StopBRK,     // BRK with haltOnBRK set
+    StopHalt,    // the cpu halted
+    StopReset,   // the cpu dropped into reset
+    StopIllegal  // illegal instruction at seg:pc, cpu is halted or in reset
+};
+
+struct StopReason {
+    StopCause cause;
+    uint8_t seg; // address of the last instruction executed
+    uint16_t pc;
+    uint64_t cycles;       // cycles run
+    uint64_t instructions; // instructions run
+
+    std::string describe() const;
+};
+
+struct CPU;
+
+typedef void (*OpHandler)(Memory& ram, CPU& cpu);
+
 struct ProcessorStatus {
     uint8_t CF : 1;
     uint8_t ZF : 1;
@@ -37,11 +139,68 @@ struct ProcessorStatus {
     uint8_t OF : 1;
     uint8_t NF : 1;
 
+    /*
+        Lazy flags. With CPU::lazyFlags set, set_flags only records what
+        N, Z, C and V are computed from and marks them pending here. The
+        accessors below evaluate one pending flag; sync() evaluates all
+        of them. Code that reads or writes the bits above directly must
+        sync() first; asByte() does.
+    */
+    uint8_t pending = 0; // FlagMasks whose bit is still in the record below
+    uint8_t nzSize;      // width in bits of the result N and Z come from
+    uint8_t ofSize;
+    unsigned nzValue;
+    unsigned cfValue, cfBase;            // C = cfValue < cfBase
+    unsigned ofValue, ofBase, ofAddend;  // V = ofValue overflowed ofBase + ofAddend
+
+    uint8_t negative() {
+        if(pending & NF_Mask) {
+            NF = (nzValue >> (nzSize - 1)) & 1;
+            pending &= ~NF_Mask;
+        }
+        return NF;
+    }
+
+    uint8_t zero() {
+        if(pending & ZF_Mask) {
+            ZF = nzValue == 0;
+            pending &= ~ZF_Mask;
+        }
+        return ZF;
+    }
+
+    uint8_t carry() {
+        if(pending & CF_Mask) {
+            CF = cfValue < cfBase;
+            pending &= ~CF_Mask;
+        }
+        return CF;
+    }
+
+    uint8_t overflow() {
+        if(pending & OF_Mask) {
+            OF = (~(ofBase ^ ofAddend) & (ofBase ^ ofValue)) >> (ofSize - 1) & 1;
+            pending &= ~OF_Mask;
+        }
+        return OF;
+    }
+
+    void sync() {
+        if(pending) {
+            negative();
+            zero();
+            carry();
+            overflow();
+        }
+    }
+
     uint8_t asByte() {
+        sync();
         return (NF << 7) | (OF << 6) | (1 << 5) | (BF << 4) | (DF << 3) | (IF << 2) | (ZF << 1) | (CF);
     }
 
     void setByte(uint8_t byte) {
+        pending = 0;
         NF = (byte & 0x80) >> 7;
         OF = (byte & 0x40) >> 6;
         BF = (byte & 0x10) >> 4;
@@ -67,10 +226,26 @@ struct CPU {
     uint8_t PS; // X program segment
     uint8_t DS; // X data segment
     uint8_t SS; // X stack segment
+
+    // data and page types of the PS, DS and SS segments in the memory last bound;
+    // change the segment registers through set_register* or call select_segments() after
+    MemorySegment* segments = nullptr;
+    const uint8_t* pageTypes = nullptr;
+    uint8_t* psData = nullptr;
+    uint8_t* dsData = nullptr;
+    uint8_t* ssData = nullptr;
+    const uint8_t* dsPages = nullptr;
+    const uint8_t* ssPages = nullptr;
+    uint8_t* dirtyPages = nullptr;
+    uint8_t* dsDirty = nullptr;
+    uint8_t* ssDirty = nullptr;
     
     uint16_t OP;
 
     bool tracing = false;
+    TraceRing* traceRing = nullptr; // with tracing off, runs record into this ring
+    OpStats* opStats = nullptr;     // with no trace of either kind, runs count opcodes into this
+    Profiler* profiler = nullptr;   // with none of the above, runs sample into this
     bool ignoreIllegalInstructions = true;
     bool allowHalting = false;
 
@@ -79,33 +254,132 @@ struct CPU {
     bool allow65c02 = true;
     bool allow65x02 = true;
 
-    uint64_t cycles;
+    uint8_t model = Model6502; // selected from allow65c02/allow65x02 on reset
+    const OpHandler* opTable = nullptr;      // NoTrace handlers
+    const OpHandler* traceOpTable = nullptr; // Trace handlers
+    const OpHandler* recordOpTable = nullptr; // RecordTrace handlers
+    const OpHandler* countOpTable = nullptr; // CountOps handlers
+    const OpHandler* profileOpTable = nullptr; // Profile handlers
+    const OpHandler* fusedTable = nullptr;   // NoTrace handlers for fusions[]
+    const OpHandler* blockOpTable = nullptr; // Predecoded handlers, as run_block calls them
+    uint16_t operand = 0; // operand bytes of the block instruction running, little-endian
+
+    bool fuseInstructions = false; // run fusions[] as one handler in cached blocks
+    bool lazyFlags = false;        // set_flags defers N, Z, C and V to their first reader
+
+    ExecutionEngine engine = Interpreted; // used by execute_until_break
+
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
     unsigned opCC;
 
+    /*
+        Interrupts and timed events. Runs stop at an instruction boundary
+        once cycles reach nextEvent: the earliest event in `events`, or now
+        when an NMI is pending or an IRQ line is active with IF clear. There
+        they fire the events due, then take the NMI or else the IRQ through
+        the vectors at 00:FFFA and 00:FFFE. Entering an interrupt works as
+        BRK does: it pushes PC and P (B clear), sets IF, and clears the
+        segment registers.
+
+        The frame keeps the 6502 layout, so an interrupt taken outside
+        segment 0 records the segment registers in segmentFrames instead,
+        keyed by SP after the push. The RTI that finds its frame there
+        selects those segments again before popping, from the stack the
+        frame was pushed on. Records left below SP by a handler that did
+        not return are dropped.
+    */
+    static constexpr uint16_t NMI_VECTOR = 0xfffa;
+    static constexpr uint16_t IRQ_VECTOR = 0xfffe;
+    EventScheduler events;
+    uint64_t nextEvent = UINT64_MAX;
+    uint8_t irqLines = 0;    // a bit for each source holding IRQ active
+    bool nmiPending = false; // NMI is edge-triggered, taken once per raise_nmi
+
+    // devices post through here so a running loop sees the new deadline
+    inline void post_event(uint64_t when, EventHandler* handler, uint32_t tag = 0) {
+        events.post(when, handler, tag);
+        if(when < nextEvent) nextEvent = when;
+    }
+    inline void set_irq(unsigned line, bool active) {
+        if(active) irqLines |= 1 << line;
+        else irqLines &= ~(1 << line);
+        update_next_event();
+    }
+    inline void raise_nmi() {
+        nmiPending = true;
+        nextEvent = 0;
+    }
+    // after anything that can clear IF or change the sources
+    inline void update_next_event() {
+        nextEvent = nmiPending || (irqLines && !P.IF) ? 0 : events.next();
+    }
+    struct SegmentFrame {
+        uint16_t sp;
+        uint8_t ps, ds, ss;
+    };
+    static constexpr unsigned MAX_SEGMENT_FRAMES = 8; // the oldest is dropped past this
+    SegmentFrame segmentFrames[MAX_SEGMENT_FRAMES];
+    unsigned numSegmentFrames = 0;
+    template<class T> void service_events(Memory& ram);
+    template<class T> void interrupt(Memory& ram, uint16_t vector);
+    void save_segments();    // as an interrupt frame has been pushed
+    void restore_segments(); // as RTI is about to pop one
+
+    bool illegalStop = false; // the last run stopped on an illegal instruction
+
     void init() {
         state = Reset;
         SP = 0x1ff;
         for(int i=0; i<8; i++) reg32[i] = 0;
         P.CF = P.ZF = P.IF = P.DF = P.BF = P.OF = P.NF = 0;
+        P.pending = 0;
         // Xtra
         PS = 0; // we boot at 00:fffc
         DS = 0; // we load/store data at 00:xxxx
         SS = 0; // we push/pop from 00:xxxx
+        select_segments();
         // other
+        events.rebase(cycles);
         cycles = 0;
+        instructions = 0;
+        nmiPending = false;
+        numSegmentFrames = 0;
+        update_next_event();
     }
 
     // performs a full reset of the cpu
     // and returns with the PC at the specified reset vector
     void reset(Memory& ram);
+    template<class T> void reset(Memory& ram);
 
+    // the non-template entry points pick the trace policy from `tracing`, `traceRing`,
+    // `opStats` and `profiler`, in that order
     void execute_next_instruction(Memory& ram);
+    template<class T> void execute_next_instruction(Memory& ram);
+    template<class T> void step(Memory& ram); // takes what is due first
     void execute_until_break(Memory& ram);
+    template<class T> void execute_until_break(Memory& ram);
+
+    // run until the budget is spent or the cpu stops; the budget counts
+    // from after the reset a run in state Reset starts with. A run may
+    // overshoot a cycle budget by the remainder of its last instruction,
+    // and events and interrupts that come due as it ends wait for the next run
+    StopReason run_for_cycles(Memory& ram, uint64_t n);
+    StopReason run_for_instructions(Memory& ram, uint64_t n);
+    template<class T, class B> StopReason run(Memory& ram, B budget);
+    // how a run that started at these counts ended, from the state it left
+    StopReason stop_reason(uint64_t startCycles, uint64_t startInstructions) const;
+    template<class T, class B> void execute_threaded(Memory& ram, B budget);
+    template<class T, class B, uint8_t model> void execute_threaded(Memory& ram, B budget);
+    template<class T, class B> void execute_cached(Memory& ram, B budget);
+    template<class T, class B> void execute_translated(Memory& ram, B budget);
     void decodeAndExecute(Memory& ram, uint16_t opcode);
+    template<class T> void decodeAndExecute(Memory& ram, uint16_t opcode);
     
     void illegalInstruction();
-    void illegalInstruction(uint8_t inst);
-    void illegalInstruction(uint8_t inst0, uint8_t inst1);
+    template<class T> void illegalInstruction(uint8_t inst);
+    template<class T> void illegalInstruction(uint8_t inst0, uint8_t inst1);
 
     inline uint8_t A() const { return register8(1); }
     inline uint8_t X() const { return register8(3); }
@@ -121,6 +395,27 @@ struct CPU {
     uint32_t register32(uint8_t sel) const;
     void set_register32(uint8_t sel, uint32_t val);
 
+    // reset, run and the public single-step entry points bind the memory they are given
+    inline void bind(Memory& ram) {
+        if(segments != ram.segments || pageTypes != ram.pageType) {
+            segments = ram.segments;
+            pageTypes = ram.pageType;
+            dirtyPages = ram.dirtyPage;
+            select_segments();
+        }
+    }
+
+    inline void select_segments() {
+        if(!segments) return;
+        psData = segments[PS].memory;
+        dsData = segments[DS].memory;
+        ssData = segments[SS].memory;
+        dsPages = pageTypes + (DS << 8);
+        ssPages = pageTypes + (SS << 8);
+        dsDirty = dirtyPages + (DS << 8);
+        ssDirty = dirtyPages + (SS << 8);
+    }
+
     uint8_t registerPS() const;
     void set_registerPS(uint8_t val);
     uint8_t registerDS() const;
@@ -129,29 +424,274 @@ struct CPU {
     void set_registerSS(uint8_t val);
     
     void branch_relative8_if(int8_t rel, bool cond);
-    void pushByte(Memory& ram, uint8_t byte);
-    uint8_t popByte(Memory& ram);
-    uint8_t fetchByte(Memory& ram);
-    uint16_t fetchWord(Memory& ram);
-    uint32_t fetchLongWord(Memory& ram);
-    uint8_t readByte(Memory& ram, uint8_t seg, uint16_t addr);
-    uint16_t readWord(Memory& ram, uint8_t seg, uint16_t addr);
-    uint32_t readLongWord(Memory& ram, uint8_t seg, uint16_t addr);
-
-    void writeByte(Memory& ram, uint8_t seg, uint16_t addr, uint8_t byte);
-    void writeWord(Memory& ram, uint8_t seg, uint16_t addr, uint16_t word);
-    void writeLongWord(Memory& ram, uint8_t seg, uint16_t addr, uint32_t word);
-    void cycle();
+    template<class T> void pushByte(Memory& ram, uint8_t byte);
+    template<class T> uint8_t popByte(Memory& ram);
+    template<class T> uint8_t fetchByte(Memory& ram);
+    template<class T> uint16_t fetchWord(Memory& ram);
+    template<class T> uint32_t fetchLongWord(Memory& ram);
+    template<class T> uint8_t readByte(Memory& ram, uint8_t seg, uint16_t addr);
+    template<class T> uint16_t readWord(Memory& ram, uint8_t seg, uint16_t addr);
+    template<class T> uint32_t readLongWord(Memory& ram, uint8_t seg, uint16_t addr);
+
+    template<class T> void writeByte(Memory& ram, uint8_t seg, uint16_t addr, uint8_t byte);
+    // DS accesses through dsData, leaving it only for pages that are not RAM
+    template<class T> uint8_t readData(Memory& ram, uint16_t addr);
+    template<class T> void writeData(Memory& ram, uint16_t addr, uint8_t byte);
+    template<class T> void writeWord(Memory& ram, uint8_t seg, uint16_t addr, uint16_t word);
+    template<class T> void writeLongWord(Memory& ram, uint8_t seg, uint16_t addr, uint32_t word);
+    // little-endian W at seg:addr in one host access when it stays inside the segment
+    // on pages that need no mapping, else a byte at a time wrapping like the cpu does
+    template<class T, class W> W readMulti(Memory& ram, uint8_t seg, uint16_t addr);
+    template<class T, class W> void writeMulti(Memory& ram, uint8_t seg, uint16_t addr, W word);
+    inline void cycle() { cycles += 1; }
+    template<class T> void traceAccess(uint8_t kind, uint8_t seg, uint16_t addr, uint8_t byte);
+    template<class T> void traceInstruction();
+    template<class T> void countInstruction(Memory& ram);
+    template<class T> void profileInstruction();
 
     // flags is a mask matching the flags in cpu.P
     // only CF, ZF, NF, and VF are settable with this function
-    void set_flags(uint8_t flags, size_t size, unsigned v1, unsigned v2);
+    // v1 is the result of v2 + addend (for subtraction, v2 + ~operand); addend is only used for VF
+    void set_flags(uint8_t flags, size_t size, unsigned v1, unsigned v2, unsigned addend = 0);
 
     void dump_regs_info(std::ostream& ostr) {
-        ostr << format("PC=%04X SP=%04X A=%02X X=%02X Y=%02X P=%02X", PC, SP, A(), X(), Y(), P.asByte());
-        ostr << " (" << std::bitset<8>(P.asByte()) << ")";
+        TextSink out(ostr);
+        dump_regs_info(out);
+    }
+    void dump_regs_info(TextSink& out) {
+        out.put("PC=").hex16(PC).put(" SP=").hex16(SP).put(" A=").hex8(A()).put(" X=").hex8(X())
+            .put(" Y=").hex8(Y()).put(" P=").hex8(P.asByte()).put(" (").bin8(P.asByte()).put(')');
     }
 
 };
 
+inline void CPU::set_flags(uint8_t flags, size_t size, unsigned v1, unsigned v2, unsigned addend) {
+    auto nz = flags & (NF_Mask | ZF_Mask);
+    // N and Z share one record, so a lone N or Z is set right away
+    if(lazyFlags && nz != NF_Mask && nz != ZF_Mask) {
+        if(nz) {
+            P.nzValue = v1;
+            P.nzSize = size;
+        }
+        if(flags & CF_Mask) {
+            P.cfValue = v1;
+            P.cfBase = v2;
+        }
+        if(flags & OF_Mask) {
+            P.ofValue = v1;
+            P.ofBase = v2;
+            P.ofAddend = addend;
+            P.ofSize = size;
+        }
+        P.pending |= flags & (NF_Mask | ZF_Mask | CF_Mask | OF_Mask);
+        return;
+    }
+    P.pending &= ~flags;
+    if(flags & ZF_Mask) {
+        P.ZF = (v1 == 0) ? 1 : 0;
+    }
+    if(flags & NF_Mask) {
+        P.NF = (v1 >> (size-1)) & 1;
+    }
+    if(flags & CF_Mask) {
+        P.CF = (v1 < v2) ? 1 : 0;
+    }
+    if(flags & OF_Mask) {
+        P.OF = (~(v2 ^ addend) & (v2 ^ v1)) >> (size-1) & 1;
+    }
+}
+
+// one "  read SS:AAAA=..." or "  wrote ..." line of a Trace run
+static inline void trace_access(const char* what, uint8_t seg, uint16_t addr, uint32_t data, unsigned digits) {
+    TextSink(std::cout).put(what).address(seg, addr).put('=').hex(data, digits).put('\n');
+}
+
+template<class T> inline void CPU::traceAccess(uint8_t kind, uint8_t seg, uint16_t addr, uint8_t byte) {
+    if constexpr (T::records) {
+        TraceRecord r;
+        r.cycles = cycles;
+        r.kind = kind;
+        r.seg = seg;
+        r.adr = addr;
+        r.data = byte;
+        traceRing->push(&r);
+    }
+}
+
+template<class T> inline void CPU::traceInstruction() {
+    if constexpr (T::records) {
+        TraceRecord r[2];
+        r[0].cycles = cycles;
+        r[0].instructions = instructions;
+        r[0].kind = TraceInstruction;
+        r[0].seg = opSeg;
+        r[0].adr = opPC;
+        r[0].data = P.asByte();
+        r[0].op = OP;
+        r[0].ps = PS;
+        r[0].ds = DS;
+        r[0].ss = SS;
+        r[0].pc = PC;
+        r[0].sp = SP;
+        memcpy(&r[1], reg32, sizeof(reg32));
+        traceRing->push(r, 2);
+    }
+}
+
+template<class T> inline void CPU::countInstruction(Memory& ram) {
+    if constexpr (T::counts) opStats->add(ram, OP, opSeg, opPC, opCC);
+}
+
+template<class T> inline void CPU::profileInstruction() {
+    if constexpr (T::profiles) profiler->step(OP, opSeg, opPC, PS, PC, SP, cycles);
+}
+
+template<class T> inline uint8_t CPU::readByte(Memory& ram, uint8_t seg, uint16_t addr) {
+    auto data = ram.read(seg, addr);
+    if constexpr (T::enabled) trace_access("  read ", seg, addr, data, 2);
+    cycle();
+    traceAccess<T>(TraceRead, seg, addr, data);
+    return data;
+}
+
+template<class T, class W> inline W CPU::readMulti(Memory& ram, uint8_t seg, uint16_t addr) {
+    constexpr unsigned N = sizeof(W);
+    if constexpr (!T::enabled && !T::records && std::endian::native == std::endian::little) {
+        auto types = ram.pageType + (seg << 8);
+        if(addr <= MemorySegment::SEGMENT_SIZE - N
+            && types[addr >> 8] != PageDevice && types[(addr + N - 1) >> 8] != PageDevice) {
+            W data;
+            memcpy(&data, ram.segments[seg].memory + addr, N);
+            cycles += N;
+            return data;
+        }
+    }
+    W data = 0;
+    for(unsigned i=0; i<N; i++) {
+        data |= W(readByte<T>(ram, seg, addr + i)) << (8 * i);
+    }
+    return data;
+}
+
+template<class T> inline uint16_t CPU::readWord(Memory& ram, uint8_t seg, uint16_t addr) {
+    auto data = readMulti<T, uint16_t>(ram, seg, addr);
+    if constexpr (T::enabled) trace_access("  read ", seg, addr, data, 4);
+    return data;
+}
+
+template<class T> inline uint32_t CPU::readLongWord(Memory& ram, uint8_t seg, uint16_t addr) {
+    auto data = readMulti<T, uint32_t>(ram, seg, addr);
+    if constexpr (T::enabled) trace_access("  read ", seg, addr, data, 8);
+    return data;
+}
+
+template<class T> inline uint8_t CPU::readData(Memory& ram, uint16_t addr) {
+    auto data = dsPages[addr >> 8] == PageDevice ? ram.read_mapped(DS, addr) : dsData[addr];
+    if constexpr (T::enabled) trace_access("  read ", DS, addr, data, 2);
+    cycle();
+    traceAccess<T>(TraceRead, DS, addr, data);
+    return data;
+}
+
+template<class T> inline uint8_t CPU::fetchByte(Memory& ram) {
+    if constexpr (T::predecoded) {
+        uint8_t data = operand;
+        operand >>= 8;
+        return data;
+    }
+    auto data = psData[PC];
+    if constexpr (T::enabled) trace_access("  read ", PS, PC, data, 2);
+    PC++;
+    cycle();
+    return data;
+}
+
+template<class T> inline uint16_t CPU::fetchWord(Memory& ram) {
+    if constexpr (T::predecoded) return operand;
+    auto word = readWord<T>(ram, PS, PC);
+    PC += 2;
+    return word;
+}
+
+template<class T> inline uint32_t CPU::fetchLongWord(Memory& ram) {
+    auto lword = readLongWord<T>(ram, PS, PC);
+    PC += 4;
+    return lword;
+}
+
+template<class T> inline void CPU::writeByte(Memory& ram, uint8_t seg, uint16_t addr, uint8_t byte) {
+    ram.write(seg, addr, byte);
+    if constexpr (T::enabled) trace_access("  wrote ", seg, addr, byte, 2);
+    cycle();
+    traceAccess<T>(TraceWrite, seg, addr, byte);
+}
+
+template<class T> inline void CPU::writeData(Memory& ram, uint16_t addr, uint8_t byte) {
+    if(dsPages[addr >> 8] != PageRAM) {
+        ram.write_mapped(DS, addr, byte);
+    } else {
+        dsData[addr] = byte;
+        dsDirty[addr >> 8] = 1;
+        if(ram.blocks) ram.blocks->written(DS, addr);
+    }
+    if constexpr (T::enabled) trace_access("  wrote ", DS, addr, byte, 2);
+    cycle();
+    traceAccess<T>(TraceWrite, DS, addr, byte);
+}
+
+template<class T, class W> inline void CPU::writeMulti(Memory& ram, uint8_t seg, uint16_t addr, W word) {
+    constexpr unsigned N = sizeof(W);
+    if constexpr (!T::enabled && !T::records && std::endian::native == std::endian::little) {
+        auto types = ram.pageType + (seg << 8);
+        uint16_t last = addr + N - 1;
+        if(addr <= MemorySegment::SEGMENT_SIZE - N
+            && types[addr >> 8] == PageRAM && types[last >> 8] == PageRAM) {
+            memcpy(ram.segments[seg].memory + addr, &word, N);
+            ram.dirtyPage[Memory::page(seg, addr)] = 1;
+            ram.dirtyPage[Memory::page(seg, last)] = 1;
+            if(ram.blocks) {
+                ram.blocks->written(seg, addr);
+                ram.blocks->written(seg, last);
+            }
+            cycles += N;
+            return;
+        }
+    }
+    for(unsigned i=0; i<N; i++) {
+        writeByte<T>(ram, seg, addr + i, (word >> (8 * i)) & 0xff);
+    }
+}
+
+template<class T> inline void CPU::writeWord(Memory& ram, uint8_t seg, uint16_t addr, uint16_t word) {
+    writeMulti<T>(ram, seg, addr, word);
+}
+
+template<class T> inline void CPU::writeLongWord(Memory& ram, uint8_t seg, uint16_t addr, uint32_t word) {
+    writeMulti<T>(ram, seg, addr, word);
+}
+
+template<class T> inline void CPU::pushByte(Memory& ram, uint8_t byte) {
+    if(ssPages[SP >> 8] != PageRAM) {
+        ram.write_mapped(SS, SP, byte);
+    } else {
+        ssData[SP] = byte;
+        ssDirty[SP >> 8] = 1;
+        if(ram.blocks) ram.blocks->written(SS, SP);
+    }
+    if constexpr (T::enabled) trace_access("  wrote ", SS, SP, byte, 2);
+    cycle();
+    traceAccess<T>(TraceWrite, SS, SP, byte);
+    SP = ((SP - 1) & 0xff) + 0x100; // TODO: fix this
+}
+
+template<class T> inline uint8_t CPU::popByte(Memory& ram) {
+    // pushes store then decrement, so pops increment then load
+    SP = ((SP + 1) & 0xff) + 0x100; // TODO: fix this
+    auto byte = ssPages[SP >> 8] == PageDevice ? ram.read_mapped(SS, SP) : ssData[SP];
+    if constexpr (T::enabled) trace_access("  read ", SS, SP, byte, 2);
+    cycle();
+    traceAccess<T>(TraceRead, SS, SP, byte);
+    return byte;
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,169 @@
+#ifndef __CPU65XKERNELS_H
+#define __CPU65XKERNELS_H
+
+#include <stdint.h>
+
+#include "memory.h"
+#include "cpu65x.h"
+
+/*
+    Addressing-mode and ALU-operation policies for the 6502 instructions
+    that read one operand byte (ADC, AND, CMP, CPX, CPY, EOR, LDA, LDX,
+    LDY, ORA, SBC). Each opcode handler is a single instantiation of
+    read_op<T, Mode, Op>, so nothing is decided at runtime beyond what the
+    instruction itself computes.
+*/
+
+namespace mode {
+
+// operand is the byte following the opcode
+struct Immediate {
+    static constexpr bool immediate = true;
+};
+
+struct ZeroPage {
+    static constexpr bool immediate = false;
+    template<class T> static uint16_t address(Memory& ram, CPU& cpu) {
+        return cpu.fetchByte<T>(ram);
+    }
+};
+
+template<uint8_t (CPU::*index)() const>
+struct ZeroPageIndexed {
+    static constexpr bool immediate = false;
+    template<class T> static uint16_t address(Memory& ram, CPU& cpu) {
+        uint8_t zp = cpu.fetchByte<T>(ram) + (cpu.*index)();
+        cpu.cycle();
+        return zp;
+    }
+};
+
+struct Absolute {
+    static constexpr bool immediate = false;
+    template<class T> static uint16_t address(Memory& ram, CPU& cpu) {
+        uint16_t lo = cpu.fetchByte<T>(ram);
+        return lo | cpu.fetchByte<T>(ram) << 8;
+    }
+};
+
+template<uint8_t (CPU::*index)() const>
+struct AbsoluteIndexed {
+    static constexpr bool immediate = false;
+    template<class T> static uint16_t address(Memory& ram, CPU& cpu) {
+        return Absolute::address<T>(ram, cpu) + (cpu.*index)();
+    }
+};
+
+// (zp,X)
+struct IndirectX {
+    static constexpr bool immediate = false;
+    template<class T> static uint16_t address(Memory& ram, CPU& cpu) {
+        uint8_t zp = cpu.fetchByte<T>(ram) + cpu.X();
+        cpu.cycle();
+        uint16_t lo = cpu.readData<T>(ram, zp);
+        return lo | cpu.readData<T>(ram, zp+1) << 8;
+    }
+};
+
+// (zp),Y
+struct IndirectY {
+    static constexpr bool immediate = false;
+    template<class T> static uint16_t address(Memory& ram, CPU& cpu) {
+        uint8_t zp = cpu.fetchByte<T>(ram);
+        uint16_t lo = cpu.readData<T>(ram, zp);
+        uint16_t adr = lo | cpu.readData<T>(ram, zp+1) << 8;
+        return adr + cpu.Y();
+    }
+};
+
+typedef ZeroPageIndexed<&CPU::X> ZeroPageX;
+typedef ZeroPageIndexed<&CPU::Y> ZeroPageY;
+typedef AbsoluteIndexed<&CPU::X> AbsoluteX;
+typedef AbsoluteIndexed<&CPU::Y> AbsoluteY;
+
+}
+
+namespace alu {
+
+struct ADC {
+    static void apply(CPU& cpu, uint8_t v) {
+        auto a = cpu.A();
+        auto res = a + v + cpu.P.carry();
+        cpu.setA(res);
+        cpu.set_flags(NF_Mask | ZF_Mask | CF_Mask | OF_Mask, 8, res, a, v);
+    }
+};
+
+struct SBC {
+    static void apply(CPU& cpu, uint8_t v) {
+        auto a = cpu.A();
+        auto res = a - v - ~cpu.P.carry();
+        cpu.setA(res);
+        cpu.set_flags(NF_Mask | ZF_Mask | CF_Mask | OF_Mask, 8, res, a, ~v);
+    }
+};
+
+struct AND {
+    static void apply(CPU& cpu, uint8_t v) {
+        auto res = cpu.A() & v;
+        cpu.setA(res);
+        cpu.set_flags(NF_Mask | ZF_Mask, 8, res, 0);
+    }
+};
+
+struct EOR {
+    static void apply(CPU& cpu, uint8_t v) {
+        auto res = cpu.A() ^ v;
+        cpu.setA(res);
+        cpu.set_flags(NF_Mask | ZF_Mask, 8, res, 0);
+    }
+};
+
+struct ORA {
+    static void apply(CPU& cpu, uint8_t v) {
+        auto res = cpu.A() | v;
+        cpu.setA(res);
+        cpu.set_flags(NF_Mask | ZF_Mask, 8, res, 0);
+    }
+};
+
+// compare the register read by get against the operand
+template<uint8_t (CPU::*get)() const>
+struct Compare {
+    static void apply(CPU& cpu, uint8_t v) {
+        auto r = (cpu.*get)();
+        auto res = r - v;
+        cpu.set_flags(NF_Mask | ZF_Mask | CF_Mask, 8, res, r);
+    }
+};
+
+// load the operand into the register written by set
+template<void (CPU::*set)(uint8_t)>
+struct Load {
+    static void apply(CPU& cpu, uint8_t v) {
+        (cpu.*set)(v);
+        cpu.set_flags(NF_Mask | ZF_Mask, 8, v, 0);
+    }
+};
+
+typedef Compare<&CPU::A> CMP;
+typedef Compare<&CPU::X> CPX;
+typedef Compare<&CPU::Y> CPY;
+typedef Load<&CPU::setA> LDA;
+typedef Load<&CPU::setX> LDX;
+typedef Load<&CPU::setY> LDY;
+
+}
+
+template<class T, class Mode, class Op>
+inline void read_op(Memory& ram, CPU& cpu) {
+    uint8_t v;
+    if constexpr (Mode::immediate) {
+        v = cpu.fetchByte<T>(ram);
+    } else {
+        v = cpu.readData<T>(ram, Mode::template address<T>(ram, cpu));
+    }
+    Op::apply(cpu, v);
+}
+
+#endif
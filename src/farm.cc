@@ -0,0 +1,102 @@
+#include "farm.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+VmFarm::VmFarm(unsigned threads) : threads(threads) {
+    if(!this->threads) this->threads = std::max(1u, std::thread::hardware_concurrency());
+}
+
+VmInstance& VmFarm::add() {
+    instances.push_back(std::make_unique<VmInstance>());
+    instances.back()->id = instances.size() - 1;
+    return *instances.back();
+}
+
+struct FarmQueue {
+    std::mutex lock;
+    std::deque<VmInstance*> ready; // the owner works from the front, thieves take from the back
+};
+
+// one quantum of inst; true once it has finished
+static bool run_slice(VmInstance& inst, uint64_t quantum) {
+    try {
+        auto stop = inst.cpu.run_for_cycles(inst.ram, std::min(quantum, inst.cycleLimit - inst.cycles));
+        inst.cycles += stop.cycles;
+        inst.instructions += stop.instructions;
+        inst.slices++;
+        if(stop.cause == StopBudget && inst.cycles < inst.cycleLimit) return false;
+        inst.stop = stop;
+    } catch(...) {
+        inst.error = std::current_exception();
+    }
+    inst.finished = true;
+    if(inst.done) inst.done(inst);
+    return true;
+}
+
+FarmStats VmFarm::run() {
+    FarmStats stats;
+    std::vector<FarmQueue> queues(threads);
+    size_t next = 0;
+    for(auto& inst : instances) {
+        if(inst->finished) continue;
+        queues[next++ % threads].ready.push_back(inst.get());
+    }
+    std::atomic<size_t> remaining(next);
+    std::atomic<uint64_t> steals(0);
+
+    auto worker = [&](unsigned self) {
+        auto& own = queues[self];
+        while(remaining.load(std::memory_order_acquire)) {
+            VmInstance* inst = nullptr;
+            {
+                std::lock_guard<std::mutex> guard(own.lock);
+                if(!own.ready.empty()) {
+                    inst = own.ready.front();
+                    own.ready.pop_front();
+                }
+            }
+            for(unsigned i=1; !inst && i<threads; i++) {
+                auto& victim = queues[(self + i) % threads];
+                std::lock_guard<std::mutex> guard(victim.lock);
+                if(!victim.ready.empty()) {
+                    inst = victim.ready.back();
+                    victim.ready.pop_back();
+                    steals.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+            if(!inst) {
+                // the rest are being run by other workers
+                std::this_thread::yield();
+                continue;
+            }
+            if(run_slice(*inst, quantum)) {
+                remaining.fetch_sub(1, std::memory_order_release);
+            } else {
+                std::lock_guard<std::mutex> guard(own.lock);
+                own.ready.push_back(inst);
+            }
+        }
+    };
+
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<std::thread> pool;
+    for(unsigned i=1; i<threads; i++) pool.emplace_back(worker, i);
+    worker(0);
+    for(auto& t : pool) t.join();
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    for(auto& inst : instances) {
+        stats.instances++;
+        stats.cycles += inst->cycles;
+        stats.instructions += inst->instructions;
+        stats.slices += inst->slices;
+    }
+    stats.steals = steals;
+    return stats;
+}
@@ -0,0 +1,63 @@
+#ifndef __FARM_H
+#define __FARM_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <exception>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "cpu65x.h"
+#include "memory.h"
+
+// one guest job of a VmFarm; the caller loads its memory and sets up its cpu before the farm runs
+struct VmInstance {
+    size_t id; // its index in VmFarm::instances
+    CPU cpu;
+    Memory ram;
+    uint64_t cycleLimit = UINT64_MAX;      // cycles it may run in all
+    std::function<void(VmInstance&)> done; // called on the worker that finished it
+
+    // filled in by the farm
+    bool finished = false;
+    StopReason stop = {};        // the run that finished it; StopBudget when cycleLimit ran out
+    std::exception_ptr error;    // what that run threw, if it threw
+    uint64_t cycles = 0;         // run in the farm
+    uint64_t instructions = 0;
+    unsigned slices = 0;
+};
+
+struct FarmStats {
+    size_t instances = 0;
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+    uint64_t slices = 0;
+    uint64_t steals = 0; // slices a worker took from another's queue
+    double seconds = 0;
+
+    double mips() const { return seconds > 0 ? instructions / seconds / 1e6 : 0; }
+};
+
+/*
+    Runs many independent instances on a fixed pool of host threads.
+    Each worker has a queue of runnable instances and runs them round
+    robin, `quantum` cycles at a time, putting an instance back at the end
+    of its queue until the instance stops (BRK with haltOnBRK, a halt, a
+    reset) or spends its cycleLimit. A worker whose queue runs dry steals
+    from the far end of another's, so the pool stays busy until the last
+    instance finishes. An instance only ever runs on one worker at a time.
+*/
+struct VmFarm {
+    uint64_t quantum = 1 << 20;
+    unsigned threads;
+    std::vector<std::unique_ptr<VmInstance>> instances;
+
+    VmFarm(unsigned threads = 0); // 0 for one per host core
+    VmInstance& add();
+    // runs the instances not finished yet, returns when all are
+    FarmStats run();
+};
+
+#endif
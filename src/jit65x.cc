@@ -0,0 +1,446 @@
+#include "jit65x.h"
+#include "blockcache.h"
+#include "memory.h"
+#include "cpu65x.h"
+#include "cpu65xops.h"
+
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__))
+#define JIT65X_X86_64 1
+#include <sys/mman.h>
+#endif
+
+#ifdef JIT65X_X86_64
+
+static_assert(offsetof(ProcessorStatus, pending) == 1, "P's flag bits are patched as a single byte");
+static_assert(sizeof(CPU::PC) == 2 && sizeof(CPU::opPC) == 2 && sizeof(CPU::OP) == 2, "16-bit fields");
+static_assert(sizeof(CPU::opCC) == 4 && sizeof(CPU::cycles) == 8 && sizeof(CPU::instructions) == 8, "counter widths");
+
+// byte offsets of the cpu state the translated code touches
+static const int32_t offA = offsetof(CPU, reg32) + 1;
+static const int32_t offX = offsetof(CPU, reg32) + 3;
+static const int32_t offY = offsetof(CPU, reg32) + 5;
+static const int32_t offP = offsetof(CPU, P);
+static const int32_t offDsDirty = offsetof(CPU, dsDirty);
+static const int32_t offPC = offsetof(CPU, PC);
+static const int32_t offPS = offsetof(CPU, PS);
+static const int32_t offOpSeg = offsetof(CPU, opSeg);
+static const int32_t offOpPC = offsetof(CPU, opPC);
+static const int32_t offOP = offsetof(CPU, OP);
+static const int32_t offOpCC = offsetof(CPU, opCC);
+static const int32_t offCycles = offsetof(CPU, cycles);
+static const int32_t offInstructions = offsetof(CPU, instructions);
+
+// bit positions of the ProcessorStatus bitfields, checked by available()
+enum : uint8_t { bitCF = 0x01, bitZF = 0x02, bitOF = 0x20, bitNF = 0x40 };
+
+enum Cond : uint8_t { CondB = 0x2, CondE = 0x4, CondNE = 0x5, CondA = 0x7 };
+
+/*
+    Register use: rdi = CPU*, rsi = segment data, rdx = code page row,
+    r9 = JitLimits* (moved out of rcx); eax, ecx, r8d and r10d are scratch.
+    Every memory operand uses a 32-bit displacement so each instruction
+    has a single encoding.
+*/
+struct Emitter {
+    std::vector<uint8_t> code;
+
+    size_t here() const { return code.size(); }
+    void b(uint8_t v) { code.push_back(v); }
+    void d16(uint16_t v) { b(v & 0xff); b(v >> 8); }
+    void d32(uint32_t v) { for(int i=0; i<4; i++) b(v >> (8 * i)); }
+
+    // movzx r32, byte [rdi+off]; r is eax (0) or ecx (1)
+    void loadCpu(uint8_t r, int32_t off) { b(0x0f); b(0xb6); b(0x87 | r << 3); d32(off); }
+    // mov byte [rdi+off], al
+    void storeCpu(int32_t off) { b(0x88); b(0x87); d32(off); }
+    // movzx eax, byte [rsi+adr]
+    void loadMem(uint16_t adr) { b(0x0f); b(0xb6); b(0x86); d32(adr); }
+    // mov byte [rsi+adr], al
+    void storeMem(uint16_t adr) { b(0x88); b(0x86); d32(adr); }
+    // r8d = operand byte
+    void operandImm(uint8_t v) { b(0x41); b(0xb8); d32(v); }
+    void operandMem(uint16_t adr) { b(0x44); b(0x0f); b(0xb6); b(0x86); d32(adr); }
+    // op eax, r8d for add (01), sub (29), and (21), or (09), xor (31)
+    void aluOperand(uint8_t op) { b(0x44); b(op); b(0xc0); }
+    void movEaxOperand() { b(0x44); b(0x89); b(0xc0); }
+    void movEaxEcx() { b(0x89); b(0xc8); }
+    void addEax(int32_t v) { b(0x05); d32(v); }
+    void andEax(uint32_t v) { b(0x25); d32(v); }
+    void andCpu(int32_t off, uint8_t v) { b(0x80); b(0xa7); d32(off); b(v); }
+    void orCpu(int32_t off, uint8_t v) { b(0x80); b(0x8f); d32(off); b(v); }
+    void testCpu(int32_t off, uint8_t v) { b(0xf6); b(0x87); d32(off); b(v); }
+    void addCpu64(int32_t off, uint32_t v) { b(0x48); b(0x81); b(0x87); d32(off); d32(v); }
+    void movCpu8(int32_t off, uint8_t v) { b(0xc6); b(0x87); d32(off); b(v); }
+    void movCpu16(int32_t off, uint16_t v) { b(0x66); b(0xc7); b(0x87); d32(off); d16(v); }
+    void movCpu32(int32_t off, uint32_t v) { b(0xc7); b(0x87); d32(off); d32(v); }
+    // cmp byte [rdx+page], 0
+    void testCodePage(uint8_t page) { b(0x80); b(0xba); d32(page); b(0); }
+    // mov rax, [rdi+dsDirty]; mov byte [rax+page], 1
+    void markDirty(uint8_t page) { b(0x48); b(0x8b); b(0x87); d32(offDsDirty); b(0xc6); b(0x80); d32(page); b(1); }
+    void ret(int v) { b(0xb8); d32(v); b(0xc3); }
+
+    size_t jcc(uint8_t cc) { b(0x0f); b(0x80 | cc); d32(0); return here() - 4; }
+    size_t jmp() { b(0xe9); d32(0); return here() - 4; }
+    void patch(size_t at, size_t target) {
+        int32_t rel = int32_t(target) - int32_t(at + 4);
+        memcpy(&code[at], &rel, 4);
+    }
+
+    // CPU::set_flags(flags, 8, eax, ecx, r8d), with r8d complemented when subtract is set
+    void setFlags(uint8_t flags, bool subtract = false) {
+        uint8_t bits = 0;
+        if(flags & CF_Mask) bits |= bitCF;
+        if(flags & ZF_Mask) bits |= bitZF;
+        if(flags & OF_Mask) bits |= bitOF;
+        if(flags & NF_Mask) bits |= bitNF;
+        andCpu(offP, ~bits);
+        if(flags & OF_Mask) {
+            b(0x41); b(0x89); b(0xca);    // mov r10d, ecx
+            b(0x41); b(0x31); b(0xc2);    // xor r10d, eax
+            b(0x41); b(0x31); b(0xc8);    // xor r8d, ecx
+            if(!subtract) {
+                b(0x41); b(0xf7); b(0xd0); // not r8d
+            }
+            b(0x45); b(0x21); b(0xc2);    // and r10d, r8d
+            b(0x41); b(0xf7); b(0xc2); d32(0x80); // test r10d, 0x80
+            b(0x41); b(0x0f); b(0x95); b(0xc2); // setne r10b
+            b(0x41); b(0xc0); b(0xe2); b(5);    // shl r10b, 5
+            b(0x44); b(0x08); b(0x97); d32(offP); // or [P], r10b
+        }
+        if(flags & CF_Mask) {
+            b(0x39); b(0xc8);             // cmp eax, ecx
+            b(0x0f); b(0x92); b(0xc1);    // setb cl
+            b(0x08); b(0x8f); d32(offP);  // or [P], cl
+        }
+        if(flags & ZF_Mask) {
+            b(0x85); b(0xc0);             // test eax, eax
+            b(0x0f); b(0x94); b(0xc1);    // sete cl
+            b(0xc0); b(0xe1); b(1);       // shl cl, 1
+            b(0x08); b(0x8f); d32(offP);
+        }
+        if(flags & NF_Mask) {
+            b(0xa9); d32(0x80);           // test eax, 0x80
+            b(0x0f); b(0x95); b(0xc1);    // setne cl
+            b(0xc0); b(0xe1); b(6);       // shl cl, 6
+            b(0x08); b(0x8f); d32(offP);
+        }
+    }
+};
+
+// a translated instruction, as the interpreter would have left op* after it
+struct Step {
+    uint16_t pc;
+    uint8_t opcode;
+    uint8_t cycles;
+};
+
+static void emitLastOp(Emitter& e, const Step& last) {
+    e.loadCpu(0, offPS);
+    e.storeCpu(offOpSeg);
+    e.movCpu16(offOpPC, last.pc);
+    e.movCpu16(offOP, last.opcode);
+    e.movCpu32(offOpCC, last.cycles);
+}
+
+// leaves the block at pc after `count` more instructions and `cycles` more cycles
+static void emitExit(Emitter& e, uint16_t pc, uint32_t cycles, uint32_t count, const Step& last, int result) {
+    if(cycles) e.addCpu64(offCycles, cycles);
+    if(count) e.addCpu64(offInstructions, count);
+    e.movCpu16(offPC, pc);
+    emitLastOp(e, last);
+    e.ret(result);
+}
+
+enum Reg : uint8_t { RegA, RegX, RegY };
+
+static int32_t regOffset(Reg r) {
+    switch(r) {
+        case RegA: return offA;
+        case RegX: return offX;
+        default: return offY;
+    }
+}
+
+enum Alu : uint8_t { AluADC, AluSBC, AluAND, AluORA, AluEOR, AluCMP, AluCPX, AluCPY, AluLDA, AluLDX, AluLDY };
+
+// the alu::* policies, with the operand in r8d
+static void emitAlu(Emitter& e, Alu op) {
+    switch(op) {
+        case AluADC:
+        case AluSBC:
+            e.loadCpu(1, offA);
+            e.loadCpu(0, offP);
+            e.andEax(bitCF);
+            if(op == AluADC) {
+                e.b(0x01); e.b(0xc8);         // add eax, ecx
+                e.aluOperand(0x01);
+            } else {
+                // a - v - ~CF == a - v + CF + 1
+                e.addEax(1);
+                e.b(0x01); e.b(0xc8);
+                e.aluOperand(0x29);
+            }
+            e.storeCpu(offA);
+            e.setFlags(NF_Mask | ZF_Mask | CF_Mask | OF_Mask, op == AluSBC);
+            break;
+        case AluAND:
+        case AluORA:
+        case AluEOR:
+            e.loadCpu(0, offA);
+            e.aluOperand(op == AluAND ? 0x21 : op == AluORA ? 0x09 : 0x31);
+            e.storeCpu(offA);
+            e.setFlags(NF_Mask | ZF_Mask);
+            break;
+        case AluCMP:
+        case AluCPX:
+        case AluCPY:
+            e.loadCpu(1, regOffset(op == AluCMP ? RegA : op == AluCPX ? RegX : RegY));
+            e.movEaxEcx();
+            e.aluOperand(0x29);
+            e.setFlags(NF_Mask | ZF_Mask | CF_Mask);
+            break;
+        default:
+            e.movEaxOperand();
+            e.storeCpu(regOffset(op == AluLDA ? RegA : op == AluLDX ? RegX : RegY));
+            e.setFlags(NF_Mask | ZF_Mask);
+            break;
+    }
+}
+
+enum Mode : uint8_t { Imm, Zp, Abs };
+
+struct ReadOp { uint8_t opcode; Mode mode; Alu alu; };
+
+static constexpr ReadOp readOps[] = {
+    { ADC_Immediate, Imm, AluADC }, { ADC_ZeroPage, Zp, AluADC }, { ADC_Absolute, Abs, AluADC },
+    { SBC_Immediate, Imm, AluSBC }, { SBC_ZeroPage, Zp, AluSBC }, { SBC_Absolute, Abs, AluSBC },
+    { AND_Immediate, Imm, AluAND }, { AND_ZeroPage, Zp, AluAND }, { AND_Absolute, Abs, AluAND },
+    { ORA_Immediate, Imm, AluORA }, { ORA_ZeroPage, Zp, AluORA }, { ORA_Absolute, Abs, AluORA },
+    { EOR_Immediate, Imm, AluEOR }, { EOR_ZeroPage, Zp, AluEOR }, { EOR_Absolute, Abs, AluEOR },
+    { CMP_Immediate, Imm, AluCMP }, { CMP_ZeroPage, Zp, AluCMP }, { CMP_Absolute, Abs, AluCMP },
+    { CPX_Immediate, Imm, AluCPX }, { CPX_ZeroPage, Zp, AluCPX }, { CPX_Absolute, Abs, AluCPX },
+    { CPY_Immediate, Imm, AluCPY }, { CPY_ZeroPage, Zp, AluCPY }, { CPY_Absolute, Abs, AluCPY },
+    { LDA_Immediate, Imm, AluLDA }, { LDA_ZeroPage, Zp, AluLDA }, { LDA_Absolute, Abs, AluLDA },
+    { LDX_Immediate, Imm, AluLDX }, { LDX_ZeroPage, Zp, AluLDX }, { LDX_Absolute, Abs, AluLDX },
+    { LDY_Immediate, Imm, AluLDY }, { LDY_ZeroPage, Zp, AluLDY }, { LDY_Absolute, Abs, AluLDY },
+};
+
+struct BranchOp { uint8_t opcode; uint8_t bit; bool whenSet; };
+
+// matches the handlers, including BCC/BCS testing CF the other way round
+static constexpr BranchOp branchOps[] = {
+    { BCC, bitCF, true }, { BCS, bitCF, false },
+    { BEQ, bitZF, true }, { BNE, bitZF, false },
+    { BMI, bitNF, true }, { BPL, bitNF, false },
+    { BVS, bitOF, true }, { BVC, bitOF, false },
+};
+
+static const BranchOp* findBranch(uint8_t opcode) {
+    for(auto& op : branchOps) if(op.opcode == opcode) return &op;
+    return nullptr;
+}
+
+struct Translation {
+    Emitter e;
+    std::vector<Step> steps;
+    std::vector<std::pair<size_t, size_t>> bails; // jump to patch, step it bails before
+};
+
+// emits one straight-line instruction and returns its cycles, 0 if it is not covered
+static unsigned emitOp(Translation& t, uint8_t opcode, uint8_t a8, uint16_t a16) {
+    auto& e = t.e;
+    for(auto& op : readOps) {
+        if(op.opcode != opcode) continue;
+        switch(op.mode) {
+            case Imm: e.operandImm(a8); break;
+            case Zp: e.operandMem(a8); break;
+            case Abs: e.operandMem(a16); break;
+        }
+        emitAlu(e, op.alu);
+        return op.mode == Imm ? 2 : op.mode == Zp ? 3 : 4;
+    }
+    // stores and read-modify-writes hand pages holding code back to the interpreter
+    auto checked = [&](uint16_t adr) {
+        e.testCodePage(adr >> 8);
+        t.bails.push_back({e.jcc(CondNE), t.steps.size()});
+        e.markDirty(adr >> 8);
+    };
+    auto store = [&](Reg r, uint16_t adr) {
+        checked(adr);
+        e.loadCpu(0, regOffset(r));
+        e.storeMem(adr);
+    };
+    auto step = [&](uint16_t adr, int32_t delta) {
+        checked(adr);
+        e.loadMem(adr);
+        e.addEax(delta);
+        e.storeMem(adr);
+        e.setFlags(NF_Mask | ZF_Mask);
+    };
+    auto stepReg = [&](Reg r, int32_t delta) {
+        e.loadCpu(0, regOffset(r));
+        e.addEax(delta);
+        e.storeCpu(regOffset(r));
+        e.setFlags(NF_Mask | ZF_Mask);
+    };
+    auto transfer = [&](Reg from, Reg to) {
+        e.loadCpu(0, regOffset(from));
+        e.storeCpu(regOffset(to));
+    };
+    switch(opcode) {
+        case STA_ZeroPage: store(RegA, a8); return 3;
+        case STX_ZeroPage: store(RegX, a8); return 3;
+        case STY_ZeroPage: store(RegY, a8); return 3;
+        case STA_Absolute: store(RegA, a16); return 4;
+        case STX_Absolute: store(RegX, a16); return 4;
+        case STY_Absolute: store(RegY, a16); return 4;
+        case INC_ZeroPage: step(a8, 1); return 5;
+        case DEC_ZeroPage: step(a8, -1); return 5;
+        case INC_Absolute: step(a16, 1); return 6;
+        case DEC_Absolute: step(a16, -1); return 6;
+        case INX: stepReg(RegX, 1); return 2;
+        case INY: stepReg(RegY, 1); return 2;
+        case DEX: stepReg(RegX, -1); return 2;
+        case DEY: stepReg(RegY, -1); return 2;
+        case TAX: transfer(RegA, RegX); return 2;
+        case TAY: transfer(RegA, RegY); return 2;
+        case TXA: transfer(RegX, RegA); return 2;
+        case TYA: transfer(RegY, RegA); return 2;
+        case CLC: e.andCpu(offP, ~bitCF); return 2;
+        case SEC: e.orCpu(offP, bitCF); return 2;
+        case NOP: return 2;
+        default: return 0;
+    }
+}
+
+bool Jit::available() {
+    ProcessorStatus p{}; // zero-initialized, padding bits included
+    p.CF = 1;
+    p.ZF = 1;
+    p.NF = 1;
+    uint8_t byte;
+    memcpy(&byte, &p, 1);
+    if(byte != (bitCF | bitZF | bitNF)) return false;
+    p.CF = p.ZF = p.NF = 0;
+    p.OF = 1;
+    memcpy(&byte, &p, 1);
+    return byte == bitOF;
+}
+
+Jit::Jit() {
+    void* mem = mmap(nullptr, ARENA_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if(mem != MAP_FAILED) arena = (uint8_t*)mem;
+}
+
+Jit::~Jit() {
+    if(arena) munmap(arena, ARENA_SIZE);
+}
+
+void Jit::reset() {
+    used = 0;
+    full = false;
+}
+
+bool Jit::translate(Memory& ram, Block& block) {
+    if(!arena || !available()) return false;
+    uint8_t seg = block.key >> 16;
+    uint16_t start = block.key & 0xffff;
+
+    Translation t;
+    auto& e = t.e;
+    e.b(0x49); e.b(0x89); e.b(0xc9); // mov r9, rcx
+    size_t loop = e.here();
+    uint16_t pc = start;
+    uint32_t cycles = 0;
+    const BranchOp* branch = nullptr;
+    for(auto& op : block.ops) {
+        uint8_t a8 = ram.peek(seg, pc + 1);
+        uint16_t a16 = a8 | ram.peek(seg, pc + 2) << 8;
+        if((branch = findBranch(op.opcode))) break;
+        auto n = emitOp(t, op.opcode, a8, a16);
+        if(n == 0) break;
+        t.steps.push_back({pc, op.opcode, uint8_t(n)});
+        cycles += n;
+        pc += op.length;
+    }
+    if(t.steps.empty()) return false;
+    uint32_t count = t.steps.size();
+    auto& last = t.steps.back();
+
+    if(branch) {
+        Step br = {pc, branch->opcode, 2};
+        uint16_t next = pc + 2;
+        uint16_t target = next + (int8_t)ram.peek(seg, pc + 1);
+        Step taken = {pc, branch->opcode, uint8_t((target & 0xff00) != (next & 0xff00) ? 3 : 2)};
+        e.testCpu(offP, branch->bit);
+        auto notTaken = e.jcc(branch->whenSet ? CondE : CondNE);
+        if(target == start) {
+            // commit the pass, then go round again if another full pass fits the limits
+            uint32_t pass = cycles + taken.cycles;
+            e.addCpu64(offCycles, pass);
+            e.addCpu64(offInstructions, count + 1);
+            emitLastOp(e, taken);
+            e.b(0x48); e.b(0x8b); e.b(0x87); e.d32(offCycles);       // mov rax, [cycles]
+            e.b(0x48); e.b(0x05); e.d32(pass);                      // add rax, pass
+            e.b(0x49); e.b(0x3b); e.b(0x01);                        // cmp rax, [r9]
+            auto out1 = e.jcc(CondA);
+            e.b(0x48); e.b(0x8b); e.b(0x87); e.d32(offInstructions);
+            e.b(0x48); e.b(0x05); e.d32(count + 1);
+            e.b(0x49); e.b(0x3b); e.b(0x41); e.b(0x08);             // cmp rax, [r9+8]
+            auto out2 = e.jcc(CondA);
+            e.patch(e.jmp(), loop);
+            e.patch(out1, e.here());
+            e.patch(out2, e.here());
+            e.ret(0); // PC still holds start
+        } else {
+            emitExit(e, target, cycles + taken.cycles, count + 1, taken, 0);
+        }
+        e.patch(notTaken, e.here());
+        emitExit(e, next, cycles + br.cycles, count + 1, br, 0);
+        block.nativeCycles = cycles + taken.cycles;
+        block.nativeOps = count + 1;
+    } else {
+        emitExit(e, pc, cycles, count, last, 0);
+        block.nativeCycles = cycles;
+        block.nativeOps = count;
+    }
+
+    // bailing out before step i: the earlier steps of this pass have run
+    for(auto& bail : t.bails) {
+        e.patch(bail.first, e.here());
+        auto i = bail.second;
+        if(i == 0) {
+            e.ret(1);
+            continue;
+        }
+        uint32_t partial = 0;
+        for(size_t j=0; j<i; j++) partial += t.steps[j].cycles;
+        emitExit(e, t.steps[i].pc, partial, i, t.steps[i - 1], 1);
+    }
+
+    size_t size = (e.code.size() + 15) & ~size_t(15);
+    if(used + size > ARENA_SIZE) {
+        full = true;
+        return false;
+    }
+    mprotect(arena, ARENA_SIZE, PROT_READ | PROT_WRITE);
+    memcpy(arena + used, e.code.data(), e.code.size());
+    mprotect(arena, ARENA_SIZE, PROT_READ | PROT_EXEC);
+    block.native = (JitBlockFn)(arena + used);
+    used += size;
+    return true;
+}
+
+#else
+
+bool Jit::available() { return false; }
+Jit::Jit() {}
+Jit::~Jit() {}
+void Jit::reset() { used = 0; full = false; }
+bool Jit::translate(Memory& ram, Block& block) { return false; }
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef __JIT65X_H
+#define __JIT65X_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+struct CPU;
+struct Memory;
+struct Block;
+
+// counter values a translated block may run up to before handing back control
+struct JitLimits {
+    uint64_t cycles;
+    uint64_t instructions;
+};
+
+// data is ram.segments[DS].memory and codePage the DS row of BlockCache::codePage;
+// returns 1 when the instruction at the new PC has to be interpreted
+typedef int (*JitBlockFn)(CPU* cpu, uint8_t* data, const uint8_t* codePage, const JitLimits* limits);
+
+/*
+    x86-64 translator for hot blocks. It covers the implied, immediate,
+    zero page and absolute forms of the common loads, stores, ALU ops,
+    INC/DEC and register transfers, working directly on reg32, P and the
+    DS segment. Translation stops at the first instruction it cannot handle,
+    and a conditional branch may close the block. A branch back to the
+    block's start loops natively while the run's limits allow another pass.
+    Stores into pages holding decoded code bail out to the interpreter so
+    that the block cache sees the write; the others mark their page in
+    the dirty map. cycles, instructions, PC and the op* fields match the
+    interpreter at every exit.
+
+    On other hosts available() is false and nothing is translated.
+*/
+struct Jit {
+    static constexpr size_t ARENA_SIZE = 4 * 1024 * 1024;
+    static constexpr unsigned HOT_BLOCK = 16; // runs before a block is translated
+
+    uint8_t* arena = nullptr;
+    size_t used = 0;
+    bool full = false; // the last translation did not fit in the arena
+
+    Jit();
+    ~Jit();
+
+    static bool available();
+    bool translate(Memory& ram, Block& block);
+    void reset();
+};
+
+#endif
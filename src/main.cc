@@ -1,33 +1,225 @@
 #include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
 
 #include "cpu65x.h"
+#include "tracefile.h"
 #include "xutils.h"
 
+/*
+    Runs raw images headless and reports how the run ended as JSON.
+
+        vm [options] image[@addr] ...
+
+        image[@addr]     load a raw image at addr, SS:AAAA or AAAA in hex
+                         (default 00:0300); later images load over earlier ones
+        -r image[@addr]  load an image as ROM
+        -v vec=AAAA      point vector reset, nmi or irq at 00:AAAA; with no -v
+                         and nothing loaded over 00:FFFA-FFFF, all three point
+                         at the first image
+        -m model         6502, 65c02 or 65x02 (default)
+        -e engine        interpreted (default), threaded, cached or translated
+        -c cycles        stop after this many cycles
+        -n count         stop after this many instructions
+        -t               trace every step as text on stderr
+        -T file          record a trace file for trace65
+        -d               dump zero page, the stack and the registers to stderr
+        -o file          write the JSON there instead of stdout
+
+    The run stops at BRK, a halt, a reset or the end of its budget.
+*/
+
+struct Image {
+    std::string path;
+    uint8_t seg = 0x00;
+    uint16_t adr = 0x0300;
+    bool rom = false;
+};
+
+static int usage() {
+    std::cerr << "usage: vm [-m model] [-e engine] [-c cycles | -n count] [-v vec=AAAA]...\n"
+                 "          [-t] [-T file] [-d] [-o file] [-r image[@addr]]... image[@addr]...\n";
+    return EXIT_FAILURE;
+}
+
+// SS:AAAA or AAAA, in hex
+static bool parse_address(const char* text, uint8_t& seg, uint16_t& adr) {
+    char* end;
+    auto value = strtoul(text, &end, 16);
+    seg = 0;
+    if(*end == ':' && end != text && value <= 0xff) {
+        seg = value;
+        text = end + 1;
+        value = strtoul(text, &end, 16);
+    }
+    adr = value;
+    return end != text && *end == 0 && value <= 0xffff;
+}
+
+static bool parse_image(const char* arg, bool rom, Image& image) {
+    image.rom = rom;
+    const char* at = strrchr(arg, '@');
+    if(at == nullptr) {
+        image.path = arg;
+        return true;
+    }
+    image.path.assign(arg, at - arg);
+    return !image.path.empty() && parse_address(at + 1, image.seg, image.adr);
+}
+
+static const char* stop_name(StopCause cause) {
+    switch(cause) {
+        case StopBudget: return "budget";
+        case StopBRK: return "brk";
+        case StopHalt: return "halt";
+        case StopReset: return "reset";
+        case StopIllegal: return "illegal";
+    }
+    return "unknown";
+}
+
+static void write_json(std::ostream& ostr, CPU& cpu, const StopReason& stop, double seconds) {
+    TextSink out(ostr);
+    out.put("{\n  \"stop\": \"").put(stop_name(stop.cause))
+        .put("\",\n  \"at\": \"").address(stop.seg, stop.pc)
+        .put("\",\n  \"reason\": \"").put(stop.describe().c_str())
+        .put("\",\n  \"cycles\": ").dec(stop.cycles)
+        .put(",\n  \"instructions\": ").dec(stop.instructions)
+        .printf(",\n  \"seconds\": %.6f", seconds)
+        .printf(",\n  \"mips\": %.2f", seconds > 0 ? stop.instructions / seconds / 1e6 : 0.0)
+        .put(",\n  \"registers\": {\"pc\": ").dec(cpu.PC)
+        .put(", \"sp\": ").dec(cpu.SP)
+        .put(", \"a\": ").dec(cpu.A())
+        .put(", \"x\": ").dec(cpu.X())
+        .put(", \"y\": ").dec(cpu.Y())
+        .put(", \"p\": ").dec(cpu.P.asByte())
+        .put(", \"ps\": ").dec(cpu.PS)
+        .put(", \"ds\": ").dec(cpu.DS)
+        .put(", \"ss\": ").dec(cpu.SS)
+        .put(", \"reg32\": [");
+    for(int i=0; i<8; i++) {
+        if(i) out.put(", ");
+        out.dec(cpu.reg32[i]);
+    }
+    out.put("]}\n}\n");
+}
+
 int main(int argc, const char** argv) {
     struct CPU cpu;
     struct Memory ram;
+    std::vector<Image> images;
+    std::vector<std::pair<uint16_t, uint16_t>> vectors; // where, what
+    uint64_t cycles = 0, count = 0;
+    const char* tracePath = nullptr;
+    const char* jsonPath = nullptr;
+    bool dump = false;
+
+    for(int i=1; i<argc; i++) {
+        auto arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if(!strcmp(arg, "-t")) {
+            cpu.tracing = true;
+        } else if(!strcmp(arg, "-d")) {
+            dump = true;
+        } else if(!strcmp(arg, "-T") && hasValue) {
+            tracePath = argv[++i];
+        } else if(!strcmp(arg, "-o") && hasValue) {
+            jsonPath = argv[++i];
+        } else if(!strcmp(arg, "-c") && hasValue) {
+            cycles = strtoull(argv[++i], nullptr, 0);
+        } else if(!strcmp(arg, "-n") && hasValue) {
+            count = strtoull(argv[++i], nullptr, 0);
+        } else if(!strcmp(arg, "-m") && hasValue) {
+            std::string model = argv[++i];
+            if(model == "6502") cpu.allow65c02 = cpu.allow65x02 = false;
+            else if(model == "65c02") cpu.allow65x02 = false;
+            else if(model != "65x02") return usage();
+        } else if(!strcmp(arg, "-e") && hasValue) {
+            std::string engine = argv[++i];
+            if(engine == "interpreted") cpu.engine = Interpreted;
+            else if(engine == "threaded") cpu.engine = Threaded;
+            else if(engine == "cached") cpu.engine = Cached;
+            else if(engine == "translated") cpu.engine = Translated;
+            else return usage();
+        } else if(!strcmp(arg, "-v") && hasValue) {
+            std::string vec = argv[++i];
+            auto eq = vec.find('=');
+            uint8_t seg;
+            uint16_t adr;
+            if(eq == std::string::npos || !parse_address(vec.c_str() + eq + 1, seg, adr) || seg) return usage();
+            vec.resize(eq);
+            if(vec == "reset") vectors.push_back({0xfffc, adr});
+            else if(vec == "nmi") vectors.push_back({CPU::NMI_VECTOR, adr});
+            else if(vec == "irq") vectors.push_back({CPU::IRQ_VECTOR, adr});
+            else return usage();
+        } else if(!strcmp(arg, "-r") && hasValue) {
+            Image image;
+            if(!parse_image(argv[++i], true, image)) return usage();
+            images.push_back(image);
+        } else if(arg[0] != '-') {
+            Image image;
+            if(!parse_image(arg, false, image)) return usage();
+            images.push_back(image);
+        } else {
+            return usage();
+        }
+    }
+    if(images.empty() || (cycles && count)) return usage();
+
+    TraceWriter writer;
+    StopReason stop;
+    double seconds;
+    std::streambuf* stdoutBuf = nullptr;
+    try {
+        ram.init();
+        bool coversVectors = false;
+        for(auto& image : images) {
+            auto size = ram.load_image(image.path.c_str(), image.seg, image.adr, image.rom);
+            coversVectors |= image.seg == 0 && image.adr + size > CPU::NMI_VECTOR;
+        }
+        if(vectors.empty() && !coversVectors) {
+            for(uint16_t vec : {CPU::NMI_VECTOR, uint16_t(0xfffc), CPU::IRQ_VECTOR}) {
+                vectors.push_back({vec, images[0].adr});
+            }
+        }
+        for(auto& vec : vectors) ram.program(0x00, vec.first, {uint8_t(vec.second), uint8_t(vec.second >> 8)});
+        if(tracePath) {
+            writer.start(tracePath);
+            cpu.traceRing = &writer.ring;
+        }
+
+        // the cpu traces to std::cout; stdout is kept for the JSON
+        if(cpu.tracing) stdoutBuf = std::cout.rdbuf(std::cerr.rdbuf());
+        cpu.haltOnBRK = true;
+        auto t0 = std::chrono::steady_clock::now();
+        stop = count ? cpu.run_for_instructions(ram, count) : cpu.run_for_cycles(ram, cycles ? cycles : UINT64_MAX);
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        if(stdoutBuf) std::cout.rdbuf(stdoutBuf);
+        writer.stop();
+    } catch(const std::exception& e) {
+        if(stdoutBuf) std::cout.rdbuf(stdoutBuf);
+        std::cerr << "vm: " << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
 
-    ram.init();
-    // set NMI=0x0300, RESET=0x0300, INT=0x0300
-    ram.program(0x00, 0xfffa, {0x00, 0x03, 0x00, 0x03, 0x00, 0x03});
-    //ram.program(0x00, 0x0300, {0xa9, 0x01, 0xa2, 0x02, 0xa0, 0x03});
-    //ram.program(0x00, 0x0300, {0xa9, 0x80, 0x85, 0x21, 0xa9, 0x85, 0xa2, 0x01, 0x79, 0x20, 0x00, 0x29, 0x01, 0xc6, 0x00, 0x45, 0x00 });
-    //ram.program(0x00, 0x0300, {0xa9, 0x80, 0x85, 0x01, 0x9c, 0x01, 0x00, 0xf2, 0x12, 0xf4, 0x38, 0xf4, 0x40});
-    ram.program(0x00, 0x0300, {
-        0xf4, 0x40, // xor.l %x0,%x0 (clr x0)
-        0xd4, 0x80, 0xef, 0xbe, 0xad, 0xde, // add.l %x0, #$dead_beef
-        0xf4, 0x08, // tr.l %x1, %x0
-        0x00, // brk
-    });
-    cpu.tracing = true;
-    cpu.allow65c02 = true;
-    cpu.allow65x02 = true;
-
-    cpu.reset(ram);
-    cpu.execute_until_break(ram);
-    ram.dump_memory(std::cout, 0, 0, 16, 8);
-    ram.dump_memory(std::cout, cpu.SS, cpu.SP+1, 1, (0x1ff - cpu.SP) );
-    x_dump_regs_info(std::cout, ram, cpu);
-    std::cout << std::endl;
+    if(dump) {
+        ram.dump_memory(std::cerr, 0, 0, 16, 8);
+        ram.dump_memory(std::cerr, cpu.SS, cpu.SP+1, 1, (0x1ff - cpu.SP) );
+        x_dump_regs_info(std::cerr, ram, cpu);
+        std::cerr << std::endl;
+    }
+    if(jsonPath) {
+        std::ofstream json(jsonPath);
+        if(!json) {
+            std::cerr << format("vm: cannot create %s: %s\n", jsonPath, strerror(errno));
+            return EXIT_FAILURE;
+        }
+        write_json(json, cpu, stop, seconds);
+    } else {
+        write_json(std::cout, cpu, stop, seconds);
+    }
     return EXIT_SUCCESS;
 }
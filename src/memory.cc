@@ -1,31 +1,393 @@
 #include "memory.h"
 #include "utils.h"
 
-uint8_t Memory::read(uint8_t seg, uint16_t adr) {
+#include <algorithm>
+#include <cerrno>
+#include <new>
+#include <stdexcept>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// replaces [p, p+len) with fresh anonymous pages, whatever was mapped there
+static void remap(void* p, size_t len) {
+    if(mmap(p, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON | MAP_FIXED, -1, 0) != MAP_FAILED) return;
+    memset(p, 0, len);
+}
+
+// returns the anonymous pages of [p, p+len) to the host; they read as zero when next touched
+static void discard(void* p, size_t len) {
+#if defined(__linux__)
+    if(madvise(p, len, MADV_DONTNEED) == 0) return;
+#endif
+    // MADV_DONTNEED may keep the contents elsewhere; a fresh fixed mapping does not
+    remap(p, len);
+}
+
+void MemorySegment::init() {
+    // remapped rather than discarded: a file mapped here would read back its contents
+    remap(memory, SEGMENT_SIZE);
+}
+
+void Memory::init() {
+    if(!segments) {
+        // fresh anonymous pages read as zero
+        void* mem = mmap(nullptr, MEMORY_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON | MAP_NORESERVE, -1, 0);
+        if(mem == MAP_FAILED) throw std::bad_alloc();
+        segments = (MemorySegment*)mem;
+    } else if(images.empty()) {
+        discard(segments, MEMORY_SIZE);
+    } else {
+        remap(segments, MEMORY_SIZE);
+        images.clear();
+    }
+    memset(pageType, PageRAM, sizeof(pageType));
+    memset(pageDevice, 0, sizeof(pageDevice));
+    memset(mappedPages, 0, sizeof(mappedPages));
+    memset(dirtyPage, 0, sizeof(dirtyPage));
+    devices.resize(1);
+    if(blocks) blocks->clear();
+}
+
+static void map_pages(Memory& ram, uint8_t seg, uint16_t adr, size_t len, PageType type, uint8_t device) {
+    if(len == 0) return;
+    uint32_t first = Memory::page(seg, adr);
+    uint32_t last = Memory::page(seg, 0) + ((adr + len - 1) >> 8);
+    if(last > Memory::page(seg, 0xffff)) last = Memory::page(seg, 0xffff);
+    for(auto page = first; page <= last; page++) {
+        if(ram.pageType[page] == PageRAM && type != PageRAM) ram.mappedPages[seg]++;
+        if(ram.pageType[page] != PageRAM && type == PageRAM) ram.mappedPages[seg]--;
+        ram.pageType[page] = type;
+        ram.pageDevice[page] = device;
+    }
+    // translated and fused code assumes the map it was built under
+    if(ram.blocks) ram.blocks->clear();
+}
+
+void Memory::map_ram(uint8_t seg, uint16_t adr, size_t len) {
+    map_pages(*this, seg, adr, len, PageRAM, 0);
+}
+
+void Memory::map_rom(uint8_t seg, uint16_t adr, size_t len) {
+    map_pages(*this, seg, adr, len, PageROM, 0);
+}
+
+void Memory::map_device(uint8_t seg, uint16_t adr, size_t len, MemoryDevice* device) {
+    uint8_t index = 0;
+    for(size_t i=1; i<devices.size(); i++) {
+        if(devices[i] == device) index = i;
+    }
+    if(!index) {
+        if(devices.size() > UINT8_MAX) throw std::length_error("too many memory devices");
+        index = devices.size();
+        devices.push_back(device);
+    }
+    map_pages(*this, seg, adr, len, PageDevice, index);
+}
+
+uint8_t Memory::read_mapped(uint8_t seg, uint16_t adr) {
+    auto p = page(seg, adr);
+    if(pageType[p] == PageDevice) return devices[pageDevice[p]]->read(seg, adr);
     return segments[seg].memory[adr];
 }
 
-void Memory::write(uint8_t seg, uint16_t adr, uint8_t byte) {
-    segments[seg].memory[adr] = byte;
+void Memory::write_mapped(uint8_t seg, uint16_t adr, uint8_t byte) {
+    auto p = page(seg, adr);
+    switch(pageType[p]) {
+        case PageDevice: devices[pageDevice[p]]->write(seg, adr, byte); break;
+        case PageROM: break;
+        default: write(seg, adr, byte); break;
+    }
+}
+
+Memory::~Memory() {
+    if(segments != nullptr) munmap(segments, MEMORY_SIZE);
+    if(blocks != nullptr) delete blocks;
+}
+
+// marks the pages of [adr, adr+len) in seg, wrapping like the segment does
+static void mark_dirty(Memory& ram, uint8_t seg, uint16_t adr, size_t len) {
+    if(len == 0) return;
+    if(len > MemorySegment::SEGMENT_SIZE) len = MemorySegment::SEGMENT_SIZE;
+    unsigned first = adr >> 8;
+    unsigned last = first + ((adr & 0xff) + len - 1) / Memory::PAGE_SIZE;
+    for(unsigned p=first; p<=last; p++) {
+        ram.dirtyPage[(seg << 8) | (p & 0xff)] = 1;
+    }
+}
+
+// whether the byte at offset into the reservation belongs to a read-only image
+static bool read_only(const Memory& ram, size_t offset) {
+    for(auto& image : ram.images) {
+        if(image.readOnly && offset >= image.offset && offset < image.offset + image.length) return true;
+    }
+    return false;
+}
+
+/*
+    Calls run(a, offset, n) for consecutive runs covering [adr, adr+len) of
+    seg, where a is where the run starts in the segment and offset how far
+    it is into the range. A run never crosses the end of the segment, and
+    while the map is honored and the segment has mapped pages, never a
+    page either, so the run has a single PageType.
+*/
+template<class Run>
+static void for_each_run(const Memory& ram, uint8_t seg, uint16_t adr, size_t len, uint8_t flags, Run run) {
+    bool byPage = (flags & BulkMapped) && ram.mappedPages[seg];
+    size_t offset = 0;
+    while(offset < len) {
+        uint16_t a = adr + offset;
+        size_t room = byPage ? Memory::PAGE_SIZE - (a & 0xff) : MemorySegment::SEGMENT_SIZE - a;
+        size_t n = std::min(room, len - offset);
+        run(a, offset, n);
+        offset += n;
+    }
+}
+
+// the type a run of for_each_run is handled as
+static inline uint8_t run_type(const Memory& ram, uint8_t seg, uint16_t a, uint8_t flags) {
+    return (flags & BulkMapped) ? ram.pageType[Memory::page(seg, a)] : uint8_t(PageRAM);
+}
+
+/*
+    Throws before a write to [adr, adr+len) of seg stores into a read-only
+    image; its pages are mapped PROT_READ and the store would fault. Runs
+    the map drops or hands to a device are not stored to.
+*/
+static void check_writable(const Memory& ram, uint8_t seg, uint16_t adr, size_t len, uint8_t flags, const char* op) {
+    if(ram.images.empty()) return;
+    size_t base = seg * MemorySegment::SEGMENT_SIZE;
+    for_each_run(ram, seg, adr, len, flags, [&](uint16_t a, size_t, size_t n) {
+        if(run_type(ram, seg, a, flags) != PageRAM) return;
+        for(auto& image : ram.images) {
+            if(!image.readOnly) continue;
+            size_t lo = std::max(base + a, image.offset);
+            size_t hi = std::min(base + a + n, image.offset + image.length);
+            if(lo < hi) {
+                throw std::invalid_argument(format("%s into the read-only image at %02X:%04X", op, seg, uint16_t(lo - base)));
+            }
+        }
+    });
 }
 
 uint16_t Memory::program(uint8_t seg, uint16_t adr, const std::vector<uint8_t>& bytes) {
-    uint16_t a = adr;
-    for(auto byte : bytes) {
-        segments[seg].memory[a++] = byte;
+    check_writable(*this, seg, adr, bytes.size(), BulkDirty, "program()");
+    write_block(seg, adr, bytes.data(), bytes.size(), BulkDirty);
+    return adr + bytes.size();
+}
+
+void Memory::read_block(uint8_t seg, uint16_t adr, uint8_t* out, size_t len, uint8_t flags) {
+    auto mem = segments[seg].memory;
+    for_each_run(*this, seg, adr, len, flags, [&](uint16_t a, size_t offset, size_t n) {
+        if(run_type(*this, seg, a, flags) == PageDevice) {
+            for(size_t i=0; i<n; i++) out[offset + i] = read_mapped(seg, a + i);
+        } else {
+            memcpy(out + offset, mem + a, n);
+        }
+    });
+}
+
+void Memory::write_block(uint8_t seg, uint16_t adr, const uint8_t* bytes, size_t len, uint8_t flags) {
+    check_writable(*this, seg, adr, len, flags, "write_block()");
+    auto mem = segments[seg].memory;
+    for_each_run(*this, seg, adr, len, flags, [&](uint16_t a, size_t offset, size_t n) {
+        switch(run_type(*this, seg, a, flags)) {
+            case PageROM: break;
+            case PageDevice:
+                for(size_t i=0; i<n; i++) write_mapped(seg, a + i, bytes[offset + i]);
+                break;
+            default:
+                memcpy(mem + a, bytes + offset, n);
+                if(flags & BulkDirty) mark_dirty(*this, seg, a, n);
+                break;
+        }
+    });
+    if(blocks) blocks->invalidate_range(seg, adr, len);
+}
+
+void Memory::fill(uint8_t seg, uint16_t adr, uint8_t byte, size_t len, uint8_t flags) {
+    check_writable(*this, seg, adr, len, flags, "fill()");
+    auto mem = segments[seg].memory;
+    for_each_run(*this, seg, adr, len, flags, [&](uint16_t a, size_t, size_t n) {
+        switch(run_type(*this, seg, a, flags)) {
+            case PageROM: break;
+            case PageDevice:
+                for(size_t i=0; i<n; i++) write_mapped(seg, a + i, byte);
+                break;
+            default:
+                memset(mem + a, byte, n);
+                if(flags & BulkDirty) mark_dirty(*this, seg, a, n);
+                break;
+        }
+    });
+    if(blocks) blocks->invalidate_range(seg, adr, len);
+}
+
+int Memory::compare(uint8_t seg, uint16_t adr, const uint8_t* bytes, size_t len, uint8_t flags) {
+    auto mem = segments[seg].memory;
+    int result = 0;
+    for_each_run(*this, seg, adr, len, flags, [&](uint16_t a, size_t offset, size_t n) {
+        if(result != 0) return;
+        if(run_type(*this, seg, a, flags) == PageDevice) {
+            uint8_t buf[PAGE_SIZE];
+            for(size_t i=0; i<n; i++) buf[i] = read_mapped(seg, a + i);
+            result = memcmp(buf, bytes + offset, n);
+        } else {
+            result = memcmp(mem + a, bytes + offset, n);
+        }
+    });
+    return result;
+}
+
+void Memory::copy(uint8_t dseg, uint16_t dadr, uint8_t sseg, uint16_t sadr, size_t len, uint8_t flags) {
+    bool direct = !(flags & BulkMapped) || (!mappedPages[dseg] && !mappedPages[sseg]);
+    if(direct && len <= MemorySegment::SEGMENT_SIZE - std::max(dadr, sadr)) {
+        // neither range wraps: memmove handles the overlap in place
+        check_writable(*this, dseg, dadr, len, flags, "copy()");
+        memmove(segments[dseg].memory + dadr, segments[sseg].memory + sadr, len);
+        if(flags & BulkDirty) mark_dirty(*this, dseg, dadr, len);
+        if(blocks) blocks->invalidate_range(dseg, dadr, len);
+        return;
     }
-    return a;
+    std::vector<uint8_t> bytes(len);
+    read_block(sseg, sadr, bytes.data(), len, flags);
+    write_block(dseg, dadr, bytes.data(), len, flags);
+}
+
+size_t Memory::load_image(const char* path, uint8_t seg, uint16_t adr, bool rom) {
+    if(!segments) init();
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) throw std::runtime_error(format("cannot open %s: %s", path, strerror(errno)));
+    struct stat st;
+    if(fstat(fd, &st) != 0) {
+        close(fd);
+        throw std::runtime_error(format("cannot stat %s: %s", path, strerror(errno)));
+    }
+    size_t size = st.st_size;
+    size_t offset = seg * MemorySegment::SEGMENT_SIZE + adr;
+    if(offset + size > MEMORY_SIZE) {
+        close(fd);
+        throw std::length_error(format("%s does not fit at %02X:%04X", path, seg, adr));
+    }
+    auto base = (uint8_t*)segments + offset;
+    size_t hostPage = sysconf(_SC_PAGESIZE);
+    bool mapped = false;
+    if(size && offset % hostPage == 0) {
+        int prot = rom ? PROT_READ : PROT_READ | PROT_WRITE;
+        mapped = mmap(base, size, prot, MAP_PRIVATE | MAP_FIXED, fd, 0) != MAP_FAILED;
+        if(mapped) images.push_back({offset, (size + hostPage - 1) / hostPage * hostPage, rom});
+    }
+    for(size_t done = 0; !mapped && done < size; ) {
+        auto n = pread(fd, base + done, size - done, done);
+        if(n <= 0) {
+            close(fd);
+            throw std::runtime_error(format("cannot read %s: %s", path, n ? strerror(errno) : "short read"));
+        }
+        done += n;
+    }
+    close(fd);
+
+    // code decoded from the old contents is stale, and a ROM's pages drop writes;
+    // a mapping covers the whole of its last host page. A read-only mapping is
+    // left out of snapshots: restore() could not write it back.
+    size_t end = mapped ? offset + images.back().length : offset + size;
+    for(size_t at = offset; at < end; ) {
+        uint8_t s = at / MemorySegment::SEGMENT_SIZE;
+        uint16_t a = at % MemorySegment::SEGMENT_SIZE;
+        size_t len = std::min(size_t(MemorySegment::SEGMENT_SIZE - a), end - at);
+        if(!(mapped && rom)) mark_dirty(*this, s, a, len);
+        if(blocks) blocks->invalidate_range(s, a, len);
+        if(rom) map_rom(s, a, len);
+        at += len;
+    }
+    return size;
 }
 
 void Memory::dump_memory(std::ostream& ostr, uint8_t seg, uint16_t adr, unsigned width, unsigned count) {
+    TextSink out(ostr);
     for(int i=0; i<count; i++) {
-        ostr << format("%02X:%04X : ", seg, adr);
+        out.address(seg, adr).put(" : ");
         for(int j=0; j<width; j++) {
-            if(j && j % 8 == 0) ostr << " ";
-            ostr << format("%02X", segments[seg].memory[adr++]);
-            if(j<width-1) ostr << " ";
+            if(j && j % 8 == 0) out.put(' ');
+            out.hex8(segments[seg].memory[adr++]);
+            if(j<width-1) out.put(' ');
+        }
+        out.put('\n');
+    }
+}
+
+
+const uint8_t* Snapshot::find(uint32_t page) const {
+    auto it = std::lower_bound(pages.begin(), pages.end(), page);
+    if(it == pages.end() || *it != page) return nullptr;
+    return data.data() + (it - pages.begin()) * Memory::PAGE_SIZE;
+}
+
+Snapshot Memory::snapshot() {
+    Snapshot snap;
+    // most of the map is clean; skip it eight pages at a time
+    for(size_t i=0; i<NUM_PAGES; i+=8) {
+        uint64_t word;
+        memcpy(&word, dirtyPage + i, sizeof(word));
+        if(!word) continue;
+        for(size_t p=i; p<i+8; p++) {
+            if(!dirtyPage[p]) continue;
+            dirtyPage[p] = 0;
+            auto bytes = (const uint8_t*)segments + p * PAGE_SIZE;
+            snap.pages.push_back(p);
+            snap.data.insert(snap.data.end(), bytes, bytes + PAGE_SIZE);
         }
-        ostr << std::endl;
     }
+    return snap;
 }
 
+void Memory::restore(const Snapshot& snap) {
+    for(size_t i=0; i<snap.pages.size(); i++) {
+        auto p = snap.pages[i];
+        // the page of a read-only image can only hold the image
+        if(read_only(*this, p * PAGE_SIZE)) continue;
+        memcpy((uint8_t*)segments + p * PAGE_SIZE, snap.data.data() + i * PAGE_SIZE, PAGE_SIZE);
+        dirtyPage[p] = 1;
+        if(blocks) blocks->invalidate_range(p >> 8, (p & 0xff) << 8, PAGE_SIZE);
+    }
+}
+
+// prints the differing runs of one page, at most 16 bytes to a line
+static void dump_page_diff(TextSink& out, uint32_t page, const uint8_t* from, const uint8_t* to) {
+    size_t i = 0;
+    while(i < Memory::PAGE_SIZE) {
+        if(from[i] == to[i]) {
+            i++;
+            continue;
+        }
+        size_t start = i;
+        while(i < Memory::PAGE_SIZE && i - start < 16 && from[i] != to[i]) i++;
+        out.address(page >> 8, ((page & 0xff) << 8) | start).put(" : ");
+        for(size_t j=start; j<i; j++) (j == start ? out : out.put(' ')).hex8(from[j]);
+        out.put(" ->");
+        for(size_t j=start; j<i; j++) out.put(' ').hex8(to[j]);
+        out.put('\n');
+    }
+}
+
+void Memory::dump_diff(std::ostream& ostr, const Snapshot& from, const Snapshot& to) {
+    TextSink out(ostr);
+    size_t i = 0, j = 0;
+    while(i < from.pages.size() || j < to.pages.size()) {
+        uint32_t a = i < from.pages.size() ? from.pages[i] : UINT32_MAX;
+        uint32_t b = j < to.pages.size() ? to.pages[j] : UINT32_MAX;
+        if(a == b) {
+            dump_page_diff(out, a, from.data.data() + i * PAGE_SIZE, to.data.data() + j * PAGE_SIZE);
+            i++;
+            j++;
+        } else if(a < b) {
+            out.address(a >> 8, (a & 0xff) << 8).put(" : only in the first snapshot\n");
+            i++;
+        } else {
+            out.address(b >> 8, (b & 0xff) << 8).put(" : only in the second snapshot\n");
+            j++;
+        }
+    }
+}
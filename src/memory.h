@@ -7,38 +7,166 @@
 #include <iostream>
 #include <vector>
 
+#include "blockcache.h"
+
 struct MemorySegment {
     static constexpr size_t SEGMENT_SIZE = 1024 * 64;
     uint8_t memory[SEGMENT_SIZE];
-    void init() {
-        for(auto i=0; i<SEGMENT_SIZE; i++) {
-            memory[i] = 0;
-        }
-    }
+    // zeroes the segment by handing its pages back to the host
+    void init();
+};
+
+// what a page of the memory map is backed by
+enum PageType : uint8_t {
+    PageRAM = 0,
+    PageROM,    // reads like RAM, cpu writes are dropped
+    PageDevice  // reads and writes go to a MemoryDevice
+};
+
+// memory-mapped hardware; adr is the full address, not the offset into the page
+struct MemoryDevice {
+    virtual ~MemoryDevice() {}
+    virtual uint8_t read(uint8_t seg, uint16_t adr) = 0;
+    virtual void write(uint8_t seg, uint16_t adr, uint8_t byte) = 0;
+};
+
+// how the bulk operations of Memory treat the memory map
+enum BulkFlags : uint8_t {
+    BulkRaw = 0,         // straight to memory, like the loader: no devices, ROM is written but a read-only image throws
+    BulkMapped = 1 << 0, // as read() and write() would: devices are called, ROM drops writes
+    BulkDirty = 1 << 1,  // written RAM pages are marked in dirtyPage
+    BulkDefault = BulkMapped | BulkDirty
+};
+
+// pages copied out of a Memory by snapshot(), in page order
+struct Snapshot {
+    std::vector<uint32_t> pages; // seg << 8 | adr >> 8
+    std::vector<uint8_t> data;   // Memory::PAGE_SIZE bytes for each entry of pages
+
+    // the bytes of page, nullptr if the snapshot does not hold it
+    const uint8_t* find(uint32_t page) const;
 };
 
+/*
+    Guest memory is one anonymous mapping of all segments, reserved up
+    front and committed by the host page by page on first touch, so a
+    guest only pays for the pages it uses. Re-initializing discards the
+    pages instead of rewriting them.
+
+    The memory map gives every 256-byte page a PageType. RAM pages are
+    read and written in place; read() and write() only leave that path
+    for the other types. Instruction fetch and the decoders read code
+    straight from memory (peek), so code runs from RAM or ROM pages.
+    program() is the loader and writes through ROM pages.
+
+    Every store into RAM, including program(), load_image() and stores
+    from translated code, marks its page in dirtyPage. snapshot() copies
+    the marked pages out and clears the marks, so each snapshot holds
+    what changed since the one before it, and the first what changed
+    since init(). Restoring init() and then each snapshot in order
+    rebuilds the memory. The pages of a read-only image are never marked,
+    and restore() leaves them as they are.
+*/
 struct Memory {
     static constexpr size_t NUM_SEGMENTS = 256;
+    static constexpr size_t MEMORY_SIZE = NUM_SEGMENTS * MemorySegment::SEGMENT_SIZE;
+    static constexpr size_t PAGE_SIZE = 256;
+    static constexpr size_t NUM_PAGES = MEMORY_SIZE / PAGE_SIZE;
     MemorySegment *segments = nullptr;
+    BlockCache *blocks = nullptr; // created by the first cached run
+
+    // indexed by seg << 8 | adr >> 8
+    uint8_t pageType[NUM_PAGES] = {};
+    uint8_t pageDevice[NUM_PAGES] = {}; // index into devices for PageDevice pages
+    uint16_t mappedPages[NUM_SEGMENTS] = {}; // pages of each segment that are not RAM
+    uint8_t dirtyPage[NUM_PAGES] = {}; // a byte per page keeps the write path a single store
+    std::vector<MemoryDevice*> devices = {nullptr};
+
+    // host files mapped over the reservation by load_image, as byte ranges of it
+    struct Image {
+        size_t offset;
+        size_t length;
+        bool readOnly;
+    };
+    std::vector<Image> images;
+
+    // clears memory and maps every page back to RAM
+    void init();
+
+    ~Memory();
+
+    BlockCache& blockCache() {
+        if(!blocks) blocks = new BlockCache;
+        return *blocks;
+    }
     
-    void init() {
-        if(!segments) {
-            segments = new MemorySegment[NUM_SEGMENTS];
-        }
-        for(auto i=0; i<NUM_SEGMENTS; i++) {
-            segments[i].init();
-        }
+    static inline uint32_t page(uint8_t seg, uint16_t adr) { return (seg << 8) | (adr >> 8); }
+
+    inline uint8_t peek(uint8_t seg, uint16_t adr) const {
+        return segments[seg].memory[adr];
     }
 
-    ~Memory() {
-        if(segments != nullptr) delete [] segments;
+    inline uint8_t read(uint8_t seg, uint16_t adr) {
+        if(pageType[page(seg, adr)] == PageDevice) return read_mapped(seg, adr);
+        return segments[seg].memory[adr];
     }
-    
-    uint8_t read(uint8_t seg, uint16_t adr);
-    void write(uint8_t seg, uint16_t adr, uint8_t byte);
+
+    inline void write(uint8_t seg, uint16_t adr, uint8_t byte) {
+        if(pageType[page(seg, adr)] != PageRAM) {
+            write_mapped(seg, adr, byte);
+            return;
+        }
+        segments[seg].memory[adr] = byte;
+        dirtyPage[page(seg, adr)] = 1;
+        if(blocks) blocks->written(seg, adr);
+    }
+
+    // the pages covering [adr, adr+len) of seg; remapping drops all decoded blocks
+    void map_ram(uint8_t seg, uint16_t adr, size_t len);
+    void map_rom(uint8_t seg, uint16_t adr, size_t len);
+    void map_device(uint8_t seg, uint16_t adr, size_t len, MemoryDevice* device);
+
+    // the slow paths of read and write for pages that are not RAM
+    uint8_t read_mapped(uint8_t seg, uint16_t adr);
+    void write_mapped(uint8_t seg, uint16_t adr, uint8_t byte);
 
     uint16_t program(uint8_t seg, uint16_t adr, const std::vector<uint8_t>& bytes);
+
+    /*
+        Bulk operations on [adr, adr+len) of seg. The range wraps from the
+        end of the segment to its start, as the cpu's addressing does. RAM
+        runs are moved with memcpy/memset/memcmp a page (or, in a segment
+        with no mapped pages, a segment) at a time; device pages go through
+        their device a byte at a time. Writes always drop the decoded
+        blocks they overlap. A write that would store into a read-only
+        image throws std::invalid_argument before anything is written.
+    */
+    void read_block(uint8_t seg, uint16_t adr, uint8_t* out, size_t len, uint8_t flags = BulkDefault);
+    void write_block(uint8_t seg, uint16_t adr, const uint8_t* bytes, size_t len, uint8_t flags = BulkDefault);
+    void fill(uint8_t seg, uint16_t adr, uint8_t byte, size_t len, uint8_t flags = BulkDefault);
+    // memcmp of the guest bytes against bytes
+    int compare(uint8_t seg, uint16_t adr, const uint8_t* bytes, size_t len, uint8_t flags = BulkDefault);
+    // as if the whole source was read before the destination is written, so ranges may overlap
+    void copy(uint8_t dseg, uint16_t dadr, uint8_t sseg, uint16_t sadr, size_t len, uint8_t flags = BulkDefault);
+
+    /*
+        Loads the host file at path into memory at seg:adr, running on into
+        the following segments, and returns its size. When seg:adr falls on
+        a host page boundary the file is mapped in place: privately, so
+        guest writes stay in this Memory, and read-only for a ROM. Instances
+        loading the same file share its pages until they write them.
+        Otherwise the file is read in. A ROM's pages are mapped as PageROM,
+        and neither program() nor the bulk writes may store into a
+        read-only mapping. Bytes up to the end of the file's last host page
+        read as zero.
+    */
+    size_t load_image(const char* path, uint8_t seg, uint16_t adr, bool rom = false);
     void dump_memory(std::ostream& ostr, uint8_t seg, uint16_t adr, unsigned width, unsigned count);
+
+    Snapshot snapshot();
+    void restore(const Snapshot& snap);
+    // prints the bytes that differ between the pages both snapshots hold, and the pages only one holds
+    static void dump_diff(std::ostream& ostr, const Snapshot& from, const Snapshot& to);
 };
 
 
@@ -0,0 +1,67 @@
+#include "opstats.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <vector>
+
+OpStats::OpStats() {
+    std::fill(std::begin(prefix), std::end(prefix), -1);
+    for(size_t i=0; i<NUM_PREFIXES; i++) prefix[XTOP_PREFIXES[i]] = i;
+}
+
+void OpStats::clear() {
+    std::fill(std::begin(ops), std::end(ops), OpCounter());
+    for(auto& subs : subOps) std::fill(std::begin(subs), std::end(subs), OpCounter());
+}
+
+struct ReportRow {
+    int op;
+    int sub; // -1 for the opcode as a whole
+    OpCounter counter;
+};
+
+// the opcodes by cycles, each prefix followed by its sub-opcodes by cycles
+static std::vector<ReportRow> report_rows(const OpStats& stats) {
+    auto byCycles = [](const ReportRow& a, const ReportRow& b) {
+        return a.counter.cycles != b.counter.cycles ? a.counter.cycles > b.counter.cycles : a.op * 256 + a.sub < b.op * 256 + b.sub;
+    };
+    std::vector<ReportRow> ops;
+    for(int op=0; op<256; op++) {
+        if(stats.ops[op].count) ops.push_back({op, -1, stats.ops[op]});
+    }
+    std::sort(ops.begin(), ops.end(), byCycles);
+    std::vector<ReportRow> rows;
+    for(auto& row : ops) {
+        rows.push_back(row);
+        if(stats.prefix[row.op] < 0) continue;
+        auto first = rows.size();
+        for(int sub=0; sub<256; sub++) {
+            auto& counter = stats.subOps[stats.prefix[row.op]][sub];
+            if(counter.count) rows.push_back({row.op, sub, counter});
+        }
+        std::sort(rows.begin() + first, rows.end(), byCycles);
+    }
+    return rows;
+}
+
+void OpStats::report(std::ostream& ostr) const {
+    uint64_t total = 0;
+    for(auto& op : ops) total += op.cycles;
+    ostr << format("%-8s %14s %14s %8s %7s\n", "opcode", "count", "cycles", "cyc/op", "cycles%");
+    for(auto& row : report_rows(*this)) {
+        auto& c = row.counter;
+        auto name = row.sub < 0 ? format("%02X", row.op) : format("  %02X %02X", row.op, row.sub);
+        ostr << format("%-8s %14llu %14llu %8.2f %6.2f%%\n", name.c_str(),
+            (unsigned long long)c.count, (unsigned long long)c.cycles,
+            double(c.cycles) / c.count, total ? 100.0 * c.cycles / total : 0.0);
+    }
+}
+
+void OpStats::report_csv(std::ostream& ostr) const {
+    ostr << "opcode,subop,count,cycles\n";
+    for(auto& row : report_rows(*this)) {
+        auto sub = row.sub < 0 ? std::string() : format("%02X", row.sub);
+        ostr << format("%02X,%s,%llu,%llu\n", row.op, sub.c_str(),
+            (unsigned long long)row.counter.count, (unsigned long long)row.counter.cycles);
+    }
+}
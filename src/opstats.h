@@ -0,0 +1,57 @@
+#ifndef __OPSTATS_H
+#define __OPSTATS_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <iostream>
+
+#include "cpu65xops.h"
+#include "memory.h"
+
+struct OpCounter {
+    uint64_t count = 0;
+    uint64_t cycles = 0;
+};
+
+/*
+    Instructions and cycles by opcode, kept by runs while cpu.opStats is
+    set. The XTOP prefixes are counted again by the sub-opcode byte after
+    them, so a report can tell apart the operations behind one prefix.
+*/
+struct OpStats {
+    static constexpr uint8_t XTOP_PREFIXES[] = {
+        XTOP1, XTOP2, XTOP3, XTOP1_TRX, XTOP1_MATH, XTOP2_MATH, XTOP3_MATH,
+        XTOP1_STOR, XTOP2_STOR, XTOP3_STOR
+    };
+    static constexpr size_t NUM_PREFIXES = sizeof(XTOP_PREFIXES);
+
+    OpCounter ops[256];
+    OpCounter subOps[NUM_PREFIXES][256];
+    int8_t prefix[256]; // index into subOps of each opcode, -1 if it is not a prefix
+
+    OpStats();
+    void clear();
+
+    // the instruction that started at seg:pc took cycles
+    inline void add(const Memory& ram, uint8_t op, uint8_t seg, uint16_t pc, unsigned cycles) {
+        ops[op].count++;
+        ops[op].cycles += cycles;
+        if(prefix[op] >= 0) {
+            auto& sub = subOps[prefix[op]][ram.peek(seg, pc + 1)];
+            sub.count++;
+            sub.cycles += cycles;
+        }
+    }
+
+    /*
+        One row per opcode that ran, the XTOP prefixes broken down by
+        sub-opcode after theirs, most cycles first. As text with each row's
+        share of all cycles, or as CSV with an "opcode,subop,count,cycles"
+        header and subop empty outside the prefixes.
+    */
+    void report(std::ostream& ostr) const;
+    void report_csv(std::ostream& ostr) const;
+};
+
+#endif
@@ -0,0 +1,103 @@
+#include "profiler.h"
+#include "utils.h"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string.h>
+
+// deeper stacks lose their outermost frames; a guest only gets here by
+// moving SP or SS under its calls
+static constexpr size_t MAX_DEPTH = 256;
+
+Profiler::Profiler(uint64_t interval) : interval(interval ? interval : 1), nextSample(this->interval) {
+}
+
+void Profiler::restart(uint64_t cycles) {
+    stack.clear();
+    nextSample = cycles + interval;
+}
+
+void Profiler::clear() {
+    counts.clear();
+    samples = 0;
+}
+
+void Profiler::call(uint32_t site, uint32_t target, uint16_t sp) {
+    unwind(sp);
+    if(stack.size() == MAX_DEPTH) stack.erase(stack.begin());
+    stack.push_back({site, target, sp});
+}
+
+void Profiler::sample(uint32_t pc, uint64_t cycles) {
+    // an instruction that spans several intervals is one sample
+    nextSample = cycles + interval - (cycles - nextSample) % interval;
+    samples++;
+    std::vector<uint32_t> key;
+    key.reserve(stack.size() + 2);
+    if(!stack.empty()) {
+        key.push_back(stack.front().site);
+        for(auto& frame : stack) key.push_back(frame.target);
+    }
+    key.push_back(pc);
+    counts[key]++;
+}
+
+void Profiler::load_labels(const char* path) {
+    std::ifstream in(path);
+    if(!in) throw std::runtime_error(format("cannot open %s: %s", path, strerror(errno)));
+    load_labels(in, path);
+}
+
+void Profiler::load_labels(std::istream& in, const char* name) {
+    std::string line;
+    for(int n=1; std::getline(in, line); n++) {
+        std::istringstream fields(line);
+        std::string al, adr, label;
+        if(!(fields >> al) || al[0] == ';' || al[0] == '#') continue;
+        if(al != "al" || !(fields >> adr >> label)) {
+            throw std::invalid_argument(format("%s:%d: expected \"al addr .name\"", name, n));
+        }
+        uint32_t seg = 0;
+        auto colon = adr.find(':');
+        if(colon != std::string::npos) {
+            auto prefix = adr.substr(0, colon);
+            if(prefix != "C") seg = strtoul(prefix.c_str(), nullptr, 16);
+            adr = adr.substr(colon + 1);
+        }
+        char* end;
+        uint32_t value = strtoul(adr.c_str(), &end, 16);
+        if(adr.empty() || *end || seg > 0xff || value > 0xffffff || (colon != std::string::npos && value > 0xffff)) {
+            throw std::invalid_argument(format("%s:%d: bad address %s", name, n, adr.c_str()));
+        }
+        if(label[0] == '.') label.erase(0, 1);
+        labels.emplace(seg << 16 | value, label);
+    }
+}
+
+std::string Profiler::resolve(uint32_t adr) const {
+    auto at = labels.upper_bound(adr);
+    if(at != labels.begin() && (--at)->first >> 16 == adr >> 16) return at->second;
+    return format("%02X:%04X", adr >> 16, adr & 0xffff);
+}
+
+void Profiler::folded(std::ostream& ostr) const {
+    // different stacks can fold to the same routines
+    std::map<std::string, uint64_t> lines;
+    for(auto& [key, count] : counts) {
+        std::string root = labels.empty() ? "root" : resolve(key[0]);
+        std::string line = root, top = root;
+        for(size_t i=1; i+1<key.size(); i++) {
+            top = resolve(key[i]);
+            line += ";" + top;
+        }
+        if(!labels.empty() && key.size() > 1) {
+            auto leaf = resolve(key.back());
+            if(leaf != top) line += ";" + leaf;
+        }
+        lines[line] += count;
+    }
+    for(auto& [line, count] : lines) {
+        ostr << line << " " << count << "\n";
+    }
+}
@@ -0,0 +1,85 @@
+#ifndef __PROFILER_H
+#define __PROFILER_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "cpu65xops.h"
+
+// a guest routine entered by JSR or BRK; addresses are seg << 16 | adr
+struct ProfileFrame {
+    uint32_t site;   // the calling instruction
+    uint32_t target; // where the call went
+    uint16_t sp;     // SP once the return address is popped
+};
+
+/*
+    Guest sampling profiler, kept by runs while cpu.profiler is set. Every
+    `interval` cycles the instruction that was running when the sample
+    fell due is counted under the call stack of the moment. Samples go by
+    the cycle count, so the same run gives the same profile.
+
+    The stack is rebuilt from the instructions themselves: JSR and BRK push
+    a frame, RTS and RTI pop frames down to the SP they left. A frame whose
+    return address the guest dropped (PLA PLA, then a JMP) goes as soon as
+    a call or return reaches above it.
+*/
+struct Profiler {
+    uint64_t interval;
+    uint64_t nextSample;
+    uint64_t samples = 0;
+    std::vector<ProfileFrame> stack;
+    // by stack: the bottom call site (or the PC with no frames), the
+    // targets, then the sampled PC
+    std::map<std::vector<uint32_t>, uint64_t> counts;
+    std::map<uint32_t, std::string> labels;
+
+    Profiler(uint64_t interval = 10000);
+
+    // drops the stack and samples from `cycles` on; a cpu reset does this
+    void restart(uint64_t cycles);
+    void clear();
+
+    // the instruction op at seg:pc left the cpu at ps:newPC with sp at cycles
+    inline void step(uint8_t op, uint8_t seg, uint16_t pc, uint8_t ps, uint16_t newPC, uint16_t sp, uint64_t cycles) {
+        if(cycles >= nextSample) sample(seg << 16 | pc, cycles);
+        switch(op) {
+            case JSR_Absolute: call(seg << 16 | pc, ps << 16 | newPC, sp + 2); break;
+            case BRK: call(seg << 16 | pc, ps << 16 | newPC, sp + 3); break;
+            case RTS:
+            case RTI: unwind(sp); break;
+        }
+    }
+    void call(uint32_t site, uint32_t target, uint16_t sp);
+    inline void unwind(uint16_t sp) {
+        while(!stack.empty() && stack.back().sp <= sp) stack.pop_back();
+    }
+    void sample(uint32_t pc, uint64_t cycles);
+
+    /*
+        Labels as ca65 (-Ln) and VICE write them, one "al addr .name" per
+        line. addr is hex: AAAA, SSAAAA, or with a "C:" (segment 0) or
+        "SS:" prefix. Later labels at an address already named are ignored.
+    */
+    void load_labels(const char* path);
+    void load_labels(std::istream& in, const char* name = "labels");
+    // the label at or below adr in its segment, else SS:AAAA
+    std::string resolve(uint32_t adr) const;
+
+    /*
+        One "frame;frame;... count" line per stack, for flamegraph.pl and
+        its kin. Frames are routines, named by resolve() with labels loaded.
+        The outermost is the routine the first call came from, and the
+        sampled PC's routine goes on top when it is not the innermost call's
+        (code reached by JMP). Without labels, the outermost is "root" and
+        only the called addresses follow.
+    */
+    void folded(std::ostream& ostr) const;
+};
+
+#endif
@@ -0,0 +1,47 @@
+#include "scheduler.h"
+
+#include <algorithm>
+
+// std::*_heap keep the greatest first; this puts the earliest there
+static bool later(const ScheduledEvent& a, const ScheduledEvent& b) {
+    return a.when != b.when ? a.when > b.when : a.order > b.order;
+}
+
+void EventScheduler::post(uint64_t when, EventHandler* handler, uint32_t tag) {
+    heap.push_back({when, posted++, handler, tag});
+    std::push_heap(heap.begin(), heap.end(), later);
+}
+
+size_t EventScheduler::cancel(EventHandler* handler) {
+    auto size = heap.size();
+    heap.erase(std::remove_if(heap.begin(), heap.end(),
+        [&](const ScheduledEvent& ev) { return ev.handler == handler; }), heap.end());
+    std::make_heap(heap.begin(), heap.end(), later);
+    return size - heap.size();
+}
+
+size_t EventScheduler::cancel(EventHandler* handler, uint32_t tag) {
+    auto size = heap.size();
+    heap.erase(std::remove_if(heap.begin(), heap.end(),
+        [&](const ScheduledEvent& ev) { return ev.handler == handler && ev.tag == tag; }), heap.end());
+    std::make_heap(heap.begin(), heap.end(), later);
+    return size - heap.size();
+}
+
+bool EventScheduler::pop_due(uint64_t cycles, ScheduledEvent& ev) {
+    if(heap.empty() || heap.front().when > cycles) return false;
+    std::pop_heap(heap.begin(), heap.end(), later);
+    ev = heap.back();
+    heap.pop_back();
+    return true;
+}
+
+void EventScheduler::rebase(uint64_t by) {
+    for(auto& ev : heap) ev.when -= std::min(ev.when, by);
+    // events that were overdue now tie at 0 and go by posting order
+    std::make_heap(heap.begin(), heap.end(), later);
+}
+
+void EventScheduler::clear() {
+    heap.clear();
+}
@@ -0,0 +1,49 @@
+#ifndef __SCHEDULER_H
+#define __SCHEDULER_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <vector>
+
+struct CPU;
+
+// timed work of a device, fired at the first instruction boundary at or after its cycle
+struct EventHandler {
+    virtual ~EventHandler() {}
+    virtual void fire(CPU& cpu, uint64_t when, uint32_t tag) = 0;
+};
+
+struct ScheduledEvent {
+    uint64_t when;  // cpu.cycles it is due at
+    uint64_t order; // events due at the same cycle fire in the order they were posted
+    EventHandler* handler;
+    uint32_t tag;   // the handler's own, to tell its events apart
+};
+
+/*
+    Min-heap of events keyed on CPU::cycles. Devices post through
+    CPU::post_event, which also lowers the deadline the run loop checks,
+    so nothing polls a device between its events. Cancelling can leave
+    that deadline early; the run then stops once for nothing.
+*/
+struct EventScheduler {
+    std::vector<ScheduledEvent> heap;
+    uint64_t posted = 0;
+
+    inline bool empty() const { return heap.empty(); }
+    inline uint64_t next() const { return heap.empty() ? UINT64_MAX : heap.front().when; }
+
+    void post(uint64_t when, EventHandler* handler, uint32_t tag = 0);
+    // drops the handler's events (with tag only those), returns how many
+    size_t cancel(EventHandler* handler);
+    size_t cancel(EventHandler* handler, uint32_t tag);
+    // takes the earliest event into ev if it is due by cycles
+    bool pop_due(uint64_t cycles, ScheduledEvent& ev);
+    // moves every event `by` cycles earlier, as far as cycle 0; a cpu reset
+    // does this so events stay as far off as they were
+    void rebase(uint64_t by);
+    void clear();
+};
+
+#endif
@@ -0,0 +1,430 @@
+#include "tracefile.h"
+#include "cpu65x.h"
+#include "xutils.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <string.h>
+
+// fixed-width fields are stored as the (little-endian) host has them
+template<class V> static void put(std::vector<uint8_t>& out, V v) {
+    auto p = reinterpret_cast<const uint8_t*>(&v);
+    out.insert(out.end(), p, p + sizeof(v));
+}
+
+static void put_varint(std::vector<uint8_t>& out, uint64_t v) {
+    while(v >= 0x80) {
+        out.push_back(v | 0x80);
+        v >>= 7;
+    }
+    out.push_back(v);
+}
+
+static inline uint64_t zigzag(int64_t v) {
+    return (uint64_t(v) << 1) ^ uint64_t(v >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t v) {
+    return int64_t(v >> 1) ^ -int64_t(v & 1);
+}
+
+static constexpr uint8_t TAG_KEYFRAME = 3;
+static constexpr uint8_t TAG_LOST = 0xff;
+
+void TraceEncoder::begin(FILE* f) {
+    file = f;
+    offset = 0;
+    state = TraceState();
+    lastSeg = 0;
+    lastAdr = 0;
+    lastCycles = 0;
+    sinceKeyframe = 0;
+    keyframeDue = true;
+    index.clear();
+    out.assign(TRACE_MAGIC, TRACE_MAGIC + sizeof(TRACE_MAGIC));
+}
+
+void TraceEncoder::keyframe() {
+    keyframeDue = false;
+    sinceKeyframe = 0;
+    index.push_back({offset + out.size(), state.cycles, state.instructions, 0xffff, 0, 0});
+    out.push_back(TAG_KEYFRAME);
+    put(out, state.cycles);
+    put(out, state.instructions);
+    put(out, state.opSeg);
+    put(out, state.opPC);
+    put(out, state.op);
+    put(out, state.PS);
+    put(out, state.DS);
+    put(out, state.SS);
+    put(out, state.PC);
+    put(out, state.SP);
+    put(out, state.P);
+    for(auto r : state.reg32) put(out, r);
+    put(out, lastSeg);
+    put(out, lastAdr);
+}
+
+void TraceEncoder::instruction(const TraceRecord& r, const TraceRegisters& regs) {
+    if(keyframeDue) keyframe();
+    uint8_t mask = 0;
+    uint8_t rare = 0;
+    uint8_t changed = 0;
+    if(r.seg != state.PS || r.adr != state.PC) mask |= DeltaAddress;
+    if(r.sp != state.SP) mask |= DeltaSP;
+    if(r.data != state.P) mask |= DeltaP;
+    for(int i=0; i<8; i++) {
+        if(regs.reg32[i] != state.reg32[i]) changed |= 1 << i;
+    }
+    if(changed) mask |= DeltaRegisters;
+    if(r.ps != r.seg) rare |= DeltaPS;
+    if(r.ds != state.DS) rare |= DeltaDS;
+    if(r.ss != state.SS) rare |= DeltaSS;
+    if(r.instructions != state.instructions + 1) rare |= DeltaInstructions;
+    if(rare) mask |= DeltaRare;
+
+    out.push_back(mask << 2);
+    if(mask & DeltaAddress) {
+        put(out, r.seg);
+        put(out, r.adr);
+    }
+    if(mask & DeltaSP) put_varint(out, zigzag(int16_t(r.sp - state.SP)));
+    if(mask & DeltaP) out.push_back(r.data);
+    if(mask & DeltaRegisters) {
+        out.push_back(changed);
+        for(int i=0; i<8; i++) {
+            if(changed & (1 << i)) put_varint(out, regs.reg32[i] ^ state.reg32[i]);
+        }
+    }
+    if(mask & DeltaRare) {
+        out.push_back(rare);
+        if(rare & DeltaPS) out.push_back(r.ps);
+        if(rare & DeltaDS) out.push_back(r.ds);
+        if(rare & DeltaSS) out.push_back(r.ss);
+        if(rare & DeltaInstructions) put_varint(out, zigzag(int64_t(r.instructions - state.instructions - 1)));
+    }
+    out.push_back(r.op);
+    put_varint(out, zigzag(int64_t(r.cycles - lastCycles)));
+    put_varint(out, zigzag(int16_t(r.pc - r.adr)));
+
+    state.cycles = r.cycles;
+    state.instructions = r.instructions;
+    state.opSeg = r.seg;
+    state.opPC = r.adr;
+    state.op = r.op;
+    state.PS = r.ps;
+    state.DS = r.ds;
+    state.SS = r.ss;
+    state.PC = r.pc;
+    state.SP = r.sp;
+    state.P = r.data;
+    memcpy(state.reg32, regs.reg32, sizeof(state.reg32));
+    lastCycles = r.cycles;
+
+    auto& chunk = index.back();
+    chunk.minPC = std::min(chunk.minPC, r.adr);
+    chunk.maxPC = std::max(chunk.maxPC, r.adr);
+    if(++sinceKeyframe >= KEYFRAME_INTERVAL) keyframeDue = true;
+    if(out.size() >= FLUSH_SIZE) flush();
+}
+
+void TraceEncoder::access(const TraceRecord& r) {
+    if(keyframeDue) keyframe();
+    int64_t delta = r.cycles - lastCycles;
+    bool small = delta >= 0 && delta < 31;
+    uint8_t tag = r.kind | (r.seg != lastSeg ? 4 : 0) | (small ? delta : 31) << 3;
+    out.push_back(tag);
+    if(!small) put_varint(out, zigzag(delta));
+    if(r.seg != lastSeg) out.push_back(r.seg);
+    put_varint(out, zigzag(int16_t(r.adr - lastAdr)));
+    out.push_back(r.data);
+    lastSeg = r.seg;
+    lastAdr = r.adr;
+    lastCycles = r.cycles;
+}
+
+void TraceEncoder::lost(uint64_t count) {
+    if(keyframeDue) keyframe();
+    out.push_back(TAG_LOST);
+    put_varint(out, count);
+}
+
+void TraceEncoder::flush() {
+    if(!out.empty()) fwrite(out.data(), 1, out.size(), file);
+    offset += out.size();
+    out.clear();
+}
+
+void TraceEncoder::finish() {
+    flush();
+    TraceTrailer trailer;
+    trailer.indexOffset = offset;
+    trailer.entries = index.size();
+    memcpy(trailer.magic, TRACE_INDEX_MAGIC, sizeof(trailer.magic));
+    fwrite(index.data(), sizeof(TraceIndexEntry), index.size(), file);
+    fwrite(&trailer, sizeof(trailer), 1, file);
+    fflush(file);
+}
+
+static void damaged(size_t pos) {
+    throw std::runtime_error(format("damaged trace entry at offset %zu", pos));
+}
+
+static inline uint8_t get_byte(TraceReader& rd) {
+    if(rd.pos >= rd.end) damaged(rd.pos);
+    return rd.data[rd.pos++];
+}
+
+template<class V> static inline V get(TraceReader& rd) {
+    if(rd.end - rd.pos < sizeof(V)) damaged(rd.pos);
+    V v;
+    memcpy(&v, rd.data + rd.pos, sizeof(V));
+    rd.pos += sizeof(V);
+    return v;
+}
+
+static inline uint64_t get_varint(TraceReader& rd) {
+    uint64_t v = 0;
+    for(unsigned shift=0; shift<64; shift+=7) {
+        uint8_t b = get_byte(rd);
+        v |= uint64_t(b & 0x7f) << shift;
+        if(!(b & 0x80)) return v;
+    }
+    damaged(rd.pos);
+    return 0;
+}
+
+TraceReader::TraceReader(const uint8_t* data, size_t size) : data(data), size(size), end(size), pos(sizeof(TRACE_MAGIC)) {
+    if(size < sizeof(TRACE_MAGIC) || memcmp(data, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0) {
+        throw std::runtime_error("not a trace file");
+    }
+    TraceTrailer trailer;
+    if(size < sizeof(TRACE_MAGIC) + sizeof(trailer)) return;
+    memcpy(&trailer, data + size - sizeof(trailer), sizeof(trailer));
+    if(memcmp(trailer.magic, TRACE_INDEX_MAGIC, sizeof(trailer.magic)) != 0
+        || trailer.indexOffset < sizeof(TRACE_MAGIC) || trailer.indexOffset > size
+        || (size - sizeof(trailer) - trailer.indexOffset) / sizeof(TraceIndexEntry) != trailer.entries) {
+        return; // no index: the writer did not finish
+    }
+    index.resize(trailer.entries);
+    memcpy(index.data(), data + trailer.indexOffset, trailer.entries * sizeof(TraceIndexEntry));
+    end = trailer.indexOffset;
+}
+
+void TraceReader::seek(size_t entry) {
+    pos = index[entry].offset;
+}
+
+size_t TraceReader::find_cycle(uint64_t cycle) const {
+    auto it = std::upper_bound(index.begin(), index.end(), cycle,
+        [](uint64_t c, const TraceIndexEntry& e) { return c < e.cycles; });
+    return it == index.begin() ? 0 : it - index.begin() - 1;
+}
+
+bool TraceReader::next(TraceEvent& ev) {
+    while(pos < end) {
+        auto at = pos;
+        uint8_t tag = get_byte(*this);
+        switch(tag & 3) {
+            case 0: {
+                uint8_t mask = tag >> 2;
+                auto& s = state;
+                if(mask & DeltaAddress) {
+                    s.opSeg = get<uint8_t>(*this);
+                    s.opPC = get<uint16_t>(*this);
+                } else {
+                    s.opSeg = s.PS;
+                    s.opPC = s.PC;
+                }
+                if(mask & DeltaSP) s.SP += unzigzag(get_varint(*this));
+                if(mask & DeltaP) s.P = get_byte(*this);
+                if(mask & DeltaRegisters) {
+                    uint8_t changed = get_byte(*this);
+                    for(int i=0; i<8; i++) {
+                        if(changed & (1 << i)) s.reg32[i] ^= get_varint(*this);
+                    }
+                }
+                uint8_t rare = (mask & DeltaRare) ? get_byte(*this) : 0;
+                s.PS = (rare & DeltaPS) ? get_byte(*this) : s.opSeg;
+                if(rare & DeltaDS) s.DS = get_byte(*this);
+                if(rare & DeltaSS) s.SS = get_byte(*this);
+                s.instructions += 1;
+                if(rare & DeltaInstructions) s.instructions += unzigzag(get_varint(*this));
+                s.op = get_byte(*this);
+                s.cycles += unzigzag(get_varint(*this));
+                s.PC = s.opPC + unzigzag(get_varint(*this));
+                ev.kind = TraceInstruction;
+                ev.cycles = s.cycles;
+                return true;
+            }
+            case TraceRead:
+            case TraceWrite: {
+                uint64_t delta = tag >> 3;
+                state.cycles += delta == 31 ? unzigzag(get_varint(*this)) : delta;
+                if(tag & 4) lastSeg = get_byte(*this);
+                lastAdr += unzigzag(get_varint(*this));
+                ev.kind = tag & 3;
+                ev.seg = lastSeg;
+                ev.adr = lastAdr;
+                ev.data = get_byte(*this);
+                ev.cycles = state.cycles;
+                return true;
+            }
+            default:
+                if(tag == TAG_LOST) {
+                    ev.kind = TraceLost;
+                    ev.lost = get_varint(*this);
+                    ev.cycles = state.cycles;
+                    return true;
+                }
+                if(tag != TAG_KEYFRAME) damaged(at);
+                state.cycles = get<uint64_t>(*this);
+                state.instructions = get<uint64_t>(*this);
+                state.opSeg = get<uint8_t>(*this);
+                state.opPC = get<uint16_t>(*this);
+                state.op = get<uint8_t>(*this);
+                state.PS = get<uint8_t>(*this);
+                state.DS = get<uint8_t>(*this);
+                state.SS = get<uint8_t>(*this);
+                state.PC = get<uint16_t>(*this);
+                state.SP = get<uint16_t>(*this);
+                state.P = get<uint8_t>(*this);
+                for(auto& r : state.reg32) r = get<uint32_t>(*this);
+                lastSeg = get<uint8_t>(*this);
+                lastAdr = get<uint16_t>(*this);
+                break;
+        }
+    }
+    return false;
+}
+
+TraceWriter::TraceWriter(size_t capacity) : ring(capacity) {}
+
+TraceWriter::~TraceWriter() {
+    stop();
+}
+
+void TraceWriter::start(const char* path) {
+    stop();
+    FILE* file = fopen(path, "wb");
+    if(file == nullptr) {
+        throw std::runtime_error(format("cannot create the trace file %s: %s", path, strerror(errno)));
+    }
+    encoder.begin(file);
+    written = 0;
+    running = true;
+    thread = std::thread(&TraceWriter::drain, this);
+}
+
+void TraceWriter::stop() {
+    if(!thread.joinable()) return;
+    running = false;
+    thread.join();
+    encoder.finish();
+    fclose(encoder.file);
+    encoder.file = nullptr;
+}
+
+void TraceWriter::drain() {
+    auto mask = ring.mask;
+    for(;;) {
+        // read running first, so a stop seen here comes after the last push
+        bool last = !running;
+        auto t = ring.tail.load(std::memory_order_relaxed);
+        auto h = ring.head.load(std::memory_order_acquire);
+        auto handedBack = t;
+        while(t != h) {
+            auto& r = ring.records[t & mask];
+            if(r.kind == TraceInstruction) {
+                // pushed together with its registers
+                TraceRegisters regs;
+                memcpy(&regs, &ring.records[(t + 1) & mask], sizeof(regs));
+                encoder.instruction(r, regs);
+                t += 2;
+                written += 2;
+            } else {
+                if(r.kind == TraceLost) encoder.lost(r.cycles);
+                else encoder.access(r);
+                t++;
+                written++;
+            }
+            // hand slots back as we go, not only once the ring is empty
+            if(t - handedBack >= 1024) {
+                ring.tail.store(t, std::memory_order_release);
+                handedBack = t;
+            }
+        }
+        ring.tail.store(t, std::memory_order_release);
+        if(last) break;
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+}
+
+void dump_trace(const uint8_t* data, size_t size, std::ostream& ostr, const TraceFilter& filter) {
+    TraceReader reader(data, size);
+    auto& index = reader.index;
+    size_t chunk = 0;
+    if(filter.fromCycle && !index.empty()) {
+        chunk = reader.find_cycle(filter.fromCycle);
+        reader.seek(chunk);
+    }
+    CPU cpu;
+    Memory ram; // x_dump_regs_info only names it
+    TextSink out(ostr);
+    // an instruction's accesses come before it in the file and after its opcode in the text
+    std::vector<TraceEvent> accesses;
+    uint64_t shown = 0;
+    TraceEvent ev;
+    while(shown < filter.count) {
+        if(!index.empty()) {
+            while(chunk + 1 < index.size() && reader.pos >= index[chunk + 1].offset) chunk++;
+            if(index[chunk].maxPC < filter.minPC || index[chunk].minPC > filter.maxPC) {
+                // nothing in range before the next keyframe
+                accesses.clear();
+                if(++chunk == index.size()) break;
+                reader.seek(chunk);
+                continue;
+            }
+        }
+        if(!reader.next(ev)) break;
+        auto& s = reader.state;
+        switch(ev.kind) {
+            case TraceRead:
+            case TraceWrite:
+            case TraceLost:
+                accesses.push_back(ev);
+                break;
+            default:
+                if(s.cycles >= filter.fromCycle && s.opPC >= filter.minPC && s.opPC <= filter.maxPC) {
+                    out.address(s.opSeg, s.opPC).put(" OP=").hex8(s.op).put('\n');
+                    for(auto& a : accesses) {
+                        if(a.kind == TraceLost) {
+                            out.put("  ... ").dec(a.lost).put(" records lost\n");
+                        } else {
+                            out.put(a.kind == TraceRead ? "  read " : "  wrote ").address(a.seg, a.adr).put('=').hex8(a.data).put('\n');
+                        }
+                    }
+                    memcpy(cpu.reg32, s.reg32, sizeof(cpu.reg32));
+                    cpu.PC = s.PC;
+                    cpu.SP = s.SP;
+                    cpu.PS = s.PS;
+                    cpu.DS = s.DS;
+                    cpu.SS = s.SS;
+                    cpu.P.setByte(s.P);
+                    if(filter.extended) {
+                        x_dump_regs_info(out, ram, cpu);
+                    } else {
+                        cpu.dump_regs_info(out);
+                        out.put('\n');
+                    }
+                    shown++;
+                }
+                accesses.clear();
+                break;
+        }
+    }
+}
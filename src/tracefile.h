@@ -0,0 +1,194 @@
+#ifndef __TRACEFILE_H
+#define __TRACEFILE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "tracering.h"
+
+/*
+    Trace files. After the TRACE_MAGIC header comes a stream of entries,
+    each starting with a tag byte whose low two bits say what it is:
+
+        0  an instruction; the other six bits say which parts of the
+           state differ from the one before (TraceDelta), and only those
+           follow: seg:adr where it started when that is not the previous
+           PS:PC, SP as a zigzag varint difference, P, a register mask
+           byte and the xor of each marked register as a varint, and a
+           byte of rarer changes (PS, DS, SS, an instruction count jump).
+           Then always the opcode, the cycles since the entry before as
+           a zigzag varint, and the PC after it as a zigzag difference
+           from where it started.
+        1  a read and
+        2  a write: bits 3-7 hold the cycles since the entry before (31:
+           a zigzag varint follows) and bit 2 says a segment byte comes
+           next; then the address as a zigzag difference from the last
+           access, and the byte.
+        3  a keyframe (bits 2-7 zero): the whole state, fixed width, that
+           the entries after it are relative to; or (bits 2-7 one) the
+           count of records the ring dropped, as a varint.
+
+    A keyframe starts the file and every KEYFRAME_INTERVAL instructions
+    after, always right after an instruction. The encoder closes the file
+    with an index of the keyframes (TraceIndexEntry) and a TraceTrailer,
+    which lets a reader seek to a cycle or skip the stretches whose PCs
+    are out of range. A file without them (the writer did not stop) is
+    still read from the start.
+*/
+
+static constexpr char TRACE_MAGIC[8] = {'6', '5', 'X', 'T', 'R', 'C', '0', '2'};
+static constexpr char TRACE_INDEX_MAGIC[8] = {'6', '5', 'X', 'T', 'I', 'D', 'X', '1'};
+
+enum TraceDelta : uint8_t {
+    DeltaAddress = 1 << 0,  // the instruction did not start at the previous PS:PC
+    DeltaSP = 1 << 1,
+    DeltaP = 1 << 2,
+    DeltaRegisters = 1 << 3,
+    DeltaRare = 1 << 4,     // a byte of DeltaRare* follows
+};
+
+enum TraceRareDelta : uint8_t {
+    DeltaPS = 1 << 0,
+    DeltaDS = 1 << 1,
+    DeltaSS = 1 << 2,
+    DeltaInstructions = 1 << 3, // instructions were skipped; how many follows as a varint
+};
+
+// the cpu as of the last instruction decoded
+struct TraceState {
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+    uint8_t opSeg = 0;   // where the last instruction started
+    uint16_t opPC = 0;
+    uint8_t op = 0;
+    uint8_t PS = 0;
+    uint8_t DS = 0;
+    uint8_t SS = 0;
+    uint16_t PC = 0;
+    uint16_t SP = 0;
+    uint8_t P = 0;
+    uint32_t reg32[8] = {};
+};
+
+struct TraceIndexEntry {
+    uint64_t offset;       // of the keyframe in the file
+    uint64_t cycles;       // at the keyframe
+    uint64_t instructions;
+    uint16_t minPC;        // range of the PCs that instructions up to the next keyframe start at
+    uint16_t maxPC;
+    uint32_t reserved;
+};
+
+struct TraceTrailer {
+    uint64_t indexOffset;
+    uint64_t entries;
+    char magic[8];
+};
+
+// turns ring records into the entries of a trace file
+struct TraceEncoder {
+    static constexpr uint64_t KEYFRAME_INTERVAL = 1 << 16;
+    static constexpr size_t FLUSH_SIZE = 1 << 16;
+
+    FILE* file = nullptr;
+    std::vector<uint8_t> out;  // encoded, not yet written
+    uint64_t offset = 0;       // of out[0] in the file
+    TraceState state;
+    uint8_t lastSeg = 0;       // of the last access
+    uint16_t lastAdr = 0;
+    uint64_t lastCycles = 0;   // of the last entry
+    uint64_t sinceKeyframe = 0; // instructions
+    bool keyframeDue = true;
+    std::vector<TraceIndexEntry> index;
+
+    // writes the header to file
+    void begin(FILE* f);
+    void instruction(const TraceRecord& r, const TraceRegisters& regs);
+    void access(const TraceRecord& r);
+    void lost(uint64_t count);
+    // writes out what is buffered, the index and the trailer
+    void finish();
+    void flush();
+
+    void keyframe();
+};
+
+// what TraceReader::next stepped over
+struct TraceEvent {
+    uint8_t kind;     // TraceKind
+    uint8_t seg;      // TraceRead/TraceWrite
+    uint16_t adr;
+    uint8_t data;
+    uint64_t cycles;
+    uint64_t lost;    // TraceLost
+};
+
+// decodes a trace file held in memory; state follows the instructions read
+struct TraceReader {
+    const uint8_t* data;
+    size_t size;
+    size_t end;   // of the entries, where the index starts
+    size_t pos;
+    TraceState state;
+    uint8_t lastSeg = 0;
+    uint16_t lastAdr = 0;
+    std::vector<TraceIndexEntry> index;
+
+    // throws std::runtime_error if data is not a trace file
+    TraceReader(const uint8_t* data, size_t size);
+
+    // false at the end of the entries; throws std::runtime_error on a damaged one
+    bool next(TraceEvent& ev);
+    // continues from keyframe entry of the index
+    void seek(size_t entry);
+    // the index entry of the last keyframe at or before cycle
+    size_t find_cycle(uint64_t cycle) const;
+};
+
+/*
+    Drains a TraceRing into a trace file on a thread of its own, so the
+    cpu only pays for filling in records.
+*/
+struct TraceWriter {
+    TraceRing ring;
+    TraceEncoder encoder;
+    uint64_t written = 0; // records taken from the ring so far
+
+    explicit TraceWriter(size_t capacity = TraceRing::DEFAULT_CAPACITY);
+    ~TraceWriter();
+
+    // throws std::runtime_error when path cannot be created
+    void start(const char* path);
+    // writes out what is left in the ring, the index, and closes the file
+    void stop();
+
+    std::thread thread;
+    std::atomic<bool> running{false};
+
+    // the writer thread
+    void drain();
+};
+
+// what dump_trace renders
+struct TraceFilter {
+    uint64_t fromCycle = 0;        // skip instructions that finished before this
+    uint16_t minPC = 0;            // only instructions starting in [minPC, maxPC]
+    uint16_t maxPC = 0xffff;
+    uint64_t count = UINT64_MAX;   // stop after this many
+    bool extended = false;         // the registers as x_dump_regs_info shows them
+};
+
+/*
+    Renders the instructions of a trace file the filter lets through: the
+    opcode with where it started, the accesses it made, and the registers
+    after it as dump_regs_info (or x_dump_regs_info) prints them.
+*/
+void dump_trace(const uint8_t* data, size_t size, std::ostream& ostr, const TraceFilter& filter = TraceFilter());
+
+#endif
@@ -0,0 +1,26 @@
+#include "tracering.h"
+
+#include <algorithm>
+#include <string.h>
+
+TraceRing::TraceRing(size_t capacity) {
+    size_t n = 1;
+    while(n < capacity) n <<= 1;
+    records = new TraceRecord[n];
+    mask = n - 1;
+}
+
+TraceRing::~TraceRing() {
+    delete[] records;
+}
+
+size_t TraceRing::pop(TraceRecord* out, size_t max) {
+    auto t = tail.load(std::memory_order_relaxed);
+    size_t n = std::min<uint64_t>(head.load(std::memory_order_acquire) - t, max);
+    // at most two runs: up to the end of the array, then from its start
+    size_t first = std::min(n, mask + 1 - (t & mask));
+    memcpy(out, records + (t & mask), first * sizeof(TraceRecord));
+    memcpy(out + first, records, (n - first) * sizeof(TraceRecord));
+    tail.store(t + n, std::memory_order_release);
+    return n;
+}
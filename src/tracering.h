@@ -0,0 +1,103 @@
+#ifndef __TRACERING_H
+#define __TRACERING_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <atomic>
+
+enum TraceKind : uint8_t {
+    TraceInstruction, // an instruction ran; made after its accesses
+    TraceRead,        // a byte read by the cpu
+    TraceWrite,       // a byte written by the cpu
+    TraceLost         // cycles holds how many records a full ring dropped here
+};
+
+/*
+    32 bytes; the fields after adr are those of the kind named in their
+    comment. A TraceInstruction record is always followed in the ring by
+    a TraceRegisters in the next slot.
+*/
+struct TraceRecord {
+    uint64_t cycles;       // cpu cycles once the instruction or access was done
+    uint64_t instructions; // TraceInstruction: cpu instructions including this one
+    uint8_t kind;
+    uint8_t seg;
+    uint16_t adr;          // where the instruction started, or the address accessed
+    uint8_t data;          // TraceRead/TraceWrite: the byte; TraceInstruction: P
+    uint8_t op;            // TraceInstruction: the opcode, then the state after it ran
+    uint8_t ps;
+    uint8_t ds;
+    uint8_t ss;
+    uint8_t reserved;
+    uint16_t pc;
+    uint16_t sp;
+    uint16_t reserved2;
+};
+
+// the slot after a TraceInstruction
+struct TraceRegisters {
+    uint32_t reg32[8];
+};
+
+static_assert(sizeof(TraceRecord) == 32 && sizeof(TraceRegisters) == sizeof(TraceRecord),
+    "ring slots are 32 bytes");
+
+/*
+    Single-producer, single-consumer ring of TraceRecords. The cpu thread
+    pushes, one other thread pops; neither ever waits on the other. A push
+    into a full ring drops the record and counts it, and the next push
+    that fits is preceded by a TraceLost record, so a reader knows where
+    the gap is.
+*/
+struct TraceRing {
+    static constexpr size_t DEFAULT_CAPACITY = 1 << 16;
+
+    // capacity is rounded up to a power of two
+    explicit TraceRing(size_t capacity = DEFAULT_CAPACITY);
+    ~TraceRing();
+    TraceRing(const TraceRing&) = delete;
+    TraceRing& operator=(const TraceRing&) = delete;
+
+    TraceRecord* records;
+    size_t mask;
+    uint64_t dropped = 0; // records pushed into a full ring, over its lifetime
+
+    // producer side: all n records, or none of them
+    inline bool push(const TraceRecord* records, unsigned n = 1);
+    // consumer side: moves up to max of the oldest records to out, returns how many
+    size_t pop(TraceRecord* out, size_t max);
+
+    alignas(64) std::atomic<uint64_t> head{0}; // next slot the producer fills
+    uint64_t cachedTail = 0;                   // producer's last look at tail
+    uint64_t lost = 0;                         // dropped since the last TraceLost
+    alignas(64) std::atomic<uint64_t> tail{0}; // next slot the consumer empties
+};
+
+inline bool TraceRing::push(const TraceRecord* pushed, unsigned n) {
+    auto h = head.load(std::memory_order_relaxed);
+    uint64_t need = lost ? n + 1 : n;
+    if(h - cachedTail + need > mask + 1) {
+        cachedTail = tail.load(std::memory_order_acquire);
+        if(h - cachedTail + need > mask + 1) {
+            lost += n;
+            dropped += n;
+            return false;
+        }
+    }
+    if(lost) {
+        TraceRecord gap = {};
+        gap.kind = TraceLost;
+        gap.cycles = lost;
+        records[h++ & mask] = gap;
+        lost = 0;
+    }
+    for(unsigned i=0; i<n; i++) {
+        records[h++ & mask] = pushed[i];
+    }
+    head.store(h, std::memory_order_release);
+    return true;
+}
+
+#endif
@@ -1,18 +1,48 @@
 #include "utils.h"
 
-#include <vector>
+#include <cstdarg>
+#include <cstdio>
 #include <cassert>
 
 std::string format(const char* format, ...) {
+    // most results fit on the stack; only longer ones pay for a second pass
+    char buf[256];
     va_list args;
     va_start(args, format);
-    size_t len = std::vsnprintf(NULL, 0, format, args);
+    size_t len = std::vsnprintf(buf, sizeof(buf), format, args);
     va_end(args);
-    std::vector<char> vec(len + 1);
+    if(len < sizeof(buf)) return std::string(buf, len);
+    std::string str(len, '\0');
     va_start(args, format);
-    std::vsnprintf(&vec[0], len + 1, format, args);
+    std::vsnprintf(str.data(), len + 1, format, args);
     va_end(args);
-    return &vec[0];    
+    return str;
+}
+
+TextSink& TextSink::dec(uint64_t value) {
+    char digits[20];
+    size_t n = 0;
+    do {
+        digits[sizeof(digits) - ++n] = '0' + value % 10;
+        value /= 10;
+    } while(value);
+    return put(digits + sizeof(digits) - n, n);
+}
+
+TextSink& TextSink::printf(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    size_t len = std::vsnprintf(text + length, CAPACITY - length, format, args);
+    va_end(args);
+    if(length + len >= CAPACITY && length) {
+        // did not fit behind what is buffered; retry in an empty buffer
+        flush();
+        va_start(args, format);
+        len = std::vsnprintf(text, CAPACITY, format, args);
+        va_end(args);
+    }
+    length += len < CAPACITY - length ? len : CAPACITY - length - 1;
+    return *this;
 }
 
 uint32_t mask(size_t h, size_t l) {
@@ -1,6 +1,10 @@
 #ifndef __UTILS_H
 #define __UTILS_H
 
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
 #include <string>
 
 uint32_t mask(size_t h, size_t l);
@@ -10,4 +14,77 @@ uint32_t bitsv(uint32_t lw, size_t h, size_t l);
 
 std::string format(const char* format, ...);
 
-#endif
\ No newline at end of file
+// uppercase hex into out, which has room for the digits; each returns the end
+inline char* put_hex(char* out, uint32_t value, unsigned digits) {
+    static constexpr char hexDigits[] = "0123456789ABCDEF";
+    for(unsigned i=digits; i-- > 0; value >>= 4) out[i] = hexDigits[value & 0xf];
+    return out + digits;
+}
+inline char* put_hex8(char* out, uint8_t value) { return put_hex(out, value, 2); }
+inline char* put_hex16(char* out, uint16_t value) { return put_hex(out, value, 4); }
+inline char* put_hex32(char* out, uint32_t value) { return put_hex(out, value, 8); }
+
+/*
+    Text for an ostream gathered in a fixed buffer and written out when it
+    fills or the sink goes away, for output made per byte or per access:
+    no heap, and hex and decimal are written digit by digit. printf covers
+    the rest; one call writes at most CAPACITY - 1 characters.
+*/
+struct TextSink {
+    static constexpr size_t CAPACITY = 512;
+
+    std::ostream& ostr;
+    size_t length = 0;
+    char text[CAPACITY];
+
+    TextSink(std::ostream& ostr) : ostr(ostr) {}
+    ~TextSink() { flush(); }
+    TextSink(const TextSink&) = delete;
+    TextSink& operator=(const TextSink&) = delete;
+
+    void flush() {
+        ostr.write(text, length);
+        length = 0;
+    }
+    // room for n characters, n up to CAPACITY
+    inline char* room(size_t n) {
+        if(length + n > CAPACITY) flush();
+        return text + length;
+    }
+
+    inline TextSink& put(char c) {
+        *room(1) = c;
+        length++;
+        return *this;
+    }
+    inline TextSink& put(const char* s) { return put(s, strlen(s)); }
+    inline TextSink& put(const char* s, size_t n) {
+        while(n) {
+            size_t chunk = n < CAPACITY ? n : CAPACITY;
+            memcpy(room(chunk), s, chunk);
+            length += chunk;
+            s += chunk;
+            n -= chunk;
+        }
+        return *this;
+    }
+    inline TextSink& hex(uint32_t value, unsigned digits) {
+        length = put_hex(room(digits), value, digits) - text;
+        return *this;
+    }
+    inline TextSink& hex8(uint8_t value) { return hex(value, 2); }
+    inline TextSink& hex16(uint16_t value) { return hex(value, 4); }
+    inline TextSink& hex32(uint32_t value) { return hex(value, 8); }
+    inline TextSink& bin8(uint8_t value) {
+        char* out = room(8);
+        for(int i=0; i<8; i++) out[i] = '0' + (value >> (7 - i) & 1);
+        length += 8;
+        return *this;
+    }
+    // SS:AAAA
+    inline TextSink& address(uint8_t seg, uint16_t adr) { return hex8(seg).put(':').hex16(adr); }
+    TextSink& dec(uint64_t value);
+    TextSink& printf(const char* format, ...);
+};
+
+#endif
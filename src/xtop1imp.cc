@@ -12,8 +12,8 @@
     8 32-bit registers, x0..x7, overlapping w0..w3, overlapping d0, d2, d3
 */
 
-void xtop1_decodeAndExecute(Memory& ram, CPU& cpu) {
-    uint8_t opcode = cpu.fetchByte(ram);
+template<class T> void xtop1_decodeAndExecute(Memory& ram, CPU& cpu) {
+    uint8_t opcode = cpu.fetchByte<T>(ram);
     auto subop = bitsv(opcode, 7, 6);
     auto params = bitsv(opcode, 5, 0);
     auto rd = bitsv(opcode, 5, 3);
@@ -31,12 +31,12 @@ void xtop1_decodeAndExecute(Memory& ram, CPU& cpu) {
             auto SR = bitsv(opcode, 1, 0);
             break;
         }
-        default: { cpu.illegalInstruction(XTOP1, opcode); break; }
+        default: { cpu.illegalInstruction<T>(XTOP1, opcode); break; }
     }
 }
 
-void xtop1_trx_decodeAndExecute(Memory& ram, CPU& cpu) {
-    uint8_t opcode = cpu.fetchByte(ram);
+template<class T> void xtop1_trx_decodeAndExecute(Memory& ram, CPU& cpu) {
+    uint8_t opcode = cpu.fetchByte<T>(ram);
     auto subop = bitsv(opcode, 7, 7);
     auto dir = bitsv(opcode, 6, 6);
     auto d8r = bitsv(opcode, 5, 3);
@@ -58,16 +58,16 @@ void xtop1_trx_decodeAndExecute(Memory& ram, CPU& cpu) {
                 else cpu.set_registerSS(cpu.register8(d8r));
                 break;
             }
-            default: { cpu.illegalInstruction(XTOP1_TRX, opcode); break; }
+            default: { cpu.illegalInstruction<T>(XTOP1_TRX, opcode); break; }
         }
     } else {
-        cpu.illegalInstruction(XTOP1_TRX, opcode);
+        cpu.illegalInstruction<T>(XTOP1_TRX, opcode);
     }
 }
 
-void xtop1_math_decodeAndExecute(Memory& ram, CPU& cpu) {
+template<class T> void xtop1_math_decodeAndExecute(Memory& ram, CPU& cpu) {
     // 0xd2 cf ddd sss
-    uint8_t xop = cpu.fetchByte(ram);
+    uint8_t xop = cpu.fetchByte<T>(ram);
     auto const_flag = bitsv(xop, 7, 7);
     auto f = bitsv(xop, 6, 6);
     auto rd = bitsv(xop, 5, 3);
@@ -75,20 +75,22 @@ void xtop1_math_decodeAndExecute(Memory& ram, CPU& cpu) {
     auto vd = cpu.register8(rd);
     auto vs = cpu.register8(rs);
     uint8_t con = 0;
-    if(const_flag) con = cpu.fetchByte(ram); // read constant
+    if(const_flag) con = cpu.fetchByte<T>(ram); // read constant
     uint8_t res = 0;
+    uint8_t operand = (rs == rd) ? con : vs + con;
     if(f == 0) {
-        res = (rs == rd) ? vd + con : vd + vs + con;
+        res = vd + operand;
     } else {
-        res = (rs == rd) ? vd - con : vd - vs - con; 
+        res = vd - operand;
+        operand = ~operand;
     }
     cpu.set_register8(rd, res);
-    cpu.set_flags(NF_Mask | ZF_Mask | CF_Mask | OF_Mask, 8, res, vd);
+    cpu.set_flags(NF_Mask | ZF_Mask | CF_Mask | OF_Mask, 8, res, vd, operand);
     cpu.cycle();  
 }
 
-void xtop1_stor_decodeAndExecute(Memory& ram, CPU& cpu) {
-    uint8_t xop = cpu.fetchByte(ram);
+template<class T> void xtop1_stor_decodeAndExecute(Memory& ram, CPU& cpu) {
+    uint8_t xop = cpu.fetchByte<T>(ram);
     // xop: 00 iii rrr +1 : store r to zp address within DS with index register i
     //      01 iii rrr +2 : store r to word address within DS with index register i
     //      10 iii rrr +3 : store r to 24-bit address with index register i
@@ -101,23 +103,23 @@ void xtop1_stor_decodeAndExecute(Memory& ram, CPU& cpu) {
     switch(addr_mode) {
         case 0: { // DS:ZP,rI
             seg = cpu.DS;
-            addr = cpu.fetchByte(ram);            
+            addr = cpu.fetchByte<T>(ram);            
             break;
         }
         case 1: { // DS:ABS.W,rI
-            addr = cpu.fetchWord(ram);
+            addr = cpu.fetchWord<T>(ram);
             break;
         }
         case 2: {// SEG:ABS.w,rI
-            addr = cpu.fetchWord(ram);
-            seg = cpu.fetchByte(ram);
+            addr = cpu.fetchWord<T>(ram);
+            seg = cpu.fetchByte<T>(ram);
             break;
         }
         case 3:
         default: {
             seg = cpu.SS;
             addr = cpu.SP;
-            auto off = cpu.fetchByte(ram);
+            auto off = cpu.fetchByte<T>(ram);
             addr += static_cast<int8_t>(off);
             cpu.cycle();
             break;
@@ -127,5 +129,26 @@ void xtop1_stor_decodeAndExecute(Memory& ram, CPU& cpu) {
         addr += static_cast<int8_t>(cpu.register8(ri));
         cpu.cycle();
     }
-    cpu.writeByte(ram, seg, addr, cpu.register8(rs));
+    cpu.writeByte<T>(ram, seg, addr, cpu.register8(rs));
 }
+
+template void xtop1_decodeAndExecute<NoTrace>(Memory& ram, CPU& cpu);
+template void xtop1_trx_decodeAndExecute<NoTrace>(Memory& ram, CPU& cpu);
+template void xtop1_math_decodeAndExecute<NoTrace>(Memory& ram, CPU& cpu);
+template void xtop1_stor_decodeAndExecute<NoTrace>(Memory& ram, CPU& cpu);
+template void xtop1_decodeAndExecute<Trace>(Memory& ram, CPU& cpu);
+template void xtop1_trx_decodeAndExecute<Trace>(Memory& ram, CPU& cpu);
+template void xtop1_math_decodeAndExecute<Trace>(Memory& ram, CPU& cpu);
+template void xtop1_stor_decodeAndExecute<Trace>(Memory& ram, CPU& cpu);
+template void xtop1_decodeAndExecute<RecordTrace>(Memory& ram, CPU& cpu);
+template void xtop1_trx_decodeAndExecute<RecordTrace>(Memory& ram, CPU& cpu);
+template void xtop1_math_decodeAndExecute<RecordTrace>(Memory& ram, CPU& cpu);
+template void xtop1_stor_decodeAndExecute<RecordTrace>(Memory& ram, CPU& cpu);
+template void xtop1_decodeAndExecute<CountOps>(Memory& ram, CPU& cpu);
+template void xtop1_trx_decodeAndExecute<CountOps>(Memory& ram, CPU& cpu);
+template void xtop1_math_decodeAndExecute<CountOps>(Memory& ram, CPU& cpu);
+template void xtop1_stor_decodeAndExecute<CountOps>(Memory& ram, CPU& cpu);
+template void xtop1_decodeAndExecute<Profile>(Memory& ram, CPU& cpu);
+template void xtop1_trx_decodeAndExecute<Profile>(Memory& ram, CPU& cpu);
+template void xtop1_math_decodeAndExecute<Profile>(Memory& ram, CPU& cpu);
+template void xtop1_stor_decodeAndExecute<Profile>(Memory& ram, CPU& cpu);
@@ -6,9 +6,9 @@
 #include "memory.h"
 #include "cpu65x.h"
 
-void xtop1_decodeAndExecute(Memory& ram, CPU& cpu);
-void xtop1_trx_decodeAndExecute(Memory& ram, CPU& cpu);
-void xtop1_math_decodeAndExecute(Memory& ram, CPU& cpu);
-void xtop1_stor_decodeAndExecute(Memory& ram, CPU& cpu);
+template<class T> void xtop1_decodeAndExecute(Memory& ram, CPU& cpu);
+template<class T> void xtop1_trx_decodeAndExecute(Memory& ram, CPU& cpu);
+template<class T> void xtop1_math_decodeAndExecute(Memory& ram, CPU& cpu);
+template<class T> void xtop1_stor_decodeAndExecute(Memory& ram, CPU& cpu);
 
 #endif
\ No newline at end of file
@@ -2,8 +2,8 @@
 #include "cpu65xops.h"
 #include "utils.h"
 
-void xtop2_decodeAndExecute(Memory& ram, CPU& cpu) {
-   uint8_t xop = cpu.fetchByte(ram);
+template<class T> void xtop2_decodeAndExecute(Memory& ram, CPU& cpu) {
+   uint8_t xop = cpu.fetchByte<T>(ram);
     auto subop = bitsv(xop, 7, 6);
     auto rd = bitsv(xop, 5, 3);
     auto rs = bitsv(xop, 2, 0);
@@ -40,13 +40,13 @@ void xtop2_decodeAndExecute(Memory& ram, CPU& cpu) {
             cpu.cycle();
             break;
         }
-        default: { cpu.illegalInstruction(XTOP2, xop); break; }
+        default: { cpu.illegalInstruction<T>(XTOP2, xop); break; }
     }
 }
 
-void xtop2_math_decodeAndExecute(Memory& ram, CPU& cpu) {
+template<class T> void xtop2_math_decodeAndExecute(Memory& ram, CPU& cpu) {
     // 0xd2 cf ddd sss
-    uint8_t xop = cpu.fetchByte(ram);
+    uint8_t xop = cpu.fetchByte<T>(ram);
     auto const_flag = bitsv(xop, 7, 7);
     auto f = bitsv(xop, 6, 6);
     auto rd = bitsv(xop, 5, 3);
@@ -54,20 +54,22 @@ void xtop2_math_decodeAndExecute(Memory& ram, CPU& cpu) {
     auto vd = cpu.register16(rd);
     auto vs = cpu.register16(rs);
     uint16_t con = 0;
-    if(const_flag) con = cpu.fetchWord(ram); // read constant
+    if(const_flag) con = cpu.fetchWord<T>(ram); // read constant
     uint16_t res = 0;
+    uint16_t operand = (rs == rd) ? con : vs + con;
     if(f == 0) {
-        res = (rs == rd) ? vd + con : vd + vs + con;
+        res = vd + operand;
     } else {
-        res = (rs == rd) ? vd - con : vd - vs - con; 
+        res = vd - operand;
+        operand = ~operand;
     }
     cpu.set_register16(rd, res);
-    cpu.set_flags(NF_Mask | ZF_Mask | CF_Mask | OF_Mask, 16, res, vd);
+    cpu.set_flags(NF_Mask | ZF_Mask | CF_Mask | OF_Mask, 16, res, vd, operand);
     cpu.cycle();  
 }
 
-void xtop2_stor_decodeAndExecute(Memory& ram, CPU& cpu) {
-    uint8_t xop = cpu.fetchByte(ram);
+template<class T> void xtop2_stor_decodeAndExecute(Memory& ram, CPU& cpu) {
+    uint8_t xop = cpu.fetchByte<T>(ram);
     // xop: 00 iii rrr +1 : store r to zp address within DS with index register i
     //      01 iii rrr +2 : store r to word address within DS with index register i
     //      10 iii rrr +3 : store r to 24-bit address with index register i
@@ -79,22 +81,22 @@ void xtop2_stor_decodeAndExecute(Memory& ram, CPU& cpu) {
     uint16_t addr = 0;
     switch(addr_mode) {
         case 0: { // DS:ZP,rI
-            addr = cpu.fetchByte(ram);
+            addr = cpu.fetchByte<T>(ram);
             break;
         }
         case 1: { // DS:ABS.W,rI
-            addr = cpu.fetchWord(ram);
+            addr = cpu.fetchWord<T>(ram);
             break;
         }
         case 2: {// SEG:ABS.w,rI
-            seg = cpu.fetchByte(ram);
-            addr = cpu.fetchWord(ram);
+            seg = cpu.fetchByte<T>(ram);
+            addr = cpu.fetchWord<T>(ram);
             break;
         }
         case 3:
         default: {
             seg = cpu.SS;
-            addr = cpu.fetchWord(ram);
+            addr = cpu.fetchWord<T>(ram);
             break;
         }
     }
@@ -102,6 +104,16 @@ void xtop2_stor_decodeAndExecute(Memory& ram, CPU& cpu) {
         addr += static_cast<int8_t>(cpu.register16(ri));
         cpu.cycle();
     }
-    cpu.writeByte(ram, seg, addr, cpu.register16(rs));
+    cpu.writeByte<T>(ram, seg, addr, cpu.register16(rs));
 }
 
+template void xtop2_decodeAndExecute<NoTrace>(Memory& ram, CPU& cpu);
+template void xtop2_math_decodeAndExecute<NoTrace>(Memory& ram, CPU& cpu);
+template void xtop2_decodeAndExecute<Trace>(Memory& ram, CPU& cpu);
+template void xtop2_math_decodeAndExecute<Trace>(Memory& ram, CPU& cpu);
+template void xtop2_decodeAndExecute<RecordTrace>(Memory& ram, CPU& cpu);
+template void xtop2_math_decodeAndExecute<RecordTrace>(Memory& ram, CPU& cpu);
+template void xtop2_decodeAndExecute<CountOps>(Memory& ram, CPU& cpu);
+template void xtop2_math_decodeAndExecute<CountOps>(Memory& ram, CPU& cpu);
+template void xtop2_decodeAndExecute<Profile>(Memory& ram, CPU& cpu);
+template void xtop2_math_decodeAndExecute<Profile>(Memory& ram, CPU& cpu);
@@ -4,7 +4,7 @@
 #include "memory.h"
 #include "cpu65x.h"
 
-void xtop2_decodeAndExecute(Memory& ram, CPU& cpu);
-void xtop2_math_decodeAndExecute(Memory& ram, CPU& cpu);
+template<class T> void xtop2_decodeAndExecute(Memory& ram, CPU& cpu);
+template<class T> void xtop2_math_decodeAndExecute(Memory& ram, CPU& cpu);
 
 #endif
\ No newline at end of file
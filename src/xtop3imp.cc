@@ -4,8 +4,8 @@
 #include "utils.h"
 #include "xutils.h"
 
-void xtop3_decodeAndExecute(Memory& ram, CPU& cpu) {
-    uint8_t xop = cpu.fetchByte(ram);
+template<class T> void xtop3_decodeAndExecute(Memory& ram, CPU& cpu) {
+    uint8_t xop = cpu.fetchByte<T>(ram);
     auto subop = bitsv(xop, 7, 6);
     auto rd = bitsv(xop, 5, 3);
     auto rs = bitsv(xop, 2, 0);
@@ -42,13 +42,13 @@ void xtop3_decodeAndExecute(Memory& ram, CPU& cpu) {
             cpu.cycle();
             break;
         }
-        default: { cpu.illegalInstruction(XTOP3, xop); break; }
+        default: { cpu.illegalInstruction<T>(XTOP3, xop); break; }
     }
 }
 
-void xtop3_math_decodeAndExecute(Memory& ram, CPU& cpu) {
+template<class T> void xtop3_math_decodeAndExecute(Memory& ram, CPU& cpu) {
     // 0xd4 cf ddd sss
-    uint8_t xop = cpu.fetchByte(ram);
+    uint8_t xop = cpu.fetchByte<T>(ram);
     auto const_flag = bitsv(xop, 7, 7);
     auto f = bitsv(xop, 6, 6);
     auto rd = bitsv(xop, 5, 3);
@@ -57,21 +57,23 @@ void xtop3_math_decodeAndExecute(Memory& ram, CPU& cpu) {
     auto vs = cpu.register32(rs);
     uint32_t con = 0;
     if(const_flag) {
-        con = cpu.fetchLongWord(ram);
+        con = cpu.fetchLongWord<T>(ram);
     }
     uint32_t res = 0;
+    uint32_t operand = (rs == rd) ? con : vs + con;
     if(f == 0) {
-        res = (rs == rd) ? vd + con : vd + vs + con;
+        res = vd + operand;
     } else {
-        res = (rs == rd) ? vd - con : vd - vs - con; 
+        res = vd - operand;
+        operand = ~operand;
     }
     cpu.set_register32(rd, res);
-    cpu.set_flags(NF_Mask | ZF_Mask | CF_Mask | OF_Mask, 32, res, vd);
+    cpu.set_flags(NF_Mask | ZF_Mask | CF_Mask | OF_Mask, 32, res, vd, operand);
     cpu.cycle();  
 }
 
-void xtop3_stor_decodeAndExecute(Memory& ram, CPU& cpu) {
-    uint8_t xop = cpu.fetchByte(ram);
+template<class T> void xtop3_stor_decodeAndExecute(Memory& ram, CPU& cpu) {
+    uint8_t xop = cpu.fetchByte<T>(ram);
     // xop: 00 iii rrr +1 : store r to zp address within DS with index register i
     //      01 iii rrr +2 : store r to word address within DS with index register i
     //      10 iii rrr +3 : store r to 24-bit address with index register i
@@ -90,22 +92,22 @@ void xtop3_stor_decodeAndExecute(Memory& ram, CPU& cpu) {
     uint16_t addr = 0;
     switch(addr_mode) {
         case 0: { // DS:ZP,rI
-            addr = cpu.fetchByte(ram);
+            addr = cpu.fetchByte<T>(ram);
             break;
         }
         case 1: { // DS:ABS.W,rI
-            addr = cpu.fetchWord(ram);
+            addr = cpu.fetchWord<T>(ram);
             break;
         }
         case 2: {// SEG:ABS.w,rI
-            seg = cpu.fetchByte(ram);
-            addr = cpu.fetchWord(ram);
+            seg = cpu.fetchByte<T>(ram);
+            addr = cpu.fetchWord<T>(ram);
             break;
         }
         case 3:
         default: {
             seg = cpu.SS;
-            addr = cpu.fetchWord(ram);
+            addr = cpu.fetchWord<T>(ram);
             break;
         }
     }
@@ -113,11 +115,11 @@ void xtop3_stor_decodeAndExecute(Memory& ram, CPU& cpu) {
         addr += static_cast<int8_t>(cpu.register32(ri));
         cpu.cycle();
     }
-    cpu.writeByte(ram, seg, addr, cpu.register32(rs));
+    cpu.writeByte<T>(ram, seg, addr, cpu.register32(rs));
 }
 
-void xtop3_regind_decodeAndExecute(Memory& ram, CPU& cpu) {
-    uint8_t xop = cpu.fetchByte(ram);
+template<class T> void xtop3_regind_decodeAndExecute(Memory& ram, CPU& cpu) {
+    uint8_t xop = cpu.fetchByte<T>(ram);
     // store r to register indirect
     // 0 mm SS rrr (implied)
     //                       : st (SS:Wr)
@@ -141,7 +143,7 @@ void xtop3_regind_decodeAndExecute(Memory& ram, CPU& cpu) {
     bool writeIndex = (mm == 2 || mm == 3);
     
     if(f == 1) {
-        uint8_t xop2 = cpu.fetchByte(ram);
+        uint8_t xop2 = cpu.fetchByte<T>(ram);
         auto ri = bitsv(xop2,7,5);
         idx = cpu.register16(ri);
         con = static_cast<int8_t>(static_cast<uint8_t>(bitsv(xop2,4,0)));
@@ -154,7 +156,7 @@ void xtop3_regind_decodeAndExecute(Memory& ram, CPU& cpu) {
         default: break;
     }
 
-    cpu.writeLongWord(ram, seg, adr, cpu.register32(rs));
+    cpu.writeLongWord<T>(ram, seg, adr, cpu.register32(rs));
 
     if(writeIndex) {
         // write index value back
@@ -162,3 +164,19 @@ void xtop3_regind_decodeAndExecute(Memory& ram, CPU& cpu) {
         cpu.cycle();
     }
 }
+
+template void xtop3_decodeAndExecute<NoTrace>(Memory& ram, CPU& cpu);
+template void xtop3_math_decodeAndExecute<NoTrace>(Memory& ram, CPU& cpu);
+template void xtop3_regind_decodeAndExecute<NoTrace>(Memory& ram, CPU& cpu);
+template void xtop3_decodeAndExecute<Trace>(Memory& ram, CPU& cpu);
+template void xtop3_math_decodeAndExecute<Trace>(Memory& ram, CPU& cpu);
+template void xtop3_regind_decodeAndExecute<Trace>(Memory& ram, CPU& cpu);
+template void xtop3_decodeAndExecute<RecordTrace>(Memory& ram, CPU& cpu);
+template void xtop3_math_decodeAndExecute<RecordTrace>(Memory& ram, CPU& cpu);
+template void xtop3_regind_decodeAndExecute<RecordTrace>(Memory& ram, CPU& cpu);
+template void xtop3_decodeAndExecute<CountOps>(Memory& ram, CPU& cpu);
+template void xtop3_math_decodeAndExecute<CountOps>(Memory& ram, CPU& cpu);
+template void xtop3_regind_decodeAndExecute<CountOps>(Memory& ram, CPU& cpu);
+template void xtop3_decodeAndExecute<Profile>(Memory& ram, CPU& cpu);
+template void xtop3_math_decodeAndExecute<Profile>(Memory& ram, CPU& cpu);
+template void xtop3_regind_decodeAndExecute<Profile>(Memory& ram, CPU& cpu);
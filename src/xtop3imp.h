@@ -4,8 +4,8 @@
 #include "memory.h"
 #include "cpu65x.h"
 
-void xtop3_decodeAndExecute(Memory& ram, CPU& cpu);
-void xtop3_math_decodeAndExecute(Memory& ram, CPU& cpu);
-void xtop3_regind_decodeAndExecute(Memory& ram, CPU& cpu);
+template<class T> void xtop3_decodeAndExecute(Memory& ram, CPU& cpu);
+template<class T> void xtop3_math_decodeAndExecute(Memory& ram, CPU& cpu);
+template<class T> void xtop3_regind_decodeAndExecute(Memory& ram, CPU& cpu);
 
 #endif 
\ No newline at end of file
@@ -22,21 +22,23 @@ uint8_t getImpliedIndex(uint8_t rs) {
 }
 
 void x_dump_regs_info(std::ostream& ostr, Memory& ram, CPU& cpu) {
-    ostr << format("PC=%02X:%04X SP=%02X:%04X P=%02X", cpu.PS, cpu.PC, cpu.SS, cpu.SP, cpu.P.asByte());
-    ostr << " (" << std::bitset<8>(cpu.P.asByte()) << ")" << std::endl;
+    TextSink out(ostr);
+    x_dump_regs_info(out, ram, cpu);
+}
+
+void x_dump_regs_info(TextSink& out, Memory& ram, CPU& cpu) {
+    out.put("PC=").address(cpu.PS, cpu.PC).put(" SP=").address(cpu.SS, cpu.SP);
+    out.put(" P=").hex8(cpu.P.asByte()).put(" (").bin8(cpu.P.asByte()).put(")\n");
     for(int i=0; i<8; i++) {
-        if(i) ostr << " ";
-        ostr << format("d%d=%02X", i, cpu.register8(i));
+        out.put(i ? " d" : "d").put('0' + i).put('=').hex8(cpu.register8(i));
     }
-    ostr << std::endl;
+    out.put('\n');
     for(int i=0; i<8; i++) {
-        if(i) ostr << " ";
-        ostr << format("w%d=%04X", i, cpu.register16(i));
+        out.put(i ? " w" : "w").put('0' + i).put('=').hex16(cpu.register16(i));
     }
-    ostr << std::endl;
+    out.put('\n');
     for(int i=0; i<8; i++) {
-        if(i) ostr << " ";
-        ostr << format("x%d=%08X", i, cpu.reg32[i]);
+        out.put(i ? " x" : "x").put('0' + i).put('=').hex32(cpu.reg32[i]);
     }
-    ostr << std::endl;
+    out.put('\n');
 }
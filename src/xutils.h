@@ -13,5 +13,6 @@ uint8_t getSegmentByIndex(const CPU& cpu, SegmentRegisterIndex index);
 uint8_t getImpliedIndex(uint8_t rs);
 
 void x_dump_regs_info(std::ostream& ostr, Memory& ram, CPU& cpu);
+void x_dump_regs_info(TextSink& out, Memory& ram, CPU& cpu);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,115 @@
+#include <cstdint>
+#include <vector>
+#include <catch2/catch_test_macros.hpp>
+
+#include "memory.h"
+#include "cpu65x.h"
+#include "cpu65xops.h"
+#include "batch.h"
+
+#include "test_utils.h"
+
+/*
+    0300: LDA #$00       0307: ADC $11
+    0302: LDX $10        0309: DEX
+    0304: BEQ $030C      030A: BNE $0306
+    0306: CLC            030C: STA $12
+                         030E: BRK
+*/
+static void load_program(Memory& ram, CPU& cpu, uint8_t count, uint8_t addend, uint8_t op = ADC_ZeroPage) {
+    ram.init();
+    ram.program(0, 0xfffc, {0x00, 0x03});
+    ram.program(0, 0x0300, {
+        LDA_Immediate, 0x00,
+        LDX_ZeroPage, 0x10,
+        BEQ, 0x06,
+        CLC,
+        op, 0x11,
+        DEX,
+        BNE, 0xfa,
+        STA_ZeroPage, 0x12,
+        BRK
+    });
+    ram.write(0, 0x10, count);
+    ram.write(0, 0x11, addend);
+    cpu.haltOnBRK = true;
+}
+
+struct Lane {
+    Memory ram;
+    CPU cpu;
+};
+
+// runs the lanes as a batch and each again alone, and checks they end the same
+static void check_against_alone(CpuBatch& batch, std::vector<Lane>& lanes,
+        const std::vector<uint8_t>& counts, const std::vector<uint8_t>& ops, uint64_t n) {
+    batch.run_for_cycles(n);
+    for(unsigned l=0; l<lanes.size(); l++) {
+        Lane alone;
+        load_program(alone.ram, alone.cpu, counts[l], l + 1, ops[l]);
+        auto stop = alone.cpu.run_for_cycles(alone.ram, n);
+        auto& cpu = lanes[l].cpu;
+        REQUIRE( batch.stop[l].cause == stop.cause );
+        REQUIRE( batch.stop[l].pc == stop.pc );
+        REQUIRE( batch.stop[l].cycles == stop.cycles );
+        REQUIRE( batch.stop[l].instructions == stop.instructions );
+        REQUIRE( cpu.PC == alone.cpu.PC );
+        REQUIRE( cpu.A() == alone.cpu.A() );
+        REQUIRE( cpu.X() == alone.cpu.X() );
+        REQUIRE( cpu.P.asByte() == alone.cpu.P.asByte() );
+        REQUIRE( cpu.OP == alone.cpu.OP );
+        REQUIRE( cpu.opCC == alone.cpu.opCC );
+        REQUIRE( lanes[l].ram.read(0, 0x12) == alone.ram.read(0, 0x12) );
+    }
+}
+
+TEST_CASE( "lanes on the same path run in lockstep and match running alone", "[batch]" ) {
+    std::vector<Lane> lanes(CpuBatch::LANES);
+    std::vector<uint8_t> counts(lanes.size(), 100), ops(lanes.size(), ADC_ZeroPage);
+    CpuBatch batch;
+    for(unsigned l=0; l<lanes.size(); l++) {
+        load_program(lanes[l].ram, lanes[l].cpu, counts[l], l + 1);
+        REQUIRE( batch.add(lanes[l].cpu, lanes[l].ram) == l );
+    }
+    check_against_alone(batch, lanes, counts, ops, 100000);
+    for(unsigned l=0; l<lanes.size(); l++) {
+        REQUIRE( batch.stop[l].cause == StopBRK );
+        REQUIRE( lanes[l].ram.read(0, 0x12) == uint8_t(100 * (l + 1)) );
+    }
+    // all but the BRKs together
+    REQUIRE( batch.scalarInstructions == lanes.size() );
+    REQUIRE( batch.lockstepInstructions > 400 * lanes.size() );
+
+    Lane extra;
+    REQUIRE_THROWS( batch.add(extra.cpu, extra.ram) );
+}
+
+TEST_CASE( "lanes that branch apart meet again and match running alone", "[batch]" ) {
+    std::vector<Lane> lanes(8);
+    std::vector<uint8_t> counts = {0, 1, 2, 3, 40, 40, 40, 50};
+    std::vector<uint8_t> ops(lanes.size(), ADC_ZeroPage);
+    ops[5] = SBC_ZeroPage; // different code at the same address
+    CpuBatch batch;
+    for(unsigned l=0; l<lanes.size(); l++) {
+        load_program(lanes[l].ram, lanes[l].cpu, counts[l], l + 1, ops[l]);
+        batch.add(lanes[l].cpu, lanes[l].ram);
+    }
+    check_against_alone(batch, lanes, counts, ops, 100000);
+    REQUIRE( batch.lockstepInstructions > batch.scalarInstructions );
+}
+
+TEST_CASE( "each lane stops on its own budget", "[batch]" ) {
+    std::vector<Lane> lanes(4);
+    std::vector<uint8_t> counts = {3, 250, 250, 250};
+    std::vector<uint8_t> ops(lanes.size(), ADC_ZeroPage);
+    CpuBatch batch;
+    for(unsigned l=0; l<lanes.size(); l++) {
+        load_program(lanes[l].ram, lanes[l].cpu, counts[l], l + 1);
+        batch.add(lanes[l].cpu, lanes[l].ram);
+    }
+    lanes[2].cpu.lazyFlags = true;
+    check_against_alone(batch, lanes, counts, ops, 501);
+    REQUIRE( batch.stop[0].cause == StopBRK );
+    REQUIRE( batch.stop[1].cause == StopBudget );
+    REQUIRE( lanes[1].cpu.cycles >= 501 );
+}
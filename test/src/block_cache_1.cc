@@ -0,0 +1,119 @@
+#include <cstdint>
+#include <catch2/catch_test_macros.hpp>
+
+#include "memory.h"
+#include "cpu65x.h"
+#include "cpu65xops.h"
+
+#include "test_utils.h"
+
+static void run_loop(Memory& ram, CPU& cpu, ExecutionEngine engine) {
+    init_segment_with_program(ram, {0}, 0, 0x300, {
+        LDY_Immediate, 0x03,
+        LDX_Immediate, 0x10,
+        TXA,
+        ADC_ZeroPage, 0x10,
+        STA_AbsoluteX, 0x00, 0x20,
+        DEX,
+        BNE, 0xf7,
+        DEY,
+        BNE, 0xf3,
+        XTOP3_MATH, 0x80, 0xef, 0xbe, 0xad, 0xde, // add.l %x0, #$deadbeef
+        BRK
+    });
+    ram.write(0, 0x10, 0x05);
+    cpu.tracing = false;
+    cpu.engine = engine;
+    cpu.reset(ram);
+    cpu.execute_until_break(ram);
+}
+
+TEST_CASE( "block cache matches the interpreter", "[blocks]" ) {
+    Memory ram1, ram2;
+    ram1.init();
+    ram2.init();
+    CPU interp, cached;
+
+    run_loop(ram1, interp, Interpreted);
+    run_loop(ram2, cached, Cached);
+
+    REQUIRE( cached.state == interp.state );
+    REQUIRE( cached.PC == interp.PC );
+    REQUIRE( cached.SP == interp.SP );
+    REQUIRE( cached.P.asByte() == interp.P.asByte() );
+    REQUIRE( cached.cycles == interp.cycles );
+    REQUIRE( cached.instructions == interp.instructions );
+    REQUIRE( cached.OP == BRK );
+    for(int i=0; i<8; i++) {
+        REQUIRE( cached.reg32[i] == interp.reg32[i] );
+    }
+    for(int adr=0x2000; adr<0x2020; adr++) {
+        REQUIRE( ram2.read(0, adr) == ram1.read(0, adr) );
+    }
+}
+
+TEST_CASE( "writes to cached code drop the block", "[blocks]" ) {
+    Memory ram;
+    ram.init();
+    CPU cpu;
+    cpu.tracing = false;
+    cpu.engine = Cached;
+
+    // the first pass rewrites the LDA at $0300 into an LDY
+    init_segment_with_program(ram, {0}, 0, 0x300, {
+        LDA_Immediate, 0x11,
+        STA_ZeroPageX, 0x40,
+        LDA_Immediate, LDY_Immediate,
+        STA_Absolute, 0x00, 0x03,
+        INX,
+        CPX_Immediate, 0x02,
+        BNE, 0xf2,
+        BRK
+    });
+    cpu.reset(ram);
+    cpu.execute_until_break(ram);
+
+    REQUIRE( ram.read(0, 0x40) == 0x11 );
+    REQUIRE( ram.read(0, 0x41) == LDY_Immediate );
+    REQUIRE( cpu.Y() == 0x11 );
+
+    // reloading a program drops the blocks decoded from the old one
+    ram.program(0, 0x300, {
+        LDA_Immediate, 0x77,
+        STA_ZeroPage, 0x50,
+        BRK
+    });
+    cpu.reset(ram);
+    cpu.execute_until_break(ram);
+
+    REQUIRE( ram.read(0, 0x50) == 0x77 );
+}
+
+TEST_CASE( "a dropped block leaves no key on the other pages it spans", "[blocks]" ) {
+    Memory ram;
+    ram.init();
+    // $03FC: NOP, LDA #$00, STA $10, INX, RTS runs on into page $04
+    ram.program(0, 0x3fc, {NOP, LDA_Immediate, 0x00, STA_ZeroPage, 0x10, INX, RTS});
+    auto& cache = ram.blockCache();
+    uint32_t first = Memory::page(0, 0x0300), second = Memory::page(0, 0x0400);
+
+    for(int i=0; i<100; i++) {
+        auto block = cache.lookup(ram, 0, 0x3fc);
+        REQUIRE( block->pages.size() == 2 );
+        REQUIRE( cache.pageBlocks[first].size() == 1 );
+        REQUIRE( cache.pageBlocks[second].size() == 1 );
+        // patch the immediate operand, the way self-modifying code would
+        ram.write(0, 0x3fe, i);
+        REQUIRE( cache.blocks.empty() );
+        REQUIRE( cache.pageBlocks.count(second) == 0 );
+        REQUIRE( cache.codePage[second] == 0 );
+    }
+
+    // two blocks sharing the pages are listed once each, and go together
+    cache.lookup(ram, 0, 0x3fc);
+    cache.lookup(ram, 0, 0x3fd);
+    REQUIRE( cache.pageBlocks[second].size() == 2 );
+    ram.write(0, 0x400, NOP);
+    REQUIRE( cache.blocks.empty() );
+    REQUIRE( cache.pageBlocks.empty() );
+}
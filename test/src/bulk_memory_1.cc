@@ -0,0 +1,129 @@
+#include <cstdint>
+#include <vector>
+#include <catch2/catch_test_macros.hpp>
+
+#include "memory.h"
+#include "cpu65x.h"
+#include "cpu65xops.h"
+
+#include "test_utils.h"
+
+// a device that counts its accesses and reads back the low byte of the address
+struct Echo : MemoryDevice {
+    unsigned reads = 0;
+    unsigned writes = 0;
+    uint8_t read(uint8_t seg, uint16_t adr) override {
+        reads++;
+        return adr & 0xff;
+    }
+    void write(uint8_t seg, uint16_t adr, uint8_t byte) override {
+        writes++;
+    }
+};
+
+TEST_CASE( "bulk operations wrap at the end of the segment", "[memory]" ) {
+    Memory ram;
+    ram.init();
+    std::vector<uint8_t> bytes(0x300);
+    for(size_t i=0; i<bytes.size(); i++) bytes[i] = i * 7;
+
+    ram.write_block(3, 0xff00, bytes.data(), bytes.size());
+    REQUIRE( ram.peek(3, 0xff00) == bytes[0] );
+    REQUIRE( ram.peek(3, 0xffff) == bytes[0xff] );
+    REQUIRE( ram.peek(3, 0x0000) == bytes[0x100] );
+    REQUIRE( ram.peek(3, 0x01ff) == bytes[0x2ff] );
+    REQUIRE( ram.peek(4, 0x0000) == 0 );
+
+    std::vector<uint8_t> out(bytes.size());
+    ram.read_block(3, 0xff00, out.data(), out.size());
+    REQUIRE( out == bytes );
+    REQUIRE( ram.compare(3, 0xff00, bytes.data(), bytes.size()) == 0 );
+    bytes[0x2ff]++;
+    REQUIRE( ram.compare(3, 0xff00, bytes.data(), bytes.size()) < 0 );
+
+    ram.fill(3, 0xfffe, 0xaa, 4);
+    REQUIRE( ram.peek(3, 0xfffd) == bytes[0xfd] );
+    REQUIRE( ram.peek(3, 0xfffe) == 0xaa );
+    REQUIRE( ram.peek(3, 0x0001) == 0xaa );
+    REQUIRE( ram.peek(3, 0x0002) == bytes[0x102] );
+}
+
+TEST_CASE( "bulk copies may overlap", "[memory]" ) {
+    Memory ram;
+    ram.init();
+    ram.program(0, 0x1000, {1, 2, 3, 4, 5, 6});
+
+    ram.copy(0, 0x1002, 0, 0x1000, 4);
+    REQUIRE( ram.compare(0, 0x1000, std::vector<uint8_t>{1, 2, 1, 2, 3, 4}.data(), 6) == 0 );
+    ram.copy(0, 0x1000, 0, 0x1001, 5);
+    REQUIRE( ram.compare(0, 0x1000, std::vector<uint8_t>{2, 1, 2, 3, 4, 4}.data(), 6) == 0 );
+
+    // across the wrap and into another segment
+    ram.program(1, 0xfffe, {7, 8, 9, 10});
+    ram.copy(1, 0xffff, 1, 0xfffe, 4);
+    REQUIRE( ram.compare(1, 0xfffe, std::vector<uint8_t>{7, 7, 8, 9, 10}.data(), 5) == 0 );
+    ram.copy(2, 0x0000, 1, 0xfffe, 5, BulkRaw);
+    REQUIRE( ram.compare(2, 0x0000, std::vector<uint8_t>{7, 7, 8, 9, 10}.data(), 5) == 0 );
+    REQUIRE( ram.dirtyPage[Memory::page(2, 0)] == 0 );
+}
+
+TEST_CASE( "bulk operations honor the memory map unless raw", "[memory]" ) {
+    Memory ram;
+    Echo echo;
+    ram.init();
+    ram.map_rom(0, 0xc100, 0x100);
+    ram.map_device(0, 0xc200, 0x100, &echo);
+    ram.snapshot();
+
+    // RAM, ROM and device pages in one run
+    ram.fill(0, 0xc0f0, 0x5a, 0x220);
+    REQUIRE( ram.peek(0, 0xc0f0) == 0x5a );
+    REQUIRE( ram.peek(0, 0xc100) == 0x00 );
+    REQUIRE( ram.peek(0, 0xc200) == 0x00 );
+    REQUIRE( echo.writes == 0x100 );
+    REQUIRE( ram.dirtyPage[Memory::page(0, 0xc000)] == 1 );
+    REQUIRE( ram.dirtyPage[Memory::page(0, 0xc100)] == 0 );
+    REQUIRE( ram.dirtyPage[Memory::page(0, 0xc200)] == 0 );
+
+    uint8_t out[4];
+    ram.read_block(0, 0xc1ff, out, 4);
+    REQUIRE( out[0] == 0x00 );
+    REQUIRE( out[1] == 0x00 );
+    REQUIRE( out[3] == 0x02 );
+    REQUIRE( echo.reads == 3 );
+    uint8_t expect[2] = {0x10, 0x11};
+    REQUIRE( ram.compare(0, 0xc210, expect, 2) == 0 );
+    REQUIRE( echo.reads == 5 );
+
+    // raw goes past the map, and without BulkDirty leaves no marks
+    ram.snapshot();
+    ram.fill(0, 0xc100, 0x33, 0x200, BulkRaw);
+    REQUIRE( ram.peek(0, 0xc100) == 0x33 );
+    REQUIRE( ram.peek(0, 0xc2ff) == 0x33 );
+    REQUIRE( echo.writes == 0x100 );
+    REQUIRE( ram.snapshot().pages.empty() );
+    ram.read_block(0, 0xc200, out, 4, BulkRaw);
+    REQUIRE( out[0] == 0x33 );
+    REQUIRE( echo.reads == 5 );
+    ram.fill(0, 0xc100, 0x44, 1, BulkDirty);
+    REQUIRE( ram.snapshot().pages.size() == 1 );
+}
+
+TEST_CASE( "bulk writes drop the decoded blocks they overlap", "[memory]" ) {
+    Memory ram;
+    CPU cpu;
+    cpu.engine = Cached;
+    cpu.haltOnBRK = true;
+    ram.init();
+    ram.program(0, 0xfffc, {0x00, 0x03});
+    ram.program(0, 0x0300, {LDA_Immediate, 0x01, BRK});
+    cpu.reset(ram);
+    cpu.execute_until_break(ram);
+    REQUIRE( cpu.A() == 0x01 );
+
+    uint8_t patch = 0x02;
+    ram.write_block(0, 0x0301, &patch, 1, BulkRaw);
+    cpu.reset(ram);
+    cpu.execute_until_break(ram);
+    REQUIRE( cpu.A() == 0x02 );
+}
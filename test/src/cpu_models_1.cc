@@ -0,0 +1,67 @@
+#include <cstdint>
+#include <catch2/catch_test_macros.hpp>
+
+#include "memory.h"
+#include "cpu65x.h"
+#include "cpu65xops.h"
+
+#include "test_utils.h"
+
+TEST_CASE( "65c02 opcodes are illegal on a 6502", "[models]" ) {
+    Memory ram;
+    ram.init();
+
+    CPU cpu;
+    cpu.tracing = false;
+    cpu.allow65c02 = false;
+    cpu.allow65x02 = false;
+    cpu.ignoreIllegalInstructions = false;
+    cpu.allowHalting = true;
+
+    init_segment_with_program(ram, {0}, 0, 0x300, {
+        LDA_Immediate, 0x40,
+        STA_ZeroPage, 0x10,
+        STZ_ZeroPage, 0x10
+    });
+
+    cpu.reset(ram);
+    cpu.execute_next_instruction(ram);
+    cpu.execute_next_instruction(ram);
+    cpu.execute_next_instruction(ram);
+
+    REQUIRE( cpu.state == Halt );
+    REQUIRE( ram.read(0, 0x10) == 0x40 );
+
+    cpu.allow65c02 = true;
+    cpu.reset(ram);
+    cpu.execute_next_instruction(ram);
+    cpu.execute_next_instruction(ram);
+    cpu.execute_next_instruction(ram);
+
+    REQUIRE( cpu.state == Normal );
+    REQUIRE( ram.read(0, 0x10) == 0x00 );
+}
+
+TEST_CASE( "65x02 opcodes are illegal without allow65x02", "[models]" ) {
+    Memory ram;
+    ram.init();
+
+    CPU cpu;
+    cpu.tracing = false;
+    cpu.allow65c02 = true;
+    cpu.allow65x02 = false;
+    cpu.ignoreIllegalInstructions = false;
+    cpu.allowHalting = true;
+
+    init_segment_with_program(ram, {0}, 0, 0x300, {
+        LDA_Immediate, 0x40,
+        XTOP1, 0x39 // %d7 <- %d1
+    });
+
+    cpu.reset(ram);
+    cpu.execute_next_instruction(ram);
+    cpu.execute_next_instruction(ram);
+
+    REQUIRE( cpu.state == Halt );
+    REQUIRE( cpu.register8(7) == 0x00 );
+}
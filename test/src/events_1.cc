@@ -0,0 +1,180 @@
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include <catch2/catch_test_macros.hpp>
+
+#include "memory.h"
+#include "cpu65x.h"
+#include "cpu65xops.h"
+#include "scheduler.h"
+
+#include "test_utils.h"
+
+struct Recorder : EventHandler {
+    std::vector<uint32_t> fired;
+    void fire(CPU& cpu, uint64_t when, uint32_t tag) override {
+        fired.push_back(tag);
+    }
+};
+
+TEST_CASE( "the scheduler hands out events by cycle, then by posting order", "[events]" ) {
+    EventScheduler events;
+    Recorder a, b;
+    events.post(30, &a, 1);
+    events.post(10, &a, 2);
+    events.post(20, &b, 3);
+    events.post(10, &b, 4);
+    events.post(40, &b, 5);
+    REQUIRE( events.next() == 10 );
+    REQUIRE( events.cancel(&b, 5) == 1 );
+
+    ScheduledEvent ev;
+    std::vector<uint32_t> order;
+    REQUIRE_FALSE( events.pop_due(9, ev) );
+    while(events.pop_due(25, ev)) order.push_back(ev.tag);
+    REQUIRE( order == std::vector<uint32_t>{2, 4, 3} );
+    REQUIRE( events.next() == 30 );
+
+    events.post(35, &b, 6);
+    events.rebase(32);
+    REQUIRE( events.pop_due(0, ev) );
+    REQUIRE( ev.tag == 1 );
+    REQUIRE( events.next() == 3 );
+    REQUIRE( events.cancel(&b) == 1 );
+    REQUIRE( events.empty() );
+    REQUIRE( events.next() == UINT64_MAX );
+}
+
+// raises IRQ line 0 every `period` cycles; a write to it acknowledges
+struct Timer : EventHandler, MemoryDevice {
+    CPU& cpu;
+    uint64_t period;
+    unsigned fired = 0;
+    uint64_t latency = 0; // most cycles between an event's cycle and its firing
+    Timer(CPU& cpu, uint64_t period) : cpu(cpu), period(period) {}
+    void fire(CPU& cpu, uint64_t when, uint32_t tag) override {
+        fired++;
+        latency = std::max(latency, cpu.cycles - when);
+        cpu.set_irq(0, true);
+        cpu.post_event(when + period, this);
+    }
+    uint8_t read(uint8_t seg, uint16_t adr) override { return 0; }
+    void write(uint8_t seg, uint16_t adr, uint8_t byte) override { cpu.set_irq(0, false); }
+};
+
+/*
+    0300: LDX #$00       0400: INY          0500: INC $10
+    0302: CLI (or SEI)   0401: STA $C000    0502: RTI
+    0303: INX            0404: RTI
+    0304: BNE $0303
+    0306: JMP $0303
+*/
+static void load_program(Memory& ram, Timer& timer, uint8_t interrupts) {
+    ram.init();
+    ram.program(0, 0xfffa, {0x00, 0x05, 0x00, 0x03, 0x00, 0x04});
+    ram.program(0, 0x0300, {LDX_Immediate, 0x00, interrupts, INX, BNE, 0xfd, JMP_Absolute, 0x03, 0x03});
+    ram.program(0, 0x0400, {INY, STA_Absolute, 0x00, 0xc0, RTI});
+    ram.program(0, 0x0500, {INC_ZeroPage, 0x10, RTI});
+    ram.map_device(0, 0xc000, 0x100, &timer);
+}
+
+TEST_CASE( "timed events raise IRQs the same way on every engine", "[events]" ) {
+    uint64_t cycles = 0;
+    uint32_t x = 0;
+    for(auto engine : {Interpreted, Threaded, Cached, Translated}) {
+        Memory ram;
+        CPU cpu;
+        Timer timer(cpu, 100);
+        load_program(ram, timer, CLI);
+        cpu.engine = engine;
+        cpu.reset(ram);
+        cpu.post_event(150, &timer);
+        cpu.run_for_cycles(ram, 20000);
+        REQUIRE( timer.fired == 199 );
+        // one IRQ a period, all handled, each at the next boundary
+        REQUIRE( cpu.Y() == timer.fired );
+        REQUIRE( timer.latency < 7 );
+        REQUIRE( cpu.SP == 0x1ff );
+        if(engine == Interpreted) {
+            cycles = cpu.cycles;
+            x = cpu.X();
+        }
+        REQUIRE( cpu.cycles == cycles );
+        REQUIRE( cpu.X() == x );
+    }
+}
+
+TEST_CASE( "IF holds IRQs back but not NMIs", "[events]" ) {
+    Memory ram;
+    CPU cpu;
+    Timer timer(cpu, 100);
+    load_program(ram, timer, SEI);
+    cpu.reset(ram);
+    cpu.post_event(150, &timer);
+    cpu.run_for_cycles(ram, 1000);
+    REQUIRE( timer.fired == 9 );
+    REQUIRE( cpu.Y() == 0 );
+    REQUIRE( cpu.irqLines == 1 );
+
+    // taken before the next instruction, which is the handler's first
+    cpu.raise_nmi();
+    cpu.execute_next_instruction(ram);
+    REQUIRE( ram.read(0, 0x10) == 1 );
+    REQUIRE( cpu.PC == 0x0502 );
+    REQUIRE( cpu.SP == 0x1ff - 3 );
+    REQUIRE( cpu.P.IF == 1 );
+    REQUIRE( (ram.read(0, 0x1fd) & BF_Mask) == 0 );
+    cpu.execute_next_instruction(ram);
+    REQUIRE( cpu.SP == 0x1ff );
+    REQUIRE( cpu.nmiPending == false );
+}
+
+TEST_CASE( "CLI lets a held IRQ in at the next boundary", "[events]" ) {
+    Memory ram;
+    CPU cpu;
+    Timer timer(cpu, 100);
+    load_program(ram, timer, CLI);
+    cpu.reset(ram);
+    cpu.P.IF = 1; // reset leaves it clear
+    cpu.set_irq(0, true);
+    // LDX, CLI, then INY in the handler instead of INX
+    auto stop = cpu.run_for_instructions(ram, 3);
+    REQUIRE( stop.instructions == 3 );
+    REQUIRE( cpu.Y() == 1 );
+    REQUIRE( cpu.X() == 0 );
+    REQUIRE( cpu.PC == 0x0401 );
+    REQUIRE( ram.read(0, 0x1fe) == 0x03 );
+    REQUIRE( ram.read(0, 0x1ff) == 0x03 );
+}
+
+TEST_CASE( "RTI returns to the segments the IRQ was taken in", "[events]" ) {
+    for(auto engine : {Interpreted, Threaded, Cached, Translated}) {
+        Memory ram;
+        CPU cpu;
+        Timer timer(cpu, 100);
+        load_program(ram, timer, CLI);
+        ram.program(3, 0x0300, {LDX_Immediate, 0x00, CLI, INX, BNE, 0xfd, JMP_Absolute, 0x03, 0x03});
+        cpu.engine = engine;
+        cpu.reset(ram);
+        cpu.P.IF = 1;
+        cpu.set_registerPS(3);
+        cpu.set_registerDS(4);
+        cpu.set_registerSS(5);
+        cpu.set_irq(0, true);
+        // LDX, CLI, then INY, STA $C000 and RTI in the handler in segment 0
+        cpu.run_for_instructions(ram, 5);
+        REQUIRE( cpu.Y() == 1 );
+        REQUIRE( cpu.PC == 0x0303 );
+        REQUIRE( cpu.registerPS() == 3 );
+        REQUIRE( cpu.registerDS() == 4 );
+        REQUIRE( cpu.registerSS() == 5 );
+        REQUIRE( cpu.SP == 0x1ff );
+        // the frame went on the interrupted stack
+        REQUIRE( ram.read(5, 0x1ff) == 0x03 );
+        REQUIRE( ram.read(5, 0x1fe) == 0x03 );
+        REQUIRE( cpu.numSegmentFrames == 0 );
+        cpu.run_for_instructions(ram, 3);
+        REQUIRE( cpu.X() == 2 );
+        REQUIRE( cpu.registerPS() == 3 );
+    }
+}
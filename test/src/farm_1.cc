@@ -0,0 +1,108 @@
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include <catch2/catch_test_macros.hpp>
+
+#include "memory.h"
+#include "cpu65x.h"
+#include "cpu65xops.h"
+#include "farm.h"
+
+#include "test_utils.h"
+
+/*
+    0300: LDY #passes    0307: INC $10
+    0302: LDX #$00       0309: DEY
+    0304: DEX            030A: BNE $0302
+    0305: BNE $0304      030C: BRK
+*/
+static void load_program(Memory& ram, CPU& cpu, uint8_t passes, ExecutionEngine engine) {
+    ram.init();
+    ram.program(0, 0xfffc, {0x00, 0x03});
+    ram.program(0, 0x0300, {
+        LDY_Immediate, passes,
+        LDX_Immediate, 0x00,
+        DEX,
+        BNE, 0xfd,
+        INC_ZeroPage, 0x10,
+        DEY,
+        BNE, 0xf6,
+        BRK
+    });
+    cpu.engine = engine;
+    cpu.haltOnBRK = true;
+}
+
+static const ExecutionEngine engines[] = {Interpreted, Threaded, Cached, Translated};
+
+TEST_CASE( "the farm runs every instance to its stop on a pool of threads", "[farm]" ) {
+    VmFarm farm(4);
+    farm.quantum = 2000;
+    std::atomic<unsigned> done(0);
+    std::vector<unsigned> calls(48);
+    for(unsigned i=0; i<48; i++) {
+        auto& inst = farm.add();
+        REQUIRE( inst.id == i );
+        load_program(inst.ram, inst.cpu, 1 + i % 13, engines[i % 4]);
+        inst.done = [&](VmInstance& inst) {
+            calls[inst.id]++;
+            done++;
+        };
+    }
+    auto stats = farm.run();
+    REQUIRE( done == 48 );
+
+    uint64_t cycles = 0, instructions = 0, slices = 0;
+    for(auto& inst : farm.instances) {
+        REQUIRE( calls[inst->id] == 1 );
+        REQUIRE( inst->finished );
+        REQUIRE( !inst->error );
+        REQUIRE( inst->stop.cause == StopBRK );
+        REQUIRE( inst->ram.read(0, 0x10) == 1 + inst->id % 13 );
+
+        // the same as running it alone, in one go
+        Memory ram;
+        CPU cpu;
+        load_program(ram, cpu, 1 + inst->id % 13, engines[inst->id % 4]);
+        auto stop = cpu.run_for_cycles(ram, 1 << 30);
+        REQUIRE( inst->cycles == stop.cycles );
+        REQUIRE( inst->instructions == stop.instructions );
+        REQUIRE( inst->cpu.cycles == cpu.cycles );
+
+        cycles += inst->cycles;
+        instructions += inst->instructions;
+        slices += inst->slices;
+    }
+    REQUIRE( stats.instances == 48 );
+    REQUIRE( stats.cycles == cycles );
+    REQUIRE( stats.instructions == instructions );
+    REQUIRE( stats.slices == slices );
+    REQUIRE( stats.slices > 48 );
+    REQUIRE( stats.steals <= stats.slices );
+
+    // nothing left to run
+    auto again = farm.run();
+    REQUIRE( again.slices == stats.slices );
+    REQUIRE( done == 48 );
+}
+
+TEST_CASE( "the farm stops an instance once its cycle limit runs out", "[farm]" ) {
+    VmFarm farm(2);
+    farm.quantum = 1000;
+    auto& spinning = farm.add();
+    spinning.ram.init();
+    spinning.ram.program(0, 0xfffc, {0x00, 0x03});
+    spinning.ram.program(0, 0x0300, {JMP_Absolute, 0x00, 0x03});
+    spinning.cycleLimit = 10000;
+    auto& finishing = farm.add();
+    load_program(finishing.ram, finishing.cpu, 2, Cached);
+
+    farm.run();
+    REQUIRE( spinning.finished );
+    REQUIRE( spinning.stop.cause == StopBudget );
+    REQUIRE( spinning.cycles >= 10000 );
+    REQUIRE( spinning.cycles < 10000 + 8 );
+    REQUIRE( spinning.slices >= 10 );
+    REQUIRE( finishing.stop.cause == StopBRK );
+    REQUIRE( finishing.ram.read(0, 0x10) == 2 );
+}
@@ -33,3 +33,57 @@ TEST_CASE( "set N and Z flags", "[flags]" ) {
     test_value_32(cpu, 0x7fffffff, 0, 0);
 }
 
+
+TEST_CASE( "set V flag on signed overflow", "[flags]" ) {
+    CPU cpu;
+    cpu.init();
+    // 8-bit: v1 = v2 + addend
+    cpu.set_flags(OF_Mask, 8, 0x50 + 0x50, 0x50, 0x50);
+    REQUIRE( cpu.P.OF == 1 );
+    cpu.set_flags(OF_Mask, 8, 0x50 + 0x10, 0x50, 0x10);
+    REQUIRE( cpu.P.OF == 0 );
+    cpu.set_flags(OF_Mask, 8, 0xd0 + 0x90, 0xd0, 0x90);
+    REQUIRE( cpu.P.OF == 1 );
+    // subtraction passes the complemented operand: 0x50 - 0xb0
+    cpu.set_flags(OF_Mask, 8, 0xa0, 0x50, (uint8_t)~0xb0);
+    REQUIRE( cpu.P.OF == 1 );
+    cpu.set_flags(OF_Mask, 8, 0xf0, 0x50, (uint8_t)~0x60);
+    REQUIRE( cpu.P.OF == 0 );
+    // 16 and 32 bits
+    cpu.set_flags(OF_Mask, 16, 0x8000, 0x7fff, 0x0001);
+    REQUIRE( cpu.P.OF == 1 );
+    cpu.set_flags(OF_Mask, 32, 0x80000000, 0x7fffffff, 0x00000001);
+    REQUIRE( cpu.P.OF == 1 );
+    cpu.set_flags(OF_Mask, 32, 0x7fffffff, 0x7ffffffe, 0x00000001);
+    REQUIRE( cpu.P.OF == 0 );
+}
+
+TEST_CASE( "lazy flags match eager flags", "[flags]" ) {
+    CPU eager, lazy;
+    eager.init();
+    lazy.init();
+    lazy.lazyFlags = true;
+    const struct { uint8_t flags; size_t size; unsigned v1, v2, addend; } cases[] = {
+        { NF_Mask | ZF_Mask | CF_Mask | OF_Mask, 8, 0x50 + 0x50, 0x50, 0x50 },
+        { NF_Mask | ZF_Mask, 8, 0x00, 0, 0 },
+        { NF_Mask | ZF_Mask | CF_Mask, 8, 0xffffffff, 0x05, 0 }, // CMP 5 with 6
+        { ZF_Mask, 8, 0x01, 0, 0 },
+        { NF_Mask | ZF_Mask | CF_Mask | OF_Mask, 16, 0x8000, 0x7fff, 0x0001 },
+        { NF_Mask | ZF_Mask | CF_Mask | OF_Mask, 32, 0x00000000, 0xffffffff, 0x00000001 },
+    };
+    for(auto& c : cases) {
+        eager.set_flags(c.flags, c.size, c.v1, c.v2, c.addend);
+        lazy.set_flags(c.flags, c.size, c.v1, c.v2, c.addend);
+        REQUIRE( lazy.P.asByte() == eager.P.asByte() );
+    }
+    // a flag left pending by an earlier op survives later ops that do not set it
+    lazy.set_flags(NF_Mask | ZF_Mask | CF_Mask, 8, 0x06 - 0x05, 0x06, 0);
+    eager.set_flags(NF_Mask | ZF_Mask | CF_Mask, 8, 0x06 - 0x05, 0x06, 0);
+    lazy.set_flags(NF_Mask | ZF_Mask, 8, 0x80, 0);
+    eager.set_flags(NF_Mask | ZF_Mask, 8, 0x80, 0);
+    REQUIRE( lazy.P.pending != 0 );
+    REQUIRE( lazy.P.zero() == eager.P.ZF );
+    REQUIRE( lazy.P.carry() == eager.P.CF );
+    REQUIRE( lazy.P.asByte() == eager.P.asByte() );
+    REQUIRE( lazy.P.pending == 0 );
+}
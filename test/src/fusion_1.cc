@@ -0,0 +1,94 @@
+#include <cstdint>
+#include <vector>
+#include <catch2/catch_test_macros.hpp>
+
+#include "memory.h"
+#include "cpu65x.h"
+#include "cpu65xops.h"
+
+#include "test_utils.h"
+
+static const std::vector<uint8_t> program = {
+    LDY_Immediate, 0x00,
+    LDX_Immediate, 0x08,
+    LDA_ZeroPage, 0x10,         // 0304
+    STA_Absolute, 0x00, 0x20,
+    ADC_ZeroPage, 0x10,
+    STA_ZeroPage, 0x10,
+    CMP_Immediate, 0x40,
+    BEQ, 0x01,
+    DEX,
+    BNE, 0xf0,                  // to 0304
+    INY,
+    CPY_Immediate, 0x04,
+    BNE, 0xe9,                  // to 0302
+    BRK
+};
+
+static void load(Memory& ram, CPU& cpu, bool fuse) {
+    ram.init();
+    init_segment_with_program(ram, {0}, 0, 0x300, program);
+    ram.write(0, 0x10, 0x03);
+    cpu.tracing = false;
+    cpu.engine = Cached;
+    cpu.fuseInstructions = fuse;
+    cpu.reset(ram);
+}
+
+static void require_same(CPU& plain, CPU& fused) {
+    REQUIRE( fused.state == plain.state );
+    REQUIRE( fused.PC == plain.PC );
+    REQUIRE( fused.P.asByte() == plain.P.asByte() );
+    REQUIRE( fused.cycles == plain.cycles );
+    REQUIRE( fused.instructions == plain.instructions );
+    REQUIRE( fused.opPC == plain.opPC );
+    REQUIRE( fused.opCC == plain.opCC );
+    for(int i=0; i<8; i++) {
+        REQUIRE( fused.reg32[i] == plain.reg32[i] );
+    }
+}
+
+TEST_CASE( "fused runs match unfused execution", "[fusion]" ) {
+    Memory ram1, ram2;
+    CPU plain, fused;
+    load(ram1, plain, false);
+    load(ram2, fused, true);
+    plain.execute_until_break(ram1);
+    fused.execute_until_break(ram2);
+
+    require_same(plain, fused);
+    REQUIRE( ram2.read(0, 0x10) == ram1.read(0, 0x10) );
+    REQUIRE( ram2.read(0, 0x2000) == ram1.read(0, 0x2000) );
+
+    auto& runs = ram2.blockCache().fusionRuns;
+    auto fired = [&](uint8_t a, uint8_t b) {
+        for(size_t f=1; f<NUM_FUSIONS; f++) {
+            if(fusions[f].count == 2 && fusions[f].ops[0] == a && fusions[f].ops[1] == b) return runs[f];
+        }
+        return uint64_t(0);
+    };
+    REQUIRE( fired(DEX, BNE) > 0 );
+    REQUIRE( fired(LDA_ZeroPage, STA_Absolute) > 0 );
+    REQUIRE( fired(ADC_ZeroPage, STA_ZeroPage) > 0 );
+    REQUIRE( fired(CMP_Immediate, BEQ) > 0 );
+    REQUIRE( ram1.blockCache().fusionRuns[1] == 0 );
+}
+
+TEST_CASE( "fused runs respect the run budget", "[fusion]" ) {
+    Memory ram1, ram2;
+    CPU plain, fused;
+    load(ram1, plain, false);
+    load(ram2, fused, true);
+    for(uint64_t n : {1, 2, 3, 5, 8, 13, 21}) {
+        auto a = plain.run_for_instructions(ram1, n);
+        auto b = fused.run_for_instructions(ram2, n);
+        REQUIRE( b.instructions == a.instructions );
+        require_same(plain, fused);
+    }
+    for(uint64_t n : {2, 3, 7, 11, 40}) {
+        auto a = plain.run_for_cycles(ram1, n);
+        auto b = fused.run_for_cycles(ram2, n);
+        REQUIRE( b.cycles == a.cycles );
+        require_same(plain, fused);
+    }
+}
@@ -0,0 +1,165 @@
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <unistd.h>
+#include <catch2/catch_test_macros.hpp>
+
+#include "memory.h"
+#include "cpu65x.h"
+#include "cpu65xops.h"
+
+// a host file holding bytes, removed when it goes out of scope
+struct TempFile {
+    std::string path;
+    TempFile(const std::vector<uint8_t>& bytes) {
+        char name[] = "/tmp/image_1_XXXXXX";
+        int fd = mkstemp(name);
+        REQUIRE( fd >= 0 );
+        REQUIRE( write(fd, bytes.data(), bytes.size()) == (ssize_t)bytes.size() );
+        close(fd);
+        path = name;
+    }
+    ~TempFile() { unlink(path.c_str()); }
+    uint8_t byte(size_t at) {
+        FILE* f = fopen(path.c_str(), "rb");
+        fseek(f, at, SEEK_SET);
+        int c = fgetc(f);
+        fclose(f);
+        return c;
+    }
+};
+
+static std::vector<uint8_t> pattern(size_t n) {
+    std::vector<uint8_t> bytes(n);
+    for(size_t i=0; i<n; i++) bytes[i] = (i * 7 + 3) & 0xff;
+    return bytes;
+}
+
+TEST_CASE( "a page-aligned image is mapped copy-on-write", "[image]" ) {
+    auto bytes = pattern(0x1800);
+    TempFile file(bytes);
+    Memory ram;
+    ram.init();
+    ram.write(2, 0x2900, 0xaa); // inside the last host page, past the end of the file
+    REQUIRE( ram.load_image(file.path.c_str(), 2, 0x1000) == bytes.size() );
+    REQUIRE( ram.images.size() == 1 );
+    for(size_t i=0; i<bytes.size(); i++) {
+        REQUIRE( ram.read(2, 0x1000 + i) == bytes[i] );
+    }
+    REQUIRE( ram.read(2, 0x2900) == 0 );
+
+    ram.write(2, 0x1000, 0xee);
+    REQUIRE( ram.read(2, 0x1000) == 0xee );
+    REQUIRE( file.byte(0) == bytes[0] );
+
+    // a second instance sees the file, not the first instance's writes
+    Memory other;
+    other.init();
+    other.load_image(file.path.c_str(), 2, 0x1000);
+    REQUIRE( other.read(2, 0x1000) == bytes[0] );
+
+    ram.init();
+    REQUIRE( ram.images.empty() );
+    REQUIRE( ram.read(2, 0x1000) == 0 );
+    REQUIRE( ram.read(2, 0x17ff) == 0 );
+}
+
+TEST_CASE( "an image runs on into the next segment", "[image]" ) {
+    auto bytes = pattern(0x2000);
+    TempFile file(bytes);
+    Memory ram;
+    ram.init();
+    ram.load_image(file.path.c_str(), 4, 0xf000);
+    REQUIRE( ram.read(4, 0xf000) == bytes[0] );
+    REQUIRE( ram.read(4, 0xffff) == bytes[0xfff] );
+    REQUIRE( ram.read(5, 0x0000) == bytes[0x1000] );
+    REQUIRE( ram.read(5, 0x0fff) == bytes[0x1fff] );
+    REQUIRE_THROWS_AS( ram.load_image(file.path.c_str(), 255, 0xf000), std::length_error );
+    REQUIRE_THROWS_AS( ram.load_image("/nonexistent/image.bin", 0, 0), std::runtime_error );
+}
+
+TEST_CASE( "a ROM image drops writes", "[image]" ) {
+    auto bytes = pattern(0x100);
+    TempFile file(bytes);
+    Memory ram;
+    ram.init();
+    ram.load_image(file.path.c_str(), 0, 0xf000, true);
+    REQUIRE( ram.pageType[Memory::page(0, 0xf000)] == PageROM );
+    ram.write(0, 0xf010, 0x00);
+    REQUIRE( ram.read(0, 0xf010) == bytes[0x10] );
+    REQUIRE_THROWS_AS( ram.program(0, 0xf010, {0x00}), std::invalid_argument );
+    ram.init();
+    REQUIRE( ram.pageType[Memory::page(0, 0xf000)] == PageRAM );
+    ram.program(0, 0xf010, {0x01});
+    REQUIRE( ram.read(0, 0xf010) == 0x01 );
+}
+
+TEST_CASE( "raw bulk writes refuse a read-only image", "[image][bulk]" ) {
+    auto bytes = pattern(0x1000);
+    TempFile file(bytes);
+    Memory ram;
+    ram.init();
+    ram.load_image(file.path.c_str(), 3, 0x4000, true);
+    std::vector<uint8_t> zeros(0x20);
+
+    // the run starts in RAM and ends in the image; nothing is written
+    REQUIRE_THROWS_AS( ram.write_block(3, 0x3ff0, zeros.data(), zeros.size(), BulkRaw), std::invalid_argument );
+    REQUIRE( ram.read(3, 0x3ff0) == 0 );
+    REQUIRE_THROWS_AS( ram.fill(3, 0x4800, 0xff, 0x10, BulkRaw), std::invalid_argument );
+    REQUIRE_THROWS_AS( ram.copy(3, 0x4000, 3, 0x0000, 0x10, BulkRaw), std::invalid_argument );
+    REQUIRE( ram.compare(3, 0x4000, bytes.data(), bytes.size(), BulkRaw) == 0 );
+
+    // through the map the image's pages are ROM and drop the writes
+    ram.write_block(3, 0x3ff0, std::vector<uint8_t>(0x20, 0xee).data(), 0x20);
+    ram.fill(3, 0x4800, 0xff, 0x10);
+    REQUIRE( ram.read(3, 0x3ff0) == 0xee );
+    REQUIRE( ram.compare(3, 0x4000, bytes.data(), bytes.size()) == 0 );
+
+    // once remapped as RAM the image is stored to again, and refused
+    ram.map_ram(3, 0x4000, 0x100);
+    REQUIRE_THROWS_AS( ram.fill(3, 0x4000, 0xff, 0x10), std::invalid_argument );
+}
+
+TEST_CASE( "a mapped ROM image stays out of snapshots", "[image][snapshot]" ) {
+    auto bytes = pattern(0x1000);
+    TempFile file(bytes);
+    Memory ram;
+    ram.init();
+    ram.write(0, 0xe010, 0x55);
+    auto before = ram.snapshot();
+    REQUIRE( before.find(Memory::page(0, 0xe000)) != nullptr );
+
+    ram.load_image(file.path.c_str(), 0, 0xe000, true);
+    REQUIRE( ram.images.size() == 1 );
+    ram.write(0, 0x0200, 0x66);
+    auto after = ram.snapshot();
+    REQUIRE( after.find(Memory::page(0, 0xe000)) == nullptr );
+    REQUIRE( after.find(Memory::page(0, 0x0200)) != nullptr );
+
+    // neither snapshot writes through the read-only mapping
+    ram.restore(after);
+    ram.restore(before);
+    REQUIRE( ram.read(0, 0xe010) == bytes[0x10] );
+    REQUIRE( ram.read(0, 0x0200) == 0x66 );
+    REQUIRE( ram.dirtyPage[Memory::page(0, 0xe000)] == 0 );
+}
+
+TEST_CASE( "an unaligned image is read in and runs", "[image]" ) {
+    TempFile file({
+        LDA_Immediate, 0x42,
+        STA_ZeroPage, 0x10,
+        BRK
+    });
+    Memory ram;
+    CPU cpu;
+    ram.init();
+    ram.program(0x00, 0xfffa, {0x00, 0x03, 0x00, 0x03, 0x00, 0x03});
+    REQUIRE( ram.load_image(file.path.c_str(), 0, 0x0300) == 5 );
+    REQUIRE( ram.images.empty() );
+    cpu.tracing = false;
+    cpu.reset(ram);
+    cpu.execute_until_break(ram);
+    REQUIRE( ram.read(0, 0x10) == 0x42 );
+}
@@ -0,0 +1,161 @@
+#include <cstdint>
+#include <vector>
+#include <catch2/catch_test_macros.hpp>
+
+#include "memory.h"
+#include "cpu65x.h"
+#include "cpu65xops.h"
+#include "jit65x.h"
+
+#include "test_utils.h"
+
+static void run_program(Memory& ram, CPU& cpu, ExecutionEngine engine, const std::vector<uint8_t>& program) {
+    ram.init();
+    init_segment_with_program(ram, {0}, 0, 0x300, program);
+    ram.write(0, 0x10, 0x05);
+    ram.write(0, 0x11, 0x80);
+    ram.write(0, 0x2345, 0xfe);
+    cpu.tracing = false;
+    cpu.engine = engine;
+    cpu.reset(ram);
+    cpu.execute_until_break(ram);
+}
+
+static void require_same(Memory& ram1, CPU& interp, Memory& ram2, CPU& translated) {
+    REQUIRE( translated.state == interp.state );
+    REQUIRE( translated.PC == interp.PC );
+    REQUIRE( translated.SP == interp.SP );
+    REQUIRE( translated.P.asByte() == interp.P.asByte() );
+    REQUIRE( translated.cycles == interp.cycles );
+    REQUIRE( translated.instructions == interp.instructions );
+    REQUIRE( translated.opPC == interp.opPC );
+    REQUIRE( translated.opCC == interp.opCC );
+    for(int i=0; i<8; i++) {
+        REQUIRE( translated.reg32[i] == interp.reg32[i] );
+    }
+    for(int adr=0; adr<0x400; adr++) {
+        REQUIRE( ram2.read(0, adr) == ram1.read(0, adr) );
+    }
+    REQUIRE( ram2.read(0, 0x2345) == ram1.read(0, 0x2345) );
+}
+
+TEST_CASE( "translated blocks match the interpreter", "[jit]" ) {
+    // every translated opcode, in loops hot enough to be translated
+    std::vector<uint8_t> program = {
+        LDY_Immediate, 0x30,
+        LDX_Immediate, 0x00,
+        TXA,                        // 0304: inner loop
+        CLC,
+        ADC_ZeroPage, 0x10,
+        SEC,
+        SBC_Immediate, 0x03,
+        EOR_Absolute, 0x45, 0x23,
+        ORA_Immediate, 0x01,
+        AND_ZeroPage, 0x11,
+        STA_ZeroPage, 0x20,
+        STX_Absolute, 0x21, 0x00,
+        STY_ZeroPage, 0x22,
+        INC_ZeroPage, 0x23,
+        DEC_Absolute, 0x24, 0x00,
+        CMP_Immediate, 0x80,
+        CPY_ZeroPage, 0x10,
+        LDA_Absolute, 0x45, 0x23,
+        TAY,
+        TYA,
+        LDY_ZeroPage, 0x22,
+        NOP,
+        INX,
+        CPX_Immediate, 0x40,
+        BNE, 0xd5,                  // to 0304
+        TAX,
+        DEY,
+        BPL, 0xcf,                  // to 0302 while Y is positive
+        BRK
+    };
+    Memory ram1, ram2;
+    CPU interp, translated;
+    run_program(ram1, interp, Interpreted, program);
+    run_program(ram2, translated, Translated, program);
+    require_same(ram1, interp, ram2, translated);
+    REQUIRE( translated.OP == BRK );
+}
+
+TEST_CASE( "translated blocks hand stores into code to the interpreter", "[jit]" ) {
+    Memory ram1, ram2;
+    CPU interp, translated;
+    for(auto ram : {&ram1, &ram2}) {
+        ram->init();
+        init_segment_with_program(*ram, {0}, 0, 0x300, {
+            LDX_Immediate, 0x00,
+            INX,                        // 0302: stores into code after one op
+            STX_Absolute, 0x01, 0x04,
+            JMP_Absolute, 0x00, 0x04
+        });
+        ram->program(0, 0x400, {
+            LDA_Immediate, 0x00,        // operand patched by 0303
+            JMP_Absolute, 0x00, 0x06
+        });
+        ram->program(0, 0x600, {
+            STA_Absolute, 0x01, 0x05,   // stores into code first thing
+            JMP_Absolute, 0x00, 0x05
+        });
+        ram->program(0, 0x500, {
+            STA_ZeroPage, 0x30,         // address patched by 0600
+            CPX_Immediate, 0x40,
+            BEQ, 0x03,
+            JMP_Absolute, 0x02, 0x03,
+            BRK
+        });
+    }
+    interp.engine = Interpreted;
+    translated.engine = Translated;
+    interp.reset(ram1);
+    translated.reset(ram2);
+    interp.execute_until_break(ram1);
+    translated.execute_until_break(ram2);
+
+    require_same(ram1, interp, ram2, translated);
+    for(int adr=0x400; adr<0x700; adr++) {
+        REQUIRE( ram2.read(0, adr) == ram1.read(0, adr) );
+    }
+    REQUIRE( translated.X() == 0x40 );
+    REQUIRE( ram2.read(0, 0x40) == 0x40 );
+    if(Jit::available()) {
+        REQUIRE( ram2.blockCache().lookup(ram2, 0, 0x302)->native != nullptr );
+        REQUIRE( ram2.blockCache().lookup(ram2, 0, 0x600)->native != nullptr );
+    }
+}
+
+TEST_CASE( "translated loops stop on the run budget", "[jit]" ) {
+    std::vector<uint8_t> program = {
+        LDX_Immediate, 0x00,
+        INX,                        // 0302
+        STX_ZeroPage, 0x30,
+        BNE, 0xfb,
+        DEY,
+        BNE, 0xf8,
+        BRK
+    };
+    Memory ram1, ram2;
+    CPU interp, translated;
+    ram1.init();
+    ram2.init();
+    init_segment_with_program(ram1, {0}, 0, 0x300, program);
+    init_segment_with_program(ram2, {0}, 0, 0x300, program);
+    interp.engine = Interpreted;
+    translated.engine = Translated;
+    interp.reset(ram1);
+    translated.reset(ram2);
+    for(uint64_t n : {1, 7, 50, 123, 1000, 5}) {
+        auto a = interp.run_for_instructions(ram1, n);
+        auto b = translated.run_for_instructions(ram2, n);
+        REQUIRE( b.instructions == a.instructions );
+        require_same(ram1, interp, ram2, translated);
+    }
+    for(uint64_t n : {3, 40, 999, 5000}) {
+        auto a = interp.run_for_cycles(ram1, n);
+        auto b = translated.run_for_cycles(ram2, n);
+        REQUIRE( b.cycles == a.cycles );
+        require_same(ram1, interp, ram2, translated);
+    }
+}
@@ -0,0 +1,85 @@
+#include <cstdint>
+#include <vector>
+#include <catch2/catch_test_macros.hpp>
+
+#include "memory.h"
+#include "cpu65x.h"
+#include "cpu65xops.h"
+
+#include "test_utils.h"
+
+// overflowing adds, a carry read by ROL after CMP, and P pushed every pass
+static const std::vector<uint8_t> program = {
+    LDX_Immediate, 0x20,
+    TXA,                        // 0302
+    ADC_ZeroPage, 0x10,
+    STA_ZeroPage, 0x10,
+    BVC, 0x02,
+    INC_ZeroPage, 0x20,         // counts passes that overflowed
+    CMP_Immediate, 0x80,
+    ROL_ZeroPage, 0x21,
+    PHP,
+    PLA,
+    STA_ZeroPageX, 0x40,
+    DEX,
+    BNE, 0xec,                  // to 0302
+    BRK
+};
+
+static void run_program(Memory& ram, CPU& cpu, ExecutionEngine engine, bool lazy) {
+    ram.init();
+    init_segment_with_program(ram, {0}, 0, 0x300, program);
+    ram.write(0, 0x10, 0x3b);
+    cpu.tracing = false;
+    cpu.engine = engine;
+    cpu.lazyFlags = lazy;
+    cpu.reset(ram);
+    cpu.execute_until_break(ram);
+}
+
+TEST_CASE( "lazy flags match eager flags on every engine", "[flags]" ) {
+    Memory ram1;
+    CPU eager;
+    run_program(ram1, eager, Interpreted, false);
+    // the program does overflow, so V is exercised
+    REQUIRE( ram1.read(0, 0x20) != 0 );
+    REQUIRE( ram1.read(0, 0x20) != 0x20 );
+
+    for(auto engine : {Interpreted, Threaded, Cached, Translated}) {
+        Memory ram2;
+        CPU lazy;
+        run_program(ram2, lazy, engine, true);
+        REQUIRE( lazy.P.pending == 0 );
+        REQUIRE( lazy.P.asByte() == eager.P.asByte() );
+        REQUIRE( lazy.PC == eager.PC );
+        REQUIRE( lazy.cycles == eager.cycles );
+        REQUIRE( lazy.instructions == eager.instructions );
+        for(int i=0; i<8; i++) {
+            REQUIRE( lazy.reg32[i] == eager.reg32[i] );
+        }
+        for(int adr=0; adr<0x100; adr++) {
+            REQUIRE( ram2.read(0, adr) == ram1.read(0, adr) );
+        }
+    }
+}
+
+TEST_CASE( "lazy flags are evaluated when a step returns", "[flags]" ) {
+    Memory ram;
+    CPU cpu;
+    ram.init();
+    init_segment_with_program(ram, {0}, 0, 0x300, {
+        LDA_Immediate, 0x70,
+        ADC_Immediate, 0x10,
+        BRK
+    });
+    cpu.tracing = false;
+    cpu.lazyFlags = true;
+    cpu.reset(ram);
+    cpu.execute_next_instruction(ram);
+    cpu.execute_next_instruction(ram);
+    REQUIRE( cpu.P.pending == 0 );
+    REQUIRE( cpu.A() == 0x80 );
+    REQUIRE( cpu.P.NF == 1 );
+    REQUIRE( cpu.P.OF == 1 );
+    REQUIRE( cpu.P.ZF == 0 );
+}
@@ -9,3 +9,32 @@ TEST_CASE( "read/write memory", "[memory]" ) {
     REQUIRE( ram.read(10, 1000) == 0xea );
 }    
 
+
+TEST_CASE( "re-init zeroes memory in place", "[memory]" ) {
+    Memory ram;
+    ram.init();
+    auto segments = ram.segments;
+    REQUIRE( ram.read(200, 0x1234) == 0 );
+    ram.write(0, 0x0200, 0x11);
+    ram.write(200, 0x1234, 0x22);
+    ram.write(255, 0xffff, 0x33);
+    ram.init();
+    REQUIRE( ram.segments == segments );
+    REQUIRE( ram.read(0, 0x0200) == 0 );
+    REQUIRE( ram.read(200, 0x1234) == 0 );
+    REQUIRE( ram.read(255, 0xffff) == 0 );
+}
+
+TEST_CASE( "a segment init leaves the others alone", "[memory]" ) {
+    Memory ram;
+    ram.init();
+    ram.write(3, 0x0000, 0x44);
+    ram.write(3, 0xffff, 0x45);
+    ram.write(4, 0x0000, 0x55);
+    ram.write(2, 0xffff, 0x66);
+    ram.segments[3].init();
+    REQUIRE( ram.read(3, 0x0000) == 0 );
+    REQUIRE( ram.read(3, 0xffff) == 0 );
+    REQUIRE( ram.read(4, 0x0000) == 0x55 );
+    REQUIRE( ram.read(2, 0xffff) == 0x66 );
+}
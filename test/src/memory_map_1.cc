@@ -0,0 +1,119 @@
+#include <cstdint>
+#include <vector>
+#include <catch2/catch_test_macros.hpp>
+
+#include "memory.h"
+#include "cpu65x.h"
+#include "cpu65xops.h"
+
+#include "test_utils.h"
+
+// a latch that counts its accesses and reads back 0x80 | the last byte written
+struct Latch : MemoryDevice {
+    unsigned reads = 0;
+    unsigned writes = 0;
+    uint16_t lastAdr = 0;
+    uint8_t value = 0;
+    uint8_t read(uint8_t seg, uint16_t adr) override {
+        reads++;
+        lastAdr = adr;
+        return 0x80 | value;
+    }
+    void write(uint8_t seg, uint16_t adr, uint8_t byte) override {
+        writes++;
+        lastAdr = adr;
+        value = byte;
+    }
+};
+
+TEST_CASE( "pages map to RAM, ROM or a device", "[memory]" ) {
+    Memory ram;
+    Latch latch;
+    ram.init();
+    ram.program(0, 0xe000, {0x11, 0x22});
+    ram.map_rom(0, 0xe000, 0x2000);
+    ram.map_device(0, 0xd000, 0x100, &latch);
+    REQUIRE( ram.mappedPages[0] == 0x21 );
+
+    ram.write(0, 0xe000, 0x99);
+    REQUIRE( ram.read(0, 0xe000) == 0x11 );
+    REQUIRE( ram.read(0, 0xe001) == 0x22 );
+
+    ram.write(0, 0xd005, 0x07);
+    REQUIRE( latch.writes == 1 );
+    REQUIRE( latch.lastAdr == 0xd005 );
+    REQUIRE( ram.read(0, 0xd0ff) == 0x87 );
+    REQUIRE( latch.reads == 1 );
+    REQUIRE( ram.peek(0, 0xd005) == 0x00 );
+
+    // the pages around the mapped ones stay RAM
+    ram.write(0, 0xcfff, 0x55);
+    ram.write(0, 0xd100, 0x66);
+    REQUIRE( ram.read(0, 0xcfff) == 0x55 );
+    REQUIRE( ram.read(0, 0xd100) == 0x66 );
+    REQUIRE( latch.reads == 1 );
+    REQUIRE( latch.writes == 1 );
+
+    ram.map_ram(0, 0xe000, 0x2000);
+    ram.write(0, 0xe000, 0x99);
+    REQUIRE( ram.read(0, 0xe000) == 0x99 );
+    REQUIRE( ram.mappedPages[0] == 1 );
+
+    ram.init();
+    REQUIRE( ram.mappedPages[0] == 0 );
+    REQUIRE( ram.pageType[Memory::page(0, 0xd000)] == PageRAM );
+}
+
+static const std::vector<uint8_t> program = {
+    LDX_Immediate, 0x04,
+    LDA_Absolute, 0x00, 0xd0,   // 0302: device
+    STA_ZeroPage, 0x10,
+    INC_ZeroPage, 0x10,
+    LDA_ZeroPage, 0x10,
+    STA_Absolute, 0x00, 0xd0,   // device
+    STA_Absolute, 0x00, 0xe0,   // ROM
+    PHA,                        // stack page is a device
+    DEX,
+    BNE, 0xed,                  // to 0302
+    BRK
+};
+
+static void run_program(Memory& ram, CPU& cpu, Latch& latch, Latch& stack, ExecutionEngine engine) {
+    ram.init();
+    init_segment_with_program(ram, {0}, 0, 0x300, program);
+    ram.program(0, 0xe000, {0x5a});
+    ram.map_rom(0, 0xe000, 0x100);
+    ram.map_device(0, 0xd000, 0x100, &latch);
+    ram.map_device(0, 0x0100, 0x100, &stack);
+    cpu.tracing = false;
+    cpu.engine = engine;
+    cpu.reset(ram);
+    cpu.execute_until_break(ram);
+}
+
+TEST_CASE( "cpu accesses go through the memory map on every engine", "[memory]" ) {
+    Memory ram1;
+    CPU interp;
+    Latch latch1, stack1;
+    run_program(ram1, interp, latch1, stack1, Interpreted);
+    REQUIRE( latch1.reads == 4 );
+    REQUIRE( latch1.writes == 4 );
+    REQUIRE( stack1.writes == 4 + 3 ); // the pushes and BRK
+    REQUIRE( ram1.read(0, 0xe000) == 0x5a );
+    REQUIRE( ram1.peek(0, 0x01ff) == 0x00 );
+
+    for(auto engine : {Threaded, Cached, Translated}) {
+        Memory ram2;
+        CPU cpu;
+        Latch latch2, stack2;
+        run_program(ram2, cpu, latch2, stack2, engine);
+        REQUIRE( latch2.reads == latch1.reads );
+        REQUIRE( latch2.writes == latch1.writes );
+        REQUIRE( latch2.value == latch1.value );
+        REQUIRE( stack2.writes == stack1.writes );
+        REQUIRE( cpu.A() == interp.A() );
+        REQUIRE( cpu.cycles == interp.cycles );
+        REQUIRE( ram2.read(0, 0x10) == ram1.read(0, 0x10) );
+        REQUIRE( ram2.read(0, 0xe000) == 0x5a );
+    }
+}
@@ -0,0 +1,112 @@
+#include <algorithm>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <catch2/catch_test_macros.hpp>
+
+#include "memory.h"
+#include "cpu65x.h"
+#include "cpu65xops.h"
+#include "opstats.h"
+
+#include "test_utils.h"
+
+// LDX #0, then 256 times round XTOP1 39 (%d7 <- %d1), DEX, BNE, then BRK
+static StopReason count_loop(ExecutionEngine engine, OpStats& stats) {
+    Memory ram;
+    CPU cpu;
+    ram.init();
+    ram.program(0, 0xfffc, {0x00, 0x03});
+    ram.program(0, 0x0300, {
+        LDX_Immediate, 0x00,
+        XTOP1, 0x39,
+        DEX,
+        BNE, 0xfb,
+        BRK
+    });
+    cpu.engine = engine;
+    cpu.haltOnBRK = true;
+    cpu.opStats = &stats;
+    cpu.reset(ram);
+    auto stop = cpu.run_for_cycles(ram, 100000);
+    REQUIRE( stop.cause == StopBRK );
+    return stop;
+}
+
+TEST_CASE( "runs with op stats count every opcode and its cycles", "[stats]" ) {
+    for(auto engine : {Interpreted, Threaded, Cached, Translated}) {
+        OpStats stats;
+        auto stop = count_loop(engine, stats);
+        REQUIRE( stats.ops[LDX_Immediate].count == 1 );
+        REQUIRE( stats.ops[XTOP1].count == 256 );
+        REQUIRE( stats.ops[DEX].count == 256 );
+        REQUIRE( stats.ops[DEX].cycles == 256 * 2 );
+        REQUIRE( stats.ops[BNE].count == 256 );
+        REQUIRE( stats.ops[BRK].count == 1 );
+
+        uint64_t count = 0, cycles = 0;
+        for(auto& op : stats.ops) {
+            count += op.count;
+            cycles += op.cycles;
+        }
+        REQUIRE( count == stop.instructions );
+        REQUIRE( cycles == stop.cycles );
+
+        auto& sub = stats.subOps[stats.prefix[XTOP1]];
+        REQUIRE( sub[0x39].count == 256 );
+        REQUIRE( sub[0x39].cycles == stats.ops[XTOP1].cycles );
+        REQUIRE( stats.prefix[DEX] < 0 );
+    }
+}
+
+TEST_CASE( "op stats report the most cycles first", "[stats]" ) {
+    OpStats stats;
+    count_loop(Interpreted, stats);
+
+    std::ostringstream csv;
+    stats.report_csv(csv);
+    std::istringstream lines(csv.str());
+    std::string line;
+    std::getline(lines, line);
+    REQUIRE( line == "opcode,subop,count,cycles" );
+    std::vector<std::string> rows;
+    uint64_t last = UINT64_MAX;
+    while(std::getline(lines, line)) {
+        rows.push_back(line);
+        if(line[3] != ',') continue; // sub-opcode rows follow their prefix
+        auto cycles = std::stoull(line.substr(line.rfind(',') + 1));
+        REQUIRE( cycles <= last );
+        last = cycles;
+    }
+    REQUIRE( rows.size() == 6 );
+    auto xtop = std::find(rows.begin(), rows.end(), format("F2,,256,%llu", (unsigned long long)stats.ops[XTOP1].cycles));
+    REQUIRE( xtop != rows.end() );
+    REQUIRE( xtop[1] == format("F2,39,256,%llu", (unsigned long long)stats.ops[XTOP1].cycles) );
+
+    std::ostringstream text;
+    stats.report(text);
+    REQUIRE( text.str().rfind("opcode ", 0) == 0 );
+    REQUIRE( text.str().find("\n  F2 39 ") != std::string::npos );
+
+    stats.clear();
+    std::ostringstream empty;
+    stats.report_csv(empty);
+    REQUIRE( empty.str() == "opcode,subop,count,cycles\n" );
+}
+
+TEST_CASE( "op stats do not change the run", "[stats]" ) {
+    OpStats stats;
+    auto counted = count_loop(Threaded, stats);
+    Memory ram;
+    CPU cpu;
+    ram.init();
+    ram.program(0, 0xfffc, {0x00, 0x03});
+    ram.program(0, 0x0300, {LDX_Immediate, 0x00, XTOP1, 0x39, DEX, BNE, 0xfb, BRK});
+    cpu.engine = Threaded;
+    cpu.haltOnBRK = true;
+    cpu.reset(ram);
+    auto plain = cpu.run_for_cycles(ram, 100000);
+    REQUIRE( plain.cycles == counted.cycles );
+    REQUIRE( plain.instructions == counted.instructions );
+}
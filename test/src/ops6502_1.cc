@@ -143,3 +143,44 @@ TEST_CASE( "ADC", "[6502]" ) {
     REQUIRE( cpu.P.NF == 1 );
     REQUIRE( cpu.opCC == 5 );
 }
+
+TEST_CASE( "indexed logical ops", "[6502]" ) {
+    Memory ram;
+    ram.init();
+
+    CPU cpu;
+    cpu.tracing = false;
+    cpu.allow65c02 = false;
+    cpu.allow65x02 = false;
+
+    init_segment_with_program(ram, {0}, 0, 0x300, {
+        LDA_Immediate, 0xff,
+        LDX_Immediate, 0x01,
+        EOR_ZeroPageX, 0x00,
+        ORA_AbsoluteX, 0x00, 0x20,
+        AND_ZeroPageX, 0x01
+    });
+    ram.write(0, 0x01, 0x0f);
+    ram.write(0, 0x02, 0x21);
+    ram.write(0, 0x2001, 0x80);
+
+    cpu.reset(ram);
+    cpu.execute_next_instruction(ram);
+    cpu.execute_next_instruction(ram);
+    cpu.execute_next_instruction(ram);
+
+    REQUIRE( cpu.A() == 0xf0 );
+    REQUIRE( cpu.opCC == 4 );
+
+    cpu.execute_next_instruction(ram);
+
+    REQUIRE( cpu.A() == 0xf0 );
+    REQUIRE( cpu.P.NF == 1 );
+    REQUIRE( cpu.opCC == 4 );
+
+    cpu.execute_next_instruction(ram);
+
+    REQUIRE( cpu.A() == 0x20 );
+    REQUIRE( cpu.P.NF == 0 );
+    REQUIRE( cpu.opCC == 4 );
+}
@@ -0,0 +1,121 @@
+#include <cstdint>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <catch2/catch_test_macros.hpp>
+
+#include "memory.h"
+#include "cpu65x.h"
+#include "cpu65xops.h"
+#include "profiler.h"
+
+#include "test_utils.h"
+
+/*
+    0300 main:  JSR outer
+    0303        JSR inner
+    0306        BRK
+    0320 outer: LDX #$10
+    0322        JSR inner
+    0325        DEX
+    0326        BNE $0322
+    0328        RTS
+    0340 inner: LDY #$08
+    0342        DEY
+    0343        BNE $0342
+    0345        RTS
+*/
+static void load_calls(Memory& ram) {
+    ram.init();
+    ram.program(0, 0xfffc, {0x00, 0x03});
+    ram.program(0, 0x0300, {JSR_Absolute, 0x20, 0x03, JSR_Absolute, 0x40, 0x03, BRK});
+    ram.program(0, 0x0320, {LDX_Immediate, 0x10, JSR_Absolute, 0x40, 0x03, DEX, BNE, 0xfa, RTS});
+    ram.program(0, 0x0340, {LDY_Immediate, 0x08, DEY, BNE, 0xfd, RTS});
+}
+
+static const char* LABELS =
+    "; from ld65 -Ln\n"
+    "al 000300 .main\n"
+    "al C:0320 .outer\n"
+    "al 00:0340 .inner\n"
+    "al 000340 .inner_again\n";
+
+static uint64_t count(const std::string& folded, const std::string& stack) {
+    auto at = folded.find(stack + " ");
+    if(at == std::string::npos || (at > 0 && folded[at - 1] != '\n')) return 0;
+    return std::stoull(folded.substr(at + stack.size() + 1));
+}
+
+TEST_CASE( "the profiler samples the call stack every interval", "[profile]" ) {
+    for(auto engine : {Interpreted, Threaded, Cached, Translated}) {
+        Memory ram;
+        CPU cpu;
+        Profiler profiler(1);
+        load_calls(ram);
+        cpu.engine = engine;
+        cpu.haltOnBRK = true;
+        cpu.profiler = &profiler;
+        cpu.reset(ram);
+        auto stop = cpu.run_for_cycles(ram, 100000);
+        // a sample for every cycle an instruction ends on
+        REQUIRE( profiler.samples == stop.instructions );
+        REQUIRE( profiler.stack.size() == 1 ); // BRK's
+
+        std::ostringstream plain;
+        profiler.folded(plain);
+        // 17 passes through inner: LDY, 8 DEY and 8 BNE, RTS
+        REQUIRE( count(plain.str(), "root;00:0320;00:0340") == 16 * 18 );
+        REQUIRE( count(plain.str(), "root;00:0340") == 18 );
+        REQUIRE( count(plain.str(), "root;00:0320") == 2 + 16 * 3 );
+        REQUIRE( count(plain.str(), "root") == 3 );
+
+        std::istringstream labels(LABELS);
+        profiler.load_labels(labels);
+        REQUIRE( profiler.resolve(0x0343) == "inner" );
+        REQUIRE( profiler.resolve(0x0310) == "main" );
+        REQUIRE( profiler.resolve(0x010300) == "01:0300" );
+        std::ostringstream named;
+        profiler.folded(named);
+        REQUIRE( named.str() ==
+            "main 3\n"
+            "main;inner 18\n"
+            "main;outer 50\n"
+            "main;outer;inner 288\n" );
+    }
+}
+
+TEST_CASE( "the profiler drops frames whose return was discarded", "[profile]" ) {
+    // 0300: JSR 0310; 0310: PLA, PLA, JMP 0320; 0320: JSR 0330; 0330: RTS; 0323: BRK
+    Memory ram;
+    CPU cpu;
+    Profiler profiler(1);
+    ram.init();
+    ram.program(0, 0xfffc, {0x00, 0x03});
+    ram.program(0, 0x0300, {JSR_Absolute, 0x10, 0x03});
+    ram.program(0, 0x0310, {PLA, PLA, JMP_Absolute, 0x20, 0x03});
+    ram.program(0, 0x0320, {JSR_Absolute, 0x30, 0x03, BRK});
+    ram.program(0, 0x0330, {RTS});
+    cpu.haltOnBRK = true;
+    cpu.profiler = &profiler;
+    cpu.reset(ram);
+    cpu.execute_next_instruction(ram);
+    cpu.execute_next_instruction(ram);
+    cpu.execute_next_instruction(ram);
+    cpu.execute_next_instruction(ram);
+    REQUIRE( profiler.stack.size() == 1 );
+    // the JSR at 0320 goes where the dropped frame was, and replaces it
+    cpu.execute_next_instruction(ram);
+    REQUIRE( profiler.stack.size() == 1 );
+    REQUIRE( profiler.stack[0].target == 0x0330 );
+    cpu.execute_next_instruction(ram);
+    REQUIRE( profiler.stack.empty() );
+}
+
+TEST_CASE( "label files report their bad lines", "[profile]" ) {
+    Profiler profiler;
+    std::istringstream bad("al 0300 .main\nlabel 0310\n");
+    REQUIRE_THROWS_AS( profiler.load_labels(bad), std::invalid_argument );
+    std::istringstream badAddress("al 03zz .main\n");
+    REQUIRE_THROWS_AS( profiler.load_labels(badAddress), std::invalid_argument );
+    REQUIRE_THROWS_AS( profiler.load_labels("/nonexistent/labels"), std::runtime_error );
+}
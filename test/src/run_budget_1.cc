@@ -0,0 +1,116 @@
+#include <cstdint>
+#include <catch2/catch_test_macros.hpp>
+
+#include "memory.h"
+#include "cpu65x.h"
+#include "cpu65xops.h"
+
+#include "test_utils.h"
+
+static void load_loop(Memory& ram, CPU& cpu, ExecutionEngine engine) {
+    init_segment_with_program(ram, {0}, 0, 0x300, {
+        LDX_Immediate, 0x00,
+        DEX,
+        BNE, 0xfd,
+        BRK
+    });
+    cpu.tracing = false;
+    cpu.haltOnBRK = true;
+    cpu.engine = engine;
+    cpu.reset(ram);
+}
+
+TEST_CASE( "run_for_instructions stops on the budget", "[run]" ) {
+    for(auto engine : {Interpreted, Threaded}) {
+        Memory ram;
+        ram.init();
+        CPU cpu;
+        load_loop(ram, cpu, engine);
+
+        auto stop = cpu.run_for_instructions(ram, 10);
+        REQUIRE( stop.cause == StopBudget );
+        REQUIRE( stop.instructions == 10 );
+        REQUIRE( cpu.state == Normal );
+        REQUIRE( cpu.X() == 0xfb );
+
+        stop = cpu.run_for_instructions(ram, 0);
+        REQUIRE( stop.cause == StopBudget );
+        REQUIRE( stop.instructions == 0 );
+
+        // LDX + 256 * (DEX, BNE) + BRK
+        stop = cpu.run_for_instructions(ram, 1000);
+        REQUIRE( stop.cause == StopBRK );
+        REQUIRE( stop.instructions == 1 + 2 * 256 + 1 - 10 );
+        REQUIRE( stop.seg == 0 );
+        REQUIRE( stop.pc == 0x305 );
+        REQUIRE( cpu.instructions == 1 + 2 * 256 + 1 );
+    }
+}
+
+TEST_CASE( "run_for_cycles stops once the budget is reached", "[run]" ) {
+    for(auto engine : {Interpreted, Threaded}) {
+        Memory ram;
+        ram.init();
+        CPU cpu;
+        load_loop(ram, cpu, engine);
+        auto start = cpu.cycles;
+
+        auto stop = cpu.run_for_cycles(ram, 100);
+        REQUIRE( stop.cause == StopBudget );
+        REQUIRE( stop.cycles >= 100 );
+        REQUIRE( stop.cycles < 100 + 7 );
+        REQUIRE( cpu.cycles - start == stop.cycles );
+
+        stop = cpu.run_for_cycles(ram, 1000000);
+        REQUIRE( stop.cause == StopBRK );
+    }
+}
+
+TEST_CASE( "run reports illegal instructions", "[run]" ) {
+    for(auto engine : {Interpreted, Threaded}) {
+        Memory ram;
+        ram.init();
+        CPU cpu;
+        cpu.allow65c02 = false;
+        cpu.allow65x02 = false;
+        cpu.ignoreIllegalInstructions = false;
+        cpu.allowHalting = true;
+        init_segment_with_program(ram, {0}, 0, 0x300, {
+            LDA_Immediate, 0x40,
+            STZ_ZeroPage, 0x10
+        });
+        cpu.engine = engine;
+        cpu.reset(ram);
+
+        auto stop = cpu.run_for_instructions(ram, 100);
+        REQUIRE( stop.cause == StopIllegal );
+        REQUIRE( stop.pc == 0x302 );
+        REQUIRE( stop.describe() == "illegal instruction at 00:0302" );
+        REQUIRE( cpu.state == Halt );
+    }
+}
+
+TEST_CASE( "budgets count from after the reset a run starts with", "[run]" ) {
+    for(auto engine : {Interpreted, Threaded, Cached, Translated}) {
+        Memory ram;
+        ram.init();
+        CPU cpu;
+        load_loop(ram, cpu, engine);
+        cpu.run_for_instructions(ram, 200);
+        REQUIRE( cpu.cycles > 400 );
+
+        // init() zeroes the counters the limits are measured on
+        cpu.state = Reset;
+        auto stop = cpu.run_for_cycles(ram, 10);
+        REQUIRE( stop.cause == StopBudget );
+        REQUIRE( stop.cycles >= 10 );
+        REQUIRE( stop.cycles < 10 + 7 );
+        REQUIRE( cpu.cycles - stop.cycles == 2 ); // the reset's vector fetch
+
+        cpu.state = Reset;
+        stop = cpu.run_for_instructions(ram, 3);
+        REQUIRE( stop.cause == StopBudget );
+        REQUIRE( stop.instructions == 3 );
+        REQUIRE( cpu.instructions == 3 );
+    }
+}
@@ -0,0 +1,80 @@
+#include <cstdint>
+#include <sstream>
+#include <vector>
+#include <catch2/catch_test_macros.hpp>
+
+#include "memory.h"
+#include "cpu65x.h"
+#include "cpu65xops.h"
+
+#include "test_utils.h"
+
+TEST_CASE( "snapshots hold the pages written since the last one", "[snapshot]" ) {
+    Memory ram;
+    ram.init();
+    ram.write(0, 0x0010, 0x01);
+    ram.write(7, 0x12ff, 0x02);
+    ram.write(7, 0x1300, 0x03);
+    ram.program(9, 0xfffe, {0x04, 0x05, 0x06}); // wraps to 09:0000
+
+    auto snap1 = ram.snapshot();
+    REQUIRE( snap1.pages == std::vector<uint32_t>{0x0000, 0x0712, 0x0713, 0x0900, 0x09ff} );
+    REQUIRE( snap1.data.size() == 5 * Memory::PAGE_SIZE );
+    REQUIRE( snap1.find(0x0712)[0xff] == 0x02 );
+    REQUIRE( snap1.find(0x0900)[0x00] == 0x06 );
+    REQUIRE( snap1.find(0x0100) == nullptr );
+
+    REQUIRE( ram.snapshot().pages.empty() );
+    ram.write(7, 0x1301, 0x07);
+    auto snap2 = ram.snapshot();
+    REQUIRE( snap2.pages == std::vector<uint32_t>{0x0713} );
+
+    // init and the snapshots in order rebuild the memory
+    Memory copy;
+    copy.init();
+    copy.restore(snap1);
+    copy.restore(snap2);
+    for(auto page : {0x0000u, 0x0712u, 0x0713u, 0x0900u, 0x09ffu}) {
+        for(unsigned i=0; i<Memory::PAGE_SIZE; i++) {
+            uint16_t adr = ((page & 0xff) << 8) | i;
+            REQUIRE( copy.read(page >> 8, adr) == ram.read(page >> 8, adr) );
+        }
+    }
+
+    std::ostringstream diff;
+    Memory::dump_diff(diff, snap1, snap2);
+    REQUIRE( diff.str() ==
+        "00:0000 : only in the first snapshot\n"
+        "07:1200 : only in the first snapshot\n"
+        "07:1301 : 00 -> 07\n"
+        "09:0000 : only in the first snapshot\n"
+        "09:FF00 : only in the first snapshot\n" );
+}
+
+TEST_CASE( "cpu stores mark their pages dirty on every engine", "[snapshot]" ) {
+    for(auto engine : {Interpreted, Threaded, Cached, Translated}) {
+        Memory ram;
+        CPU cpu;
+        ram.init();
+        init_segment_with_program(ram, {0}, 0, 0x300, {
+            LDX_Immediate, 0x80,
+            STX_Absolute, 0x00, 0x40,   // 0302
+            INC_ZeroPage, 0x80,
+            DEX,
+            BNE, 0xf8,                  // to 0302
+            BRK
+        });
+        cpu.tracing = false;
+        cpu.engine = engine;
+        cpu.reset(ram);
+        // far enough for the loop to be translated
+        cpu.run_for_instructions(ram, 100);
+        ram.snapshot();
+        cpu.execute_until_break(ram);
+        auto snap = ram.snapshot();
+        // zero page, the stack BRK pushed to, and $4000
+        REQUIRE( snap.pages == std::vector<uint32_t>{0x0000, 0x0001, 0x0040} );
+        REQUIRE( snap.find(0x0000)[0x80] == 0x80 );
+        REQUIRE( snap.find(0x0040)[0x00] == 0x01 );
+    }
+}
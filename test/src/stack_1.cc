@@ -0,0 +1,119 @@
+#include <cstdint>
+#include <catch2/catch_test_macros.hpp>
+
+#include "memory.h"
+#include "cpu65x.h"
+#include "cpu65xops.h"
+
+#include "test_utils.h"
+
+TEST_CASE( "a pull returns what the last push stored", "[stack]" ) {
+    Memory ram;
+    ram.init();
+
+    CPU cpu;
+    cpu.tracing = false;
+
+    init_segment_with_program(ram, {0}, 0, 0x300, {
+        LDA_Immediate, 0x42,
+        PHA,
+        LDA_Immediate, 0x17,
+        PHA,
+        LDA_Immediate, 0x00,
+        PLA,
+        TAX,
+        PLA,
+    });
+
+    cpu.reset(ram);
+    for(int i=0; i<4; i++) cpu.execute_next_instruction(ram);
+    // pushes store at SP, then move it down
+    REQUIRE( cpu.SP == 0x1fd );
+    REQUIRE( ram.read(0, 0x1ff) == 0x42 );
+    REQUIRE( ram.read(0, 0x1fe) == 0x17 );
+
+    for(int i=0; i<4; i++) cpu.execute_next_instruction(ram);
+    REQUIRE( cpu.X() == 0x17 );
+    REQUIRE( cpu.A() == 0x42 );
+    REQUIRE( cpu.SP == 0x1ff );
+}
+
+TEST_CASE( "JSR pushes its return address less one and RTS adds the one back", "[stack]" ) {
+    Memory ram;
+    ram.init();
+
+    CPU cpu;
+    cpu.tracing = false;
+    cpu.allow65c02 = false;
+    cpu.allow65x02 = false;
+
+    init_segment_with_program(ram, {0}, 0, 0x300, {
+        JSR_Absolute, 0x00, 0x04,
+        INX,
+    });
+    ram.program(0, 0x400, {INY, RTS});
+
+    cpu.reset(ram);
+    cpu.execute_next_instruction(ram);
+    REQUIRE( cpu.PC == 0x0400 );
+    REQUIRE( cpu.SP == 0x1fd );
+    REQUIRE( ram.read(0, 0x1ff) == 0x03 );
+    REQUIRE( ram.read(0, 0x1fe) == 0x02 );
+    REQUIRE( cpu.opCC == 6 );
+
+    cpu.execute_next_instruction(ram);
+    cpu.execute_next_instruction(ram);
+    REQUIRE( cpu.PC == 0x0303 );
+    REQUIRE( cpu.SP == 0x1ff );
+    cpu.execute_next_instruction(ram);
+    REQUIRE( cpu.X() == 1 );
+    REQUIRE( cpu.Y() == 1 );
+}
+
+TEST_CASE( "the stack pointer wraps within page one", "[stack]" ) {
+    Memory ram;
+    ram.init();
+
+    CPU cpu;
+    cpu.tracing = false;
+
+    init_segment_with_program(ram, {0}, 0, 0x300, {
+        LDA_Immediate, 0x99,
+        PHA,
+        PLA,
+        PLA,
+    });
+
+    cpu.reset(ram);
+    cpu.SP = 0x100;
+    cpu.execute_next_instruction(ram);
+    cpu.execute_next_instruction(ram);
+    REQUIRE( ram.read(0, 0x100) == 0x99 );
+    REQUIRE( cpu.SP == 0x1ff );
+    cpu.execute_next_instruction(ram);
+    REQUIRE( cpu.SP == 0x100 );
+    REQUIRE( cpu.A() == 0x99 );
+    // a pull past the top wraps to the bottom of the page
+    cpu.SP = 0x1ff;
+    ram.write(0, 0x100, 0x5a);
+    cpu.execute_next_instruction(ram);
+    REQUIRE( cpu.SP == 0x100 );
+    REQUIRE( cpu.A() == 0x5a );
+}
+
+TEST_CASE( "nested calls return past the call", "[stack]" ) {
+    Memory ram;
+    CPU cpu;
+    ram.init();
+    // main calls outer, which calls inner in a loop, then calls inner itself
+    ram.program(0, 0xfffc, {0x00, 0x03});
+    ram.program(0, 0x0300, {JSR_Absolute, 0x20, 0x03, JSR_Absolute, 0x40, 0x03, BRK});
+    ram.program(0, 0x0320, {LDX_Immediate, 0x10, JSR_Absolute, 0x40, 0x03, DEX, BNE, 0xfa, RTS});
+    ram.program(0, 0x0340, {LDY_Immediate, 0x08, DEY, BNE, 0xfd, RTS});
+    cpu.haltOnBRK = true;
+    cpu.reset(ram);
+    cpu.run_for_cycles(ram, 100000);
+    REQUIRE( cpu.OP == BRK );
+    REQUIRE( cpu.opPC == 0x0306 );
+    REQUIRE( cpu.SP == 0x01ff - 3 );
+}
@@ -0,0 +1,95 @@
+#include <bitset>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <catch2/catch_test_macros.hpp>
+
+#include "memory.h"
+#include "cpu65x.h"
+#include "xutils.h"
+#include "utils.h"
+
+TEST_CASE( "text sinks write what format would", "[format]" ) {
+    std::ostringstream ostr;
+    {
+        TextSink out(ostr);
+        out.hex8(0x0a).put(' ').hex16(0xbeef).put(' ').hex32(0x0123abcd).put(' ');
+        out.address(0x01, 0x0300).put(' ').bin8(0xa5).put(' ');
+        out.dec(0).put(' ').dec(UINT64_MAX).put(' ');
+        out.printf("%-4s|%5.1f", "ab", 2.25);
+        // nothing reaches the stream before a flush
+        REQUIRE( ostr.str().empty() );
+    }
+    REQUIRE( ostr.str() == format("%02X %04X %08X %02X:%04X 10100101 0 %llu %-4s|%5.1f",
+        0x0a, 0xbeef, 0x0123abcd, 0x01, 0x0300, (unsigned long long)UINT64_MAX, "ab", 2.25) );
+
+    char buf[8];
+    REQUIRE( put_hex16(buf, 0x12f) == buf + 4 );
+    REQUIRE( std::string(buf, 4) == "012F" );
+}
+
+TEST_CASE( "text sinks carry text longer than their buffer", "[format]" ) {
+    std::string expect;
+    std::ostringstream ostr;
+    {
+        TextSink out(ostr);
+        std::string line(100, 'x');
+        for(int i=0; i<20; i++) {
+            out.put(line.c_str()).hex16(i);
+            expect += line + format("%04X", i);
+        }
+        std::string huge(3 * TextSink::CAPACITY, 'y');
+        out.put(huge.c_str());
+        expect += huge;
+        // a printf that does not fit behind the buffered text starts a new buffer
+        out.printf("%s", std::string(TextSink::CAPACITY - 10, 'z').c_str());
+        out.printf("%s", std::string(20, 'w').c_str());
+        expect += std::string(TextSink::CAPACITY - 10, 'z') + std::string(20, 'w');
+    }
+    REQUIRE( ostr.str() == expect );
+
+    // one printf longer than the buffer is cut off, as snprintf would
+    std::ostringstream cut;
+    {
+        TextSink out(cut);
+        out.printf("%s", std::string(2 * TextSink::CAPACITY, 'q').c_str());
+    }
+    REQUIRE( cut.str() == std::string(TextSink::CAPACITY - 1, 'q') );
+
+    REQUIRE( format("%s", std::string(1000, 'f').c_str()) == std::string(1000, 'f') );
+}
+
+TEST_CASE( "dumps read as before", "[format]" ) {
+    Memory ram;
+    CPU cpu;
+    ram.init();
+    ram.program(0x02, 0x0400, {0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef, 0xfe});
+    std::ostringstream mem;
+    ram.dump_memory(mem, 0x02, 0x0400, 9, 2);
+    REQUIRE( mem.str() ==
+        "02:0400 : 01 23 45 67 89 AB CD EF  FE\n"
+        "02:0409 : 00 00 00 00 00 00 00 00  00\n" );
+
+    cpu.init();
+    cpu.PC = 0x1234;
+    cpu.PS = 0x05;
+    cpu.reg32[0] = 0xdeadbeef;
+    cpu.P.setByte(0x81);
+    std::ostringstream regs;
+    cpu.dump_regs_info(regs);
+    auto p = cpu.P.asByte();
+    REQUIRE( regs.str() == format("PC=1234 SP=01FF A=%02X X=%02X Y=%02X P=%02X (%s)",
+        cpu.A(), cpu.X(), cpu.Y(), p, std::bitset<8>(p).to_string().c_str()) );
+    std::ostringstream xregs;
+    x_dump_regs_info(xregs, ram, cpu);
+    // the registers overlap, d1 is the second byte of x0
+    std::string expect = format("PC=05:1234 SP=00:01FF P=%02X (%s)\n", p, std::bitset<8>(p).to_string().c_str());
+    for(int i=0; i<8; i++) expect += format(i ? " d%d=%02X" : "d%d=%02X", i, cpu.register8(i));
+    expect += "\n";
+    for(int i=0; i<8; i++) expect += format(i ? " w%d=%04X" : "w%d=%04X", i, cpu.register16(i));
+    expect += "\n";
+    for(int i=0; i<8; i++) expect += format(i ? " x%d=%08X" : "x%d=%08X", i, cpu.reg32[i]);
+    expect += "\n";
+    REQUIRE( xregs.str() == expect );
+    REQUIRE( expect.find("x0=DEADBEEF") != std::string::npos );
+}
@@ -0,0 +1,56 @@
+#include <cstdint>
+#include <catch2/catch_test_macros.hpp>
+
+#include "memory.h"
+#include "cpu65x.h"
+#include "cpu65xops.h"
+
+#include "test_utils.h"
+
+static void run_loop(Memory& ram, CPU& cpu, ExecutionEngine engine) {
+    init_segment_with_program(ram, {0}, 0, 0x300, {
+        LDY_Immediate, 0x03,
+        LDX_Immediate, 0x10,
+        TXA,
+        ADC_ZeroPage, 0x10,
+        STA_AbsoluteX, 0x00, 0x20,
+        DEX,
+        BNE, 0xf7,
+        DEY,
+        BNE, 0xf3,
+        XTOP3_MATH, 0x80, 0xef, 0xbe, 0xad, 0xde, // add.l %x0, #$deadbeef
+        BRK
+    });
+    ram.write(0, 0x10, 0x05);
+    cpu.tracing = false;
+    cpu.allow65c02 = true;
+    cpu.allow65x02 = true;
+    cpu.engine = engine;
+    cpu.reset(ram);
+    cpu.execute_until_break(ram);
+}
+
+TEST_CASE( "threaded engine matches the interpreter", "[threaded]" ) {
+    Memory ram1, ram2;
+    ram1.init();
+    ram2.init();
+    CPU interp, threaded;
+
+    run_loop(ram1, interp, Interpreted);
+    run_loop(ram2, threaded, Threaded);
+
+    REQUIRE( threaded.state == interp.state );
+    REQUIRE( threaded.PC == interp.PC );
+    REQUIRE( threaded.SP == interp.SP );
+    REQUIRE( threaded.P.asByte() == interp.P.asByte() );
+    REQUIRE( threaded.cycles == interp.cycles );
+    REQUIRE( threaded.opCC == interp.opCC );
+    REQUIRE( threaded.OP == BRK );
+    for(int i=0; i<8; i++) {
+        REQUIRE( threaded.reg32[i] == interp.reg32[i] );
+    }
+    for(int adr=0x2000; adr<0x2020; adr++) {
+        REQUIRE( ram2.read(0, adr) == ram1.read(0, adr) );
+    }
+    REQUIRE( ram2.read(0, 0x2010) == 0x15 );
+}
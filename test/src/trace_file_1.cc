@@ -0,0 +1,147 @@
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <catch2/catch_test_macros.hpp>
+
+#include "memory.h"
+#include "cpu65x.h"
+#include "cpu65xops.h"
+#include "tracefile.h"
+
+#include "test_utils.h"
+
+// records a 256 x 256 loop (about 330000 instructions) and returns the trace file
+static std::vector<uint8_t> record_loop(CPU& cpu) {
+    char name[] = "/tmp/trace_file_1_XXXXXX";
+    int fd = mkstemp(name);
+    REQUIRE( fd >= 0 );
+    close(fd);
+
+    Memory ram;
+    TraceWriter writer(1 << 20);
+    ram.init();
+    ram.program(0, 0xfffc, {0x00, 0x03});
+    ram.program(0, 0x0300, {
+        LDY_Immediate, 0x00,
+        LDX_Immediate, 0x00,
+        TXA,
+        ADC_ZeroPage, 0x10,
+        STA_ZeroPage, 0x11,
+        DEX,
+        BNE, 0xf8,
+        DEY,
+        BNE, 0xf3,
+        BRK
+    });
+    cpu.haltOnBRK = true;
+    cpu.traceRing = &writer.ring;
+    writer.start(name);
+    cpu.reset(ram);
+    while(cpu.state == Normal) {
+        // small steps the writer keeps up with, so nothing is dropped
+        cpu.run_for_instructions(ram, 10000);
+        while(writer.ring.tail != writer.ring.head) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    writer.stop();
+    REQUIRE( writer.ring.dropped == 0 );
+
+    std::ifstream file(name, std::ios::binary);
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    unlink(name);
+    return bytes;
+}
+
+static size_t count(const std::string& text, const std::string& what) {
+    size_t n = 0;
+    for(auto at = text.find(what); at != std::string::npos; at = text.find(what, at + 1)) n++;
+    return n;
+}
+
+TEST_CASE( "a trace file replays the run compactly", "[trace]" ) {
+    CPU cpu;
+    auto bytes = record_loop(cpu);
+    // accesses included, under an eighth of the two ring slots an instruction takes
+    REQUIRE( bytes.size() < cpu.instructions * 2 * sizeof(TraceRecord) / 8 );
+
+    TraceReader reader(bytes.data(), bytes.size());
+    REQUIRE( reader.index.size() == (cpu.instructions + TraceEncoder::KEYFRAME_INTERVAL - 1) / TraceEncoder::KEYFRAME_INTERVAL );
+    TraceEvent ev;
+    uint64_t instructions = 0, writes = 0;
+    while(reader.next(ev)) {
+        if(ev.kind == TraceInstruction) instructions++;
+        if(ev.kind == TraceWrite) writes++;
+    }
+    REQUIRE( instructions == cpu.instructions );
+    REQUIRE( writes == 256 * 256 + 3 ); // the STAs and what BRK pushes
+    auto& s = reader.state;
+    REQUIRE( s.instructions == cpu.instructions );
+    REQUIRE( s.cycles == cpu.cycles );
+    REQUIRE( s.op == BRK );
+    REQUIRE( s.PC == cpu.PC );
+    REQUIRE( s.SP == cpu.SP );
+    REQUIRE( s.P == cpu.P.asByte() );
+    for(int i=0; i<8; i++) REQUIRE( s.reg32[i] == cpu.reg32[i] );
+}
+
+TEST_CASE( "trace files seek by cycle and filter by PC", "[trace]" ) {
+    CPU cpu;
+    auto bytes = record_loop(cpu);
+    std::ostringstream full;
+    dump_trace(bytes.data(), bytes.size(), full);
+    REQUIRE( count(full.str(), " OP=") == cpu.instructions );
+
+    // from the middle of the third stretch between keyframes
+    TraceReader reader(bytes.data(), bytes.size());
+    auto cycle = reader.index[2].cycles + (reader.index[3].cycles - reader.index[2].cycles) / 2;
+    REQUIRE( reader.find_cycle(cycle) == 2 );
+    TraceFilter filter;
+    filter.fromCycle = cycle;
+    filter.count = 5;
+    std::ostringstream part;
+    dump_trace(bytes.data(), bytes.size(), part, filter);
+    REQUIRE( count(part.str(), " OP=") == 5 );
+    REQUIRE( full.str().find(part.str()) != std::string::npos );
+
+    TraceFilter dey;
+    dey.minPC = dey.maxPC = 0x030c;
+    std::ostringstream only;
+    dump_trace(bytes.data(), bytes.size(), only, dey);
+    REQUIRE( count(only.str(), "00:030C OP=88\n") == 256 );
+    REQUIRE( count(only.str(), " OP=") == 256 );
+
+    TraceFilter extended;
+    extended.count = 1;
+    extended.extended = true;
+    std::ostringstream x;
+    dump_trace(bytes.data(), bytes.size(), x, extended);
+    REQUIRE( x.str() ==
+        "00:0300 OP=A0\n"
+        "  read 00:FFFC=00\n"
+        "  read 00:FFFD=03\n"
+        "PC=00:0302 SP=00:01FF P=22 (00100010)\n"
+        "d0=00 d1=00 d2=00 d3=00 d4=00 d5=00 d6=00 d7=00\n"
+        "w0=0000 w1=0000 w2=0000 w3=0000 w4=0000 w5=0000 w6=0000 w7=0000\n"
+        "x0=00000000 x1=00000000 x2=00000000 x3=00000000 x4=00000000 x5=00000000 x6=00000000 x7=00000000\n" );
+}
+
+TEST_CASE( "a trace file without its index reads from the start", "[trace]" ) {
+    CPU cpu;
+    auto bytes = record_loop(cpu);
+    TraceTrailer trailer;
+    memcpy(&trailer, bytes.data() + bytes.size() - sizeof(trailer), sizeof(trailer));
+    std::ostringstream full, cut;
+    dump_trace(bytes.data(), bytes.size(), full);
+    dump_trace(bytes.data(), trailer.indexOffset, cut);
+    REQUIRE( cut.str() == full.str() );
+
+    TraceReader reader(bytes.data(), trailer.indexOffset);
+    REQUIRE( reader.index.empty() );
+    TraceEvent ev;
+    // a file cut mid-entry ends in an error, not garbage
+    TraceReader torn(bytes.data(), 200);
+    REQUIRE_THROWS( [&] { while(torn.next(ev)) {} }() );
+}
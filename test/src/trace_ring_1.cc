@@ -0,0 +1,108 @@
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <catch2/catch_test_macros.hpp>
+
+#include "memory.h"
+#include "cpu65x.h"
+#include "cpu65xops.h"
+#include "tracefile.h"
+
+#include "test_utils.h"
+
+static TraceRecord access(uint16_t adr) {
+    TraceRecord r = {};
+    r.kind = TraceWrite;
+    r.adr = adr;
+    return r;
+}
+
+TEST_CASE( "a full trace ring drops records and marks the gap", "[trace]" ) {
+    TraceRing ring(3);
+    REQUIRE( ring.mask == 3 );
+    for(uint16_t i=1; i<=4; i++) {
+        auto r = access(i);
+        REQUIRE( ring.push(&r) );
+    }
+    auto r5 = access(5);
+    auto r6 = access(6);
+    REQUIRE_FALSE( ring.push(&r5) );
+    REQUIRE_FALSE( ring.push(&r6) );
+    REQUIRE( ring.dropped == 2 );
+
+    TraceRecord out[8];
+    REQUIRE( ring.pop(out, 2) == 2 );
+    REQUIRE( out[0].adr == 1 );
+    REQUIRE( out[1].adr == 2 );
+    auto r7 = access(7);
+    REQUIRE( ring.push(&r7) );
+    REQUIRE( ring.pop(out, 8) == 4 );
+    REQUIRE( out[0].adr == 3 );
+    REQUIRE( out[1].adr == 4 );
+    REQUIRE( out[2].kind == TraceLost );
+    REQUIRE( out[2].cycles == 2 );
+    REQUIRE( out[3].adr == 7 );
+    REQUIRE( ring.pop(out, 8) == 0 );
+}
+
+TEST_CASE( "runs with a trace ring record instructions and accesses", "[trace]" ) {
+    char name[] = "/tmp/trace_ring_1_XXXXXX";
+    int fd = mkstemp(name);
+    REQUIRE( fd >= 0 );
+    close(fd);
+
+    for(auto engine : {Interpreted, Threaded, Cached, Translated}) {
+        Memory ram;
+        CPU cpu;
+        TraceWriter writer;
+        ram.init();
+        ram.program(0, 0xfffc, {0x00, 0x03});
+        ram.program(0, 0x0300, {
+            LDA_Immediate, 0x42,
+            STA_ZeroPage, 0x10,
+            PHA,
+            LDX_ZeroPage, 0x10,
+            BRK
+        });
+        cpu.engine = engine;
+        cpu.traceRing = &writer.ring;
+        writer.start(name);
+        cpu.reset(ram);
+        cpu.execute_until_break(ram);
+        writer.stop();
+        REQUIRE( cpu.X() == 0x42 );
+        REQUIRE( writer.ring.dropped == 0 );
+
+        std::ifstream file(name, std::ios::binary);
+        std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        std::ostringstream text;
+        dump_trace(bytes.data(), bytes.size(), text);
+        // accesses are listed under the instruction after them, so the first gets the reset vector reads
+        std::string expect =
+            "00:0300 OP=A9\n"
+            "  read 00:FFFC=00\n"
+            "  read 00:FFFD=03\n"
+            "PC=0302 SP=01FF A=42 X=00 Y=00 P=20 (00100000)\n"
+            "00:0302 OP=85\n"
+            "  wrote 00:0010=42\n"
+            "PC=0304 SP=01FF A=42 X=00 Y=00 P=20 (00100000)\n"
+            "00:0304 OP=48\n"
+            "  wrote 00:01FF=42\n"
+            "PC=0305 SP=01FE A=42 X=00 Y=00 P=20 (00100000)\n"
+            "00:0305 OP=A6\n"
+            "  read 00:0010=42\n"
+            "PC=0307 SP=01FE A=42 X=42 Y=00 P=20 (00100000)\n";
+        REQUIRE( text.str().substr(0, expect.size()) == expect );
+        REQUIRE( writer.written > 5 );
+    }
+    unlink(name);
+}
+
+TEST_CASE( "dump_trace rejects other files", "[trace]" ) {
+    std::string junk = "not a trace at all, just some text";
+    std::ostringstream text;
+    REQUIRE_THROWS( dump_trace(reinterpret_cast<const uint8_t*>(junk.data()), junk.size(), text) );
+}
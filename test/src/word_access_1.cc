@@ -0,0 +1,71 @@
+#include <cstdint>
+#include <vector>
+#include <catch2/catch_test_macros.hpp>
+
+#include "memory.h"
+#include "cpu65x.h"
+#include "cpu65xops.h"
+
+#include "test_utils.h"
+
+// reads back the low byte of the address and keeps the last byte written
+struct Echo : MemoryDevice {
+    uint8_t value = 0;
+    uint8_t read(uint8_t seg, uint16_t adr) override { return adr & 0xff; }
+    void write(uint8_t seg, uint16_t adr, uint8_t byte) override { value = byte; }
+};
+
+TEST_CASE( "words are little endian and wrap at the end of the segment", "[memory]" ) {
+    Memory ram;
+    CPU cpu;
+    ram.init();
+    cpu.reset(ram);
+    ram.program(2, 0x10ff, {0x11, 0x22, 0x33, 0x44});
+    ram.program(2, 0xfffe, {0x55, 0x66, 0x77, 0x88});
+
+    auto cycles = cpu.cycles;
+    REQUIRE( cpu.readWord<NoTrace>(ram, 2, 0x10ff) == 0x2211 );
+    REQUIRE( cpu.readLongWord<NoTrace>(ram, 2, 0x10ff) == 0x44332211 );
+    REQUIRE( cpu.readLongWord<NoTrace>(ram, 2, 0xfffe) == 0x88776655 );
+    REQUIRE( cpu.readWord<NoTrace>(ram, 2, 0xffff) == 0x7766 );
+    REQUIRE( cpu.cycles - cycles == 12 );
+
+    ram.snapshot();
+    cpu.writeLongWord<NoTrace>(ram, 3, 0x20fe, 0xa1b2c3d4);
+    REQUIRE( ram.peek(3, 0x20fe) == 0xd4 );
+    REQUIRE( ram.peek(3, 0x2101) == 0xa1 );
+    REQUIRE( ram.snapshot().pages.size() == 2 );
+
+    cpu.writeLongWord<NoTrace>(ram, 3, 0xfffd, 0x01020304);
+    REQUIRE( ram.peek(3, 0xfffd) == 0x04 );
+    REQUIRE( ram.peek(3, 0xffff) == 0x02 );
+    REQUIRE( ram.peek(3, 0x0000) == 0x01 );
+    REQUIRE( ram.peek(4, 0x0000) == 0x00 );
+    cpu.writeWord<NoTrace>(ram, 3, 0xffff, 0xbeef);
+    REQUIRE( ram.peek(3, 0xffff) == 0xef );
+    REQUIRE( ram.peek(3, 0x0000) == 0xbe );
+}
+
+TEST_CASE( "words across mapped pages go a byte at a time", "[memory]" ) {
+    Memory ram;
+    CPU cpu;
+    Echo echo;
+    ram.init();
+    cpu.reset(ram);
+    ram.program(0, 0xc0fe, {0x11, 0x22});
+    ram.map_device(0, 0xc100, 0x100, &echo);
+    ram.map_rom(0, 0xc200, 0x100);
+
+    REQUIRE( cpu.readLongWord<NoTrace>(ram, 0, 0xc0fe) == 0x01002211 );
+    cpu.writeLongWord<NoTrace>(ram, 0, 0xc0fe, 0x44332211);
+    REQUIRE( echo.value == 0x44 );
+    REQUIRE( ram.peek(0, 0xc100) == 0x00 );
+
+    // the ROM page drops its half of the word
+    cpu.writeWord<NoTrace>(ram, 0, 0xc1ff, 0x5566);
+    REQUIRE( echo.value == 0x66 );
+    REQUIRE( ram.peek(0, 0xc200) == 0x00 );
+    cpu.writeLongWord<NoTrace>(ram, 0, 0xc2fe, 0x01020304);
+    REQUIRE( ram.peek(0, 0xc2fe) == 0x00 );
+    REQUIRE( ram.peek(0, 0xc300) == 0x02 );
+}
@@ -44,4 +44,39 @@ TEST_CASE("xtop1_trx", "[xtop1_trx]") {
     REQUIRE( cpu.registerDS() == 0x40 );
     cpu.execute_next_instruction(ram);
     REQUIRE( cpu.register8(D3) == 0x040);
-}
\ No newline at end of file
+}
+TEST_CASE("xtop1_trx retargets data and stack access", "[xtop1_trx]") {
+    Memory ram;
+    CPU cpu;
+
+    ram.init();
+
+    cpu.tracing = false;
+    cpu.allow65c02 = false;
+    cpu.allow65x02 = true;
+
+    init_segment_with_program(ram, {0}, 0, 0x300, {
+        LDA_Immediate, 0x05,
+        XTOP1_TRX, xtop1_trx(0, D1, DS), // %ds <- %d1
+        LDA_ZeroPage, 0x10,
+        STA_ZeroPage, 0x11,
+        LDA_Immediate, 0x06,
+        XTOP1_TRX, xtop1_trx(0, D1, SS), // %ss <- %d1
+        PHA,
+    });
+    ram.write(5, 0x10, 0x77);
+
+    cpu.reset(ram);
+    for(int i=0; i<7; i++) cpu.execute_next_instruction(ram);
+
+    REQUIRE( ram.read(5, 0x11) == 0x77 );
+    REQUIRE( ram.read(0, 0x11) == 0x00 );
+    REQUIRE( ram.read(6, 0x1ff) == 0x06 );
+    REQUIRE( ram.read(0, 0x1ff) == 0x00 );
+
+    // a reset selects segment 0 again
+    cpu.reset(ram);
+    REQUIRE( cpu.registerDS() == 0x00 );
+    REQUIRE( cpu.dsData == ram.segments[0].memory );
+    REQUIRE( cpu.ssData == ram.segments[0].memory );
+}
@@ -0,0 +1,170 @@
+#include <algorithm>
+#include <cstdlib>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+#include "batch.h"
+#include "cpu65x.h"
+#include "cpu65xops.h"
+#include "farm.h"
+#include "tracefile.h"
+#include "utils.h"
+
+/*
+    Measures guest instructions per second for each execution engine
+    on a small nested-loop program.
+
+        0300: LDY #$00
+        0302: LDX #$00
+        0304: TXA
+        0305: ADC $10
+        0307: STA $11
+        0309: DEX
+        030A: BNE $0304
+        030C: DEY
+        030D: BNE $0302
+        030F: DEC $12      ; $12 holds the outer pass count
+        0311: BNE $0300
+        0313: BRK
+*/
+
+static void load_program(Memory& ram, uint8_t passes) {
+    ram.init();
+    ram.program(0x00, 0xfffa, {0x00, 0x03, 0x00, 0x03, 0x00, 0x03});
+    ram.program(0x00, 0x0300, {
+        LDY_Immediate, 0x00,
+        LDX_Immediate, 0x00,
+        TXA,
+        ADC_ZeroPage, 0x10,
+        STA_ZeroPage, 0x11,
+        DEX,
+        BNE, 0xf8,
+        DEY,
+        BNE, 0xf3,
+        DEC_ZeroPage, 0x12,
+        BNE, 0xed,
+        BRK
+    });
+    ram.write(0x00, 0x12, passes);
+}
+
+static uint64_t count_instructions(Memory& ram, uint8_t passes) {
+    CPU cpu;
+    load_program(ram, passes);
+    cpu.reset(ram);
+    cpu.haltOnBRK = true;
+    uint64_t count = 0;
+    do {
+        cpu.execute_next_instruction(ram);
+        count++;
+    } while(cpu.state == Normal);
+    return count;
+}
+
+static double run(Memory& ram, uint8_t passes, ExecutionEngine engine, bool fuse, bool lazy, bool record, bool count, uint64_t& cycles) {
+    CPU cpu;
+    TraceWriter writer;
+    OpStats stats;
+    cpu.engine = engine;
+    cpu.fuseInstructions = fuse;
+    cpu.lazyFlags = lazy;
+    if(record) {
+        writer.start("/dev/null");
+        cpu.traceRing = &writer.ring;
+    }
+    if(count) cpu.opStats = &stats;
+    load_program(ram, passes);
+    cpu.reset(ram);
+    auto t0 = std::chrono::steady_clock::now();
+    cpu.execute_until_break(ram);
+    auto t1 = std::chrono::steady_clock::now();
+    cycles = cpu.cycles;
+    writer.stop();
+    return std::chrono::duration<double>(t1 - t0).count();
+}
+
+int main(int argc, const char** argv) {
+    uint8_t passes = argc > 1 ? atoi(argv[1]) : 16;
+    int repeat = argc > 2 ? atoi(argv[2]) : 10;
+    Memory ram;
+    auto instructions = count_instructions(ram, passes);
+    std::cout << format("%llu instructions per run\n", (unsigned long long)instructions);
+
+    const struct { const char* name; ExecutionEngine engine; bool fuse; bool lazy; bool record; bool count; } engines[] = {
+        { "interpreted", Interpreted, false, false, false, false },
+        { "lazy flags", Interpreted, false, true, false, false },
+        { "threaded", Threaded, false, false, false, false },
+        { "cached", Cached, false, false, false, false },
+        { "cached lazy", Cached, false, true, false, false },
+        { "fused", Cached, true, false, false, false },
+        { "translated", Translated, false, false, false, false },
+        { "recorded", Threaded, false, false, true, false },
+        { "counted", Threaded, false, false, false, true },
+    };
+    const int n = sizeof(engines) / sizeof(engines[0]);
+    double best[n] = {};
+    uint64_t cycles[n] = {};
+    // interleave the engines so host noise hits them alike; keep the best run
+    for(int i=0; i<repeat; i++) {
+        for(int e=0; e<n; e++) {
+            auto t = run(ram, passes, engines[e].engine, engines[e].fuse, engines[e].lazy, engines[e].record, engines[e].count, cycles[e]);
+            if(i == 0 || t < best[e]) best[e] = t;
+        }
+    }
+    for(int e=0; e<n; e++) {
+        double ips = instructions / best[e];
+        double baseline = instructions / best[0];
+        std::cout << format("%-12s %8.2f MIPS  %5.2fx  (%llu cycles)\n",
+            engines[e].name, ips / 1e6, ips / baseline, (unsigned long long)cycles[e]);
+    }
+
+    // the same program on a full batch of lanes in lockstep, counting every lane's instructions
+    {
+        Memory lram[CpuBatch::LANES];
+        CPU lcpu[CpuBatch::LANES];
+        double lbest = 0;
+        CpuBatch batch;
+        for(unsigned l=0; l<CpuBatch::LANES; l++) batch.add(lcpu[l], lram[l]);
+        for(int i=0; i<repeat; i++) {
+            for(unsigned l=0; l<CpuBatch::LANES; l++) {
+                load_program(lram[l], passes);
+                lram[l].write(0x00, 0x10, l);
+                lcpu[l].haltOnBRK = true;
+                lcpu[l].reset(lram[l]);
+            }
+            auto t0 = std::chrono::steady_clock::now();
+            batch.run_for_cycles(UINT64_MAX / 2);
+            auto t = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+            if(i == 0 || t < lbest) lbest = t;
+        }
+        double ips = instructions * CpuBatch::LANES / lbest;
+        std::cout << format("%-12s %8.2f MIPS  %5.2fx  (%u lanes)\n",
+            "lockstep", ips / 1e6, ips / (instructions / best[0]), CpuBatch::LANES);
+    }
+
+    // the same program as a batch of translated instances, one thread against all cores
+    std::cout << "\nfarm:\n";
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    for(unsigned threads : {1u, cores}) {
+        VmFarm farm(threads);
+        for(unsigned i=0; i<4 * cores; i++) {
+            auto& inst = farm.add();
+            load_program(inst.ram, passes);
+            inst.cpu.engine = Translated;
+            inst.cpu.haltOnBRK = true;
+        }
+        auto stats = farm.run();
+        std::cout << format("%2u threads   %8.2f MIPS  %zu instances, %llu slices, %llu steals\n",
+            threads, stats.mips(), stats.instances, (unsigned long long)stats.slices, (unsigned long long)stats.steals);
+        if(cores == 1) break;
+    }
+
+    // which fusions fired during one fused run
+    Memory fram;
+    uint64_t fcycles;
+    run(fram, passes, Cached, true, false, false, false, fcycles);
+    std::cout << "\nfused runs:\n";
+    fram.blockCache().dump_fusions(std::cout);
+    return EXIT_SUCCESS;
+}
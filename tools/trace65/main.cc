@@ -0,0 +1,76 @@
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "tracefile.h"
+#include "utils.h"
+
+/*
+    Renders a trace file written by TraceWriter as text.
+
+        trace65 [-x] [-c cycle] [-p lo-hi] [-n count] file
+
+        -x        show the registers as x_dump_regs_info does
+        -c cycle  start at the first instruction finishing at or after cycle
+        -p lo-hi  only instructions starting at a PC in lo-hi (hex)
+        -n count  stop after count instructions
+
+    The file is mapped, not read, so seeking into a large trace only
+    touches the pages around the keyframe it starts from.
+*/
+
+static int usage() {
+    std::cerr << "usage: trace65 [-x] [-c cycle] [-p lo-hi] [-n count] file\n";
+    return EXIT_FAILURE;
+}
+
+int main(int argc, const char** argv) {
+    TraceFilter filter;
+    const char* path = nullptr;
+    for(int i=1; i<argc; i++) {
+        auto arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if(!strcmp(arg, "-x")) {
+            filter.extended = true;
+        } else if(!strcmp(arg, "-c") && hasValue) {
+            filter.fromCycle = strtoull(argv[++i], nullptr, 0);
+        } else if(!strcmp(arg, "-n") && hasValue) {
+            filter.count = strtoull(argv[++i], nullptr, 0);
+        } else if(!strcmp(arg, "-p") && hasValue) {
+            char* dash;
+            filter.minPC = strtoul(argv[++i], &dash, 16);
+            if(*dash != '-') return usage();
+            filter.maxPC = strtoul(dash + 1, nullptr, 16);
+        } else if(arg[0] != '-' && path == nullptr) {
+            path = arg;
+        } else {
+            return usage();
+        }
+    }
+    if(path == nullptr) return usage();
+
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if(fd < 0 || fstat(fd, &st) != 0) {
+        std::cerr << format("trace65: cannot open %s: %s\n", path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED) {
+        std::cerr << format("trace65: cannot map %s: %s\n", path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    try {
+        dump_trace(static_cast<const uint8_t*>(data), st.st_size, std::cout, filter);
+    } catch(const std::exception& e) {
+        std::cerr << "trace65: " << path << ": " << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+    munmap(data, st.st_size);
+    return EXIT_SUCCESS;
+}